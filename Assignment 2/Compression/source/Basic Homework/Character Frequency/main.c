@@ -1,10 +1,615 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
 #define uint unsigned int
 
+typedef unsigned char uint8;
+typedef unsigned int uint32;
+typedef unsigned long long uint64;
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+// With -f the inputs are files, each mapped and split into segments the
+//    threads take in turn. Every thread counts into its own table and the
+//    tables are merged once every file is done, so the counts are for the
+//    whole corpus. Bytes and bigrams are counted straight into arrays,
+//    longer n-grams and words go into open addressing hash tables.
+#define SEGMENT_SIZE ((uint64)16 << 20)
+#define MAX_NGRAM 8
+#define DEFAULT_TOP 50
+#define INITIAL_TABLE_BITS 12
+// -n w counts whitespace delimited words rather than n-grams.
+#define WORDS 0
+
+typedef void (*ThreadFunction)(void* argument);
+
+// A table entry is empty while its length is 0. Keys of up to 8 bytes, every
+//    n-gram and most words, are kept in key itself so most lookups touch a
+//    single cache line, longer ones are kept in the table's arena and key
+//    is where.
+typedef struct
+{
+	uint64 key;
+	uint64 count;
+	uint32 hash;
+	uint32 length;
+} Entry;
+
+typedef struct
+{
+	Entry* entries;
+	uint64 mask;
+	uint64 used;
+	uint8* arena;
+	uint64 arenaSize;
+	uint64 arenaCapacity;
+	// Bytes and bigrams, indexed by the bytes themselves.
+	uint64* direct;
+} Table;
+
+typedef struct
+{
+	const uint8* data;
+	uint64 size;
+	uint32 unit;
+	volatile uint64 nextSegment;
+	uint64 segmentCount;
+	volatile uint64 nextTable;
+	Table* tables;
+} Counter;
+
+void* allocateOrExit(uint64 size)
+{
+	void* memory = calloc(size > 0 ? size : 1, 1);
+	if (memory == NULL)
+	{
+		printf("Out of memory!\n");
+		exit(-1);
+	}
+	return memory;
+}
+
+uint32 getProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32)count : 1;
+#endif
+}
+
+uint64 atomicAdd(volatile uint64* value, uint64 amount)
+{
+#ifdef _WIN32
+	return InterlockedExchangeAdd64((volatile LONG64*)value, amount) + amount;
+#else
+	return __atomic_add_fetch(value, amount, __ATOMIC_SEQ_CST);
+#endif
+}
+
+typedef struct
+{
+	ThreadFunction function;
+	void* argument;
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI _threadMain(LPVOID start)
+{
+	((ThreadStart*)start)->function(((ThreadStart*)start)->argument);
+	return 0;
+}
+#else
+static void* _threadMain(void* start)
+{
+	((ThreadStart*)start)->function(((ThreadStart*)start)->argument);
+	return 0;
+}
+#endif
+
+// Runs function on threadCount threads, including this one, and waits for them all.
+void runOnThreads(uint32 threadCount, ThreadFunction function, void* argument)
+{
+	ThreadStart start = { function, argument };
+	uint32 started = 0;
+#ifdef _WIN32
+	HANDLE* threads = calloc(threadCount, sizeof(HANDLE));
+	for (uint32 i = 1; threads && i < threadCount; ++i)
+		if ((threads[started] = CreateThread(NULL, 0, _threadMain, &start, 0, NULL)) != NULL)
+			++started;
+	function(argument);
+	for (uint32 i = 0; i < started; ++i)
+	{
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+#else
+	pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+	for (uint32 i = 1; threads && i < threadCount; ++i)
+		if (pthread_create(threads + started, NULL, _threadMain, &start) == 0)
+			++started;
+	function(argument);
+	for (uint32 i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+#endif
+	free(threads);
+}
+
+// Maps the whole file read only, returns 0 if it can't. Empty files
+//    can't be mapped so come back as a pointer to nothing with size 0.
+const uint8* mapFile(const char* path, uint64* size)
+{
+	static const uint8 empty = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return 0;
+	LARGE_INTEGER fileSize;
+	const uint8* data = 0;
+	if (GetFileSizeEx(file, &fileSize))
+	{
+		*size = fileSize.QuadPart;
+		if (*size == 0)
+			data = &empty;
+		else
+		{
+			HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping != NULL)
+			{
+				data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
+			}
+		}
+	}
+	CloseHandle(file);
+	return data;
+#else
+	int descriptor = open(path, O_RDONLY);
+	if (descriptor < 0) return 0;
+	struct stat info;
+	const uint8* data = 0;
+	if (fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode))
+	{
+		*size = info.st_size;
+		if (*size == 0)
+			data = &empty;
+		else
+		{
+			void* mapped = mmap(0, *size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (mapped != MAP_FAILED)
+			{
+				madvise(mapped, *size, MADV_SEQUENTIAL);
+				data = mapped;
+			}
+		}
+	}
+	close(descriptor);
+	return data;
+#endif
+}
+
+void unmapFile(const uint8* data, uint64 size)
+{
+	if (size == 0) return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+}
+
+// Up to the first 8 bytes of a key, little endian and padded with 0's.
+//    When there are 8 bytes to read before end they are loaded at once
+//    and masked, which is a lot cheaper than copying length bytes.
+static inline uint64 packKey(const uint8* p, uint32 length, const uint8* end)
+{
+	uint64 key = 0;
+	if (end - p >= 8)
+	{
+		memcpy(&key, p, 8);
+		return length >= 8 ? key : key & (((uint64)1 << (length * 8)) - 1);
+	}
+	memcpy(&key, p, length < 8 ? length : 8);
+	return key;
+}
+
+// packed is the key's first 8 bytes from packKey, all of it if it's short.
+static inline uint32 hashKey(const uint8* p, uint32 length, uint64 packed)
+{
+	uint64 h = length * 0x9E3779B97F4A7C15ull;
+	if (length > 8)
+	{
+		const uint8* end = p + length;
+		for (; end - p > 8; p += 8)
+		{
+			uint64 v;
+			memcpy(&v, p, 8);
+			h = (h ^ v) * 0xFF51AFD7ED558CCDull;
+			h ^= h >> 32;
+		}
+		packed = packKey(p, (uint32)(end - p), end);
+	}
+	h = (h ^ packed) * 0x9E3779B97F4A7C15ull;
+	return (uint32)(h >> 32);
+}
+
+const uint8* getKey(const Table* table, const Entry* e)
+{
+	return e->length <= 8 ? (const uint8*)&e->key : table->arena + e->key;
+}
+
+void createTable(Table* table, uint32 unit)
+{
+	memset(table, 0, sizeof(Table));
+	if (unit == 1 || unit == 2)
+	{
+		table->direct = allocateOrExit(((uint64)1 << (unit * 8)) * sizeof(uint64));
+		return;
+	}
+	table->mask = ((uint64)1 << INITIAL_TABLE_BITS) - 1;
+	table->entries = allocateOrExit((table->mask + 1) * sizeof(Entry));
+}
+
+void destroyTable(Table* table)
+{
+	free(table->direct);
+	free(table->entries);
+	free(table->arena);
+}
+
+// Doubles the table, which is kept at most half full so probes stay short.
+void growTable(Table* table)
+{
+	Entry* old = table->entries;
+	uint64 oldSize = table->mask + 1;
+	table->mask = oldSize * 2 - 1;
+	table->entries = allocateOrExit((table->mask + 1) * sizeof(Entry));
+	for (uint64 i = 0; i < oldSize; ++i)
+	{
+		if (old[i].length == 0) continue;
+		uint64 slot = old[i].hash & table->mask;
+		while (table->entries[slot].length != 0)
+			slot = (slot + 1) & table->mask;
+		table->entries[slot] = old[i];
+	}
+	free(old);
+}
+
+// Adds count to the key's entry, creating it if it's new. packed is
+//    packKey of the key.
+void addKey(Table* table, const uint8* p, uint32 length, uint64 packed, uint64 count)
+{
+	uint32 hash = hashKey(p, length, packed);
+	for (uint64 slot = hash & table->mask;; slot = (slot + 1) & table->mask)
+	{
+		Entry* e = table->entries + slot;
+		if (e->length == 0)
+		{
+			e->hash = hash;
+			e->length = length;
+			e->count = count;
+			e->key = packed;
+			if (length > 8)
+			{
+				if (table->arenaSize + length > table->arenaCapacity)
+				{
+					table->arenaCapacity = (table->arenaCapacity + length) * 2;
+					table->arena = realloc(table->arena, table->arenaCapacity);
+					if (table->arena == NULL)
+					{
+						printf("Out of memory!\n");
+						exit(-1);
+					}
+				}
+				memcpy(table->arena + table->arenaSize, p, length);
+				e->key = table->arenaSize;
+				table->arenaSize += length;
+			}
+			if (++table->used * 2 > table->mask + 1)
+				growTable(table);
+			return;
+		}
+		if (e->hash == hash && e->length == length && (length <= 8 ? e->key == packed : memcmp(table->arena + e->key, p, length) == 0))
+		{
+			e->count += count;
+			return;
+		}
+	}
+}
+
+static inline bool isWhitespace(uint8 c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Counts the units that start in [begin, end) of the data, reading past
+//    end to finish the last of them.
+void countSegment(const uint8* data, uint64 size, uint64 begin, uint64 end, uint32 unit, Table* table)
+{
+	if (unit == 1)
+	{
+		for (uint64 i = begin; i < end; ++i)
+			++table->direct[data[i]];
+	}
+	else if (unit == 2)
+	{
+		uint64 last = end < size - 1 ? end : size - 1;
+		for (uint64 i = begin; i < last && size > 1; ++i)
+			++table->direct[data[i] | (data[i + 1] << 8)];
+	}
+	else if (unit != WORDS)
+	{
+		uint64 last = size >= unit ? size - unit + 1 : 0;
+		last = end < last ? end : last;
+		for (uint64 i = begin; i < last; ++i)
+			addKey(table, data + i, unit, packKey(data + i, unit, data + size), 1);
+	}
+	else
+	{
+		// A word that starts before the segment belongs to the one before.
+		uint64 i = begin;
+		if (i > 0)
+			while (i < end && !isWhitespace(data[i - 1]))
+				++i;
+		for (;;)
+		{
+			while (i < end && isWhitespace(data[i]))
+				++i;
+			if (i >= end) break;
+			uint64 start = i;
+			while (i < size && !isWhitespace(data[i]))
+				++i;
+			addKey(table, data + start, (uint32)(i - start), packKey(data + start, (uint32)(i - start), data + size), 1);
+		}
+	}
+}
+
+void countWorker(void* argument)
+{
+	Counter* counter = argument;
+	Table* table = counter->tables + atomicAdd(&counter->nextTable, 1) - 1;
+	for (uint64 segment = atomicAdd(&counter->nextSegment, 1) - 1; segment < counter->segmentCount; segment = atomicAdd(&counter->nextSegment, 1) - 1)
+	{
+		uint64 begin = segment * SEGMENT_SIZE;
+		uint64 end = begin + SEGMENT_SIZE < counter->size ? begin + SEGMENT_SIZE : counter->size;
+		countSegment(counter->data, counter->size, begin, end, counter->unit, table);
+	}
+}
+
+// Adds every count in from to into.
+void mergeTable(Table* into, const Table* from, uint32 unit)
+{
+	if (into->direct)
+	{
+		for (uint64 i = 0; i < ((uint64)1 << (unit * 8)); ++i)
+			into->direct[i] += from->direct[i];
+		return;
+	}
+	for (uint64 i = 0; i <= from->mask; ++i)
+	{
+		const Entry* e = from->entries + i;
+		if (e->length == 0) continue;
+		const uint8* key = getKey(from, e);
+		addKey(into, key, e->length, e->length <= 8 ? e->key : packKey(key, e->length, key + e->length), e->count);
+	}
+}
+
+// Orders by count, most first, then by key so the output is the same
+//    whatever order things were counted in.
+bool isBefore(const Table* table, const Entry* a, const Entry* b)
+{
+	if (a->count != b->count) return a->count > b->count;
+	uint32 length = a->length < b->length ? a->length : b->length;
+	int order = memcmp(getKey(table, a), getKey(table, b), length);
+	return order != 0 ? order < 0 : a->length < b->length;
+}
+
+// Keeps the k entries that come first in a heap with the one that comes
+//    last at the top, so each entry only has to beat that one to get in.
+void siftDown(const Table* table, Entry** heap, uint64 count, uint64 i)
+{
+	for (;;)
+	{
+		uint64 child = i * 2 + 1;
+		if (child >= count) return;
+		if (child + 1 < count && isBefore(table, heap[child], heap[child + 1]))
+			++child;
+		if (!isBefore(table, heap[i], heap[child])) return;
+		Entry* t = heap[i];
+		heap[i] = heap[child];
+		heap[child] = t;
+		i = child;
+	}
+}
+
+void printKey(const uint8* key, uint32 length)
+{
+	putchar('"');
+	for (uint32 i = 0; i < length; ++i)
+	{
+		uint8 c = key[i];
+		if (c == '"' || c == '\\') printf("\\%c", c);
+		else if (c == '\n') printf("\\n");
+		else if (c == '\t') printf("\\t");
+		else if (c == '\r') printf("\\r");
+		else if (c < 32 || c > 126) printf("\\x%02X", c);
+		else putchar(c);
+	}
+	putchar('"');
+}
+
+// Prints the top entries of the merged table, tab separated so it can be
+//    fed straight to whatever trains the codes.
+void printTop(Table* table, uint32 unit, uint64 top)
+{
+	// Bytes and bigrams become entries too so everything is printed the same way.
+	if (table->direct)
+	{
+		Table entries;
+		createTable(&entries, MAX_NGRAM);
+		for (uint64 i = 0; i < ((uint64)1 << (unit * 8)); ++i)
+		{
+			if (table->direct[i] == 0) continue;
+			uint8 key[2] = { (uint8)i, (uint8)(i >> 8) };
+			addKey(&entries, key, unit, i, table->direct[i]);
+		}
+		destroyTable(table);
+		*table = entries;
+	}
+
+	uint64 total = 0;
+	Entry** heap = allocateOrExit((top > 0 ? top : 1) * sizeof(Entry*));
+	uint64 heapCount = 0;
+	for (uint64 i = 0; i <= table->mask; ++i)
+	{
+		Entry* e = table->entries + i;
+		if (e->length == 0) continue;
+		total += e->count;
+		if (heapCount < top)
+		{
+			heap[heapCount++] = e;
+			for (uint64 j = heapCount - 1; j > 0 && isBefore(table, heap[(j - 1) / 2], heap[j]); j = (j - 1) / 2)
+			{
+				Entry* t = heap[j];
+				heap[j] = heap[(j - 1) / 2];
+				heap[(j - 1) / 2] = t;
+			}
+		}
+		else if (top > 0 && isBefore(table, e, heap[0]))
+		{
+			heap[0] = e;
+			siftDown(table, heap, heapCount, 0);
+		}
+	}
+
+	// Taking the last off the top each time leaves them in order from the back.
+	for (uint64 end = heapCount; end > 1; --end)
+	{
+		Entry* t = heap[0];
+		heap[0] = heap[end - 1];
+		heap[end - 1] = t;
+		siftDown(table, heap, end - 1, 0);
+	}
+
+	printf("%llu Distinct, %llu Total\n", table->used, total);
+	printf("%14s\t%8s\t%s\n", "Count", "Percent", unit == WORDS ? "Word" : "N-Gram");
+	for (uint64 i = 0; i < heapCount; ++i)
+	{
+		printf("%14llu\t%7.3f%%\t", heap[i]->count, total > 0 ? (double)heap[i]->count / (double)total * 100.0 : 0);
+		printKey(getKey(table, heap[i]), heap[i]->length);
+		putchar('\n');
+	}
+	free(heap);
+}
+
+void printUsage()
+{
+	printf("usage: freq <string>\n");
+	printf("       freq [-n <1-8|w>] [-k <top>] [-t <threads>] -f <file>...\n\n");
+	printf("Given a string the occurance of each character in it is printed.\n\n");
+	printf("    -f The inputs are files, the counts are for all of them together.\n");
+	printf("    -n Count bytes (1, the default), n byte n-grams or, with w, whitespace delimited words.\n");
+	printf("    -k <top> Print the top most frequent, 50 by default, 0 for all of them.\n");
+	printf("    -t <threads> Threads to count with, every processor by default.\n");
+}
+
+// Counts the files given with -f, returns how many couldn't be read.
+int countFiles(int argc, char** argv)
+{
+	uint32 unit = 1, threadCount = getProcessorCount();
+	uint64 top = DEFAULT_TOP;
+	bool all = false;
+	int failed = 0;
+	Table* tables = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (argv[i][0] == '-' && argv[i][1] != '\0' && argv[i][2] == '\0')
+		{
+			if (argv[i][1] == 'f') continue;
+			if (i + 1 >= argc || tables)
+			{
+				printUsage();
+				return -1;
+			}
+			const char* value = argv[++i];
+			switch (argv[i - 1][1])
+			{
+			case 'n':
+				unit = value[0] == 'w' ? WORDS : (uint32)atoi(value);
+				if (unit > MAX_NGRAM || (unit == 0 && value[0] != 'w'))
+				{
+					printUsage();
+					return -1;
+				}
+				continue;
+			case 'k':
+				top = atoll(value);
+				all = top == 0;
+				continue;
+			case 't':
+				threadCount = atoi(value) < 1 ? 1 : atoi(value);
+				continue;
+			}
+			printUsage();
+			return -1;
+		}
+
+		if (tables == 0)
+		{
+			tables = allocateOrExit(threadCount * sizeof(Table));
+			for (uint32 t = 0; t < threadCount; ++t)
+				createTable(tables + t, unit);
+		}
+
+		Counter counter = { 0 };
+		counter.data = mapFile(argv[i], &counter.size);
+		if (counter.data == 0)
+		{
+			printf("%s: Could not be opened!\n", argv[i]);
+			++failed;
+			continue;
+		}
+		counter.unit = unit;
+		counter.tables = tables;
+		counter.segmentCount = (counter.size + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+		uint32 threads = counter.segmentCount < threadCount ? (uint32)counter.segmentCount : threadCount;
+		runOnThreads(threads > 0 ? threads : 1, countWorker, &counter);
+		unmapFile(counter.data, counter.size);
+	}
+	if (tables == 0)
+	{
+		printUsage();
+		return -1;
+	}
+
+	for (uint32 t = 1; t < threadCount; ++t)
+	{
+		mergeTable(tables, tables + t, unit);
+		destroyTable(tables + t);
+	}
+	printTop(tables, unit, all ? (tables->direct ? (uint64)1 << (unit * 8) : tables->used) : top);
+	destroyTable(tables);
+	free(tables);
+	return failed;
+}
 
 int main(int argc, char** argv)
 {
+	for (int i = 1; i < argc; ++i)
+		if (strcmp(argv[i], "-f") == 0)
+			return countFiles(argc, argv);
+
 	if (argc != 2)
 	{
 		printf("Please provide a single string to count the occurance of characters.\n");
@@ -14,7 +619,7 @@ int main(int argc, char** argv)
 	// We will ignore anything less than 0 and 0 itself
 	uint occurances[126];
 	memset(occurances, 0, sizeof(uint) * 126);
-	
+
 	for (char*p = argv[1]; *p != '\0'; ++p)
 	{
 		if (*p < 0)
@@ -37,4 +642,4 @@ int main(int argc, char** argv)
 		}
 
 	return 0;
-}
\ No newline at end of file
+}
@@ -1,9 +1,25 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
 #include <math.h>
+#include <time.h>
 #define uint unsigned int
 
+typedef unsigned char uint8;
+typedef unsigned int uint32;
+typedef unsigned long long uint64;
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
 // We are just supporting standard ascii characters here.
 #define MAX_DICTIONARY_LENGTH 128
 
@@ -19,7 +35,6 @@ double getAverageCodeLength(const char* dictionary, const uint* countMap)
 {
 	// Note: We are going to ignore \0
 	if (dictionary[0] != '[') return -1;
-	const char* p = dictionary + 1;
 	char c;
 	unsigned int count = 0;
 	double average = 0.0;
@@ -136,10 +151,10 @@ double getShannonEntropy(uint count, const uint* countMap)
 	return -entropy;
 }
 
-// Due to the command line removing quotes this program is just
-//    going to require internal modification as I only need to
-//    run it once..
-int main(int argc, char** argv)
+// Due to the command line removing quotes this part of the program
+//    is just going to require internal modification as I only need to
+//    run it once.. It's what runs when no files are given.
+void runDemo()
 {
 	// Input because bash removes escaped quotes, which sorta defeats
 	//    the point of escaping them..
@@ -177,4 +192,527 @@ int main(int argc, char** argv)
 
 	printf("The average code length in bits of the dictionary provided is: %.3f bits\n", avg);
 	printf("Shannon entropy for the string provided is:                    %.3f bits\n", ent);
-}
\ No newline at end of file
+}
+
+// ---- File Analyzer ----
+//
+// Given files, each is mapped into memory and split into segments which
+//    the threads take in turn, so the file is read once, roughly in order,
+//    by every thread at once. For each order k up to the one asked for we
+//    count every byte under the context of the k bytes before it and
+//    report the conditional entropy H(X | previous k bytes) in bits per
+//    byte. Orders 0 and 1 have a row of 256 counts for every context.
+//    From order 2 there are too many contexts so they are hashed into
+//    2^bucketBits rows, contexts that share a row are counted as one,
+//    which can only lose information, so those figures are upper bounds.
+//
+// Segments carry the bytes before them as history so the result doesn't
+//    depend on how the file was split or how many threads there were.
+#define MAX_ORDER 8
+#define DEFAULT_ORDER 3
+#define DEFAULT_BUCKET_BITS 14
+#define MAX_BUCKET_BITS 24
+#define SEGMENT_SIZE ((uint64)16 << 20)
+
+typedef void (*ThreadFunction)(void* argument);
+
+typedef struct
+{
+	const uint8* data;
+	uint64 size;
+	uint32 order;
+	uint32 bucketBits;
+	volatile uint64 nextSegment;
+	uint64 segmentCount;
+	// Rows of 256 counts for each order, summed from every thread.
+	uint64* totals[MAX_ORDER + 1];
+	uint64 rows[MAX_ORDER + 1];
+} Analysis;
+
+uint32 getProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32)count : 1;
+#endif
+}
+
+uint64 atomicAdd(volatile uint64* value, uint64 amount)
+{
+#ifdef _WIN32
+	return InterlockedExchangeAdd64((volatile LONG64*)value, amount) + amount;
+#else
+	return __atomic_add_fetch(value, amount, __ATOMIC_SEQ_CST);
+#endif
+}
+
+typedef struct
+{
+	ThreadFunction function;
+	void* argument;
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI _threadMain(LPVOID start)
+{
+	((ThreadStart*)start)->function(((ThreadStart*)start)->argument);
+	return 0;
+}
+#else
+static void* _threadMain(void* start)
+{
+	((ThreadStart*)start)->function(((ThreadStart*)start)->argument);
+	return 0;
+}
+#endif
+
+// Runs function on threadCount threads, including this one, and waits for them all.
+void runOnThreads(uint32 threadCount, ThreadFunction function, void* argument)
+{
+	ThreadStart start = { function, argument };
+	uint32 started = 0;
+#ifdef _WIN32
+	HANDLE* threads = calloc(threadCount, sizeof(HANDLE));
+	for (uint32 i = 1; threads && i < threadCount; ++i)
+		if ((threads[started] = CreateThread(NULL, 0, _threadMain, &start, 0, NULL)) != NULL)
+			++started;
+	function(argument);
+	for (uint32 i = 0; i < started; ++i)
+	{
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+#else
+	pthread_t* threads = calloc(threadCount, sizeof(pthread_t));
+	for (uint32 i = 1; threads && i < threadCount; ++i)
+		if (pthread_create(threads + started, NULL, _threadMain, &start) == 0)
+			++started;
+	function(argument);
+	for (uint32 i = 0; i < started; ++i)
+		pthread_join(threads[i], NULL);
+#endif
+	free(threads);
+}
+
+// Maps the whole file read only, returns 0 if it can't. Empty files
+//    can't be mapped so come back as a pointer to nothing with size 0.
+const uint8* mapFile(const char* path, uint64* size)
+{
+	static const uint8 empty = 0;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return 0;
+	LARGE_INTEGER fileSize;
+	const uint8* data = 0;
+	if (GetFileSizeEx(file, &fileSize))
+	{
+		*size = fileSize.QuadPart;
+		if (*size == 0)
+			data = &empty;
+		else
+		{
+			HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping != NULL)
+			{
+				data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+				CloseHandle(mapping);
+			}
+		}
+	}
+	CloseHandle(file);
+	return data;
+#else
+	int descriptor = open(path, O_RDONLY);
+	if (descriptor < 0) return 0;
+	struct stat info;
+	const uint8* data = 0;
+	if (fstat(descriptor, &info) == 0 && S_ISREG(info.st_mode))
+	{
+		*size = info.st_size;
+		if (*size == 0)
+			data = &empty;
+		else
+		{
+			void* mapped = mmap(0, *size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+			if (mapped != MAP_FAILED)
+			{
+				// Segments are handed out in order so the file is read
+				//    more or less front to back, let the kernel read ahead.
+				madvise(mapped, *size, MADV_SEQUENTIAL);
+				data = mapped;
+			}
+		}
+	}
+	close(descriptor);
+	return data;
+#endif
+}
+
+void unmapFile(const uint8* data, uint64 size)
+{
+	if (size == 0) return;
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+#else
+	munmap((void*)data, size);
+#endif
+}
+
+double now()
+{
+	struct timespec t;
+	timespec_get(&t, TIME_UTC);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// The row a hashed order's context, its bytes of the history, counts in.
+#define HASHED_ROW(context, bucketBits) (((context) * 0x9E3779B97F4A7C15ull) >> (64 - (bucketBits)))
+
+// The row a context of order bytes counts in, history holds the previous
+//    bytes with the most recent in the lowest 8 bits.
+static inline uint64 getContextRow(uint64 history, uint32 order, uint32 bucketBits)
+{
+	if (order == 0) return 0;
+	if (order == 1) return history & 0xFF;
+	uint64 context = order == 8 ? history : history & (((uint64)1 << (order * 8)) - 1);
+	return HASHED_ROW(context, bucketBits);
+}
+
+// Adds a thread's counts to the totals and clears them. Most rows of the
+//    hashed orders are empty so only the counts that aren't 0 are added.
+void flushCounts(Analysis* analysis, uint32** counts)
+{
+	for (uint32 order = 0; order <= analysis->order; ++order)
+	{
+		uint64 cells = analysis->rows[order] * 256;
+		for (uint64 i = 0; i < cells; ++i)
+		{
+			if (counts[order][i] == 0) continue;
+			atomicAdd(analysis->totals[order] + i, counts[order][i]);
+			counts[order][i] = 0;
+		}
+	}
+}
+
+// Each thread counts into its own 32 bit tables, added to the 64 bit
+//    totals before any count could have overflowed.
+void analyzeWorker(void* argument)
+{
+	Analysis* analysis = argument;
+	uint32* counts[MAX_ORDER + 1] = { 0 };
+	for (uint32 order = 0; order <= analysis->order; ++order)
+	{
+		counts[order] = calloc(analysis->rows[order] * 256, sizeof(uint32));
+		if (counts[order] == NULL)
+		{
+			printf("Out of memory!\n");
+			exit(-1);
+		}
+	}
+
+	uint32 maxOrder = analysis->order, bucketBits = analysis->bucketBits;
+	uint64 sinceFlush = 0;
+	for (uint64 segment = atomicAdd(&analysis->nextSegment, 1) - 1; segment < analysis->segmentCount; segment = atomicAdd(&analysis->nextSegment, 1) - 1)
+	{
+		uint64 begin = segment * SEGMENT_SIZE;
+		uint64 end = begin + SEGMENT_SIZE < analysis->size ? begin + SEGMENT_SIZE : analysis->size;
+		if (sinceFlush + (end - begin) > 0xFFFFFFFFull)
+		{
+			flushCounts(analysis, counts);
+			sinceFlush = 0;
+		}
+		sinceFlush += end - begin;
+
+		const uint8* data = analysis->data;
+		uint64 history = 0;
+		for (uint64 i = begin >= MAX_ORDER ? begin - MAX_ORDER : 0; i < begin; ++i)
+			history = (history << 8) | data[i];
+
+		// The first bytes of the file don't have a full context for every order.
+		uint64 i = begin;
+		for (; i < end && i < maxOrder; ++i)
+		{
+			for (uint32 order = 0; order <= i; ++order)
+				++counts[order][getContextRow(history, order, bucketBits) * 256 + data[i]];
+			history = (history << 8) | data[i];
+		}
+
+		// Every order from maxOrder down falls through to the next, each
+		//    with its own constant mask, which is about twice as fast as
+		//    looping over the orders.
+#define COUNT_HASHED(order, mask) ++counts[order][HASHED_ROW(history & (mask), bucketBits) * 256 + symbol]
+		for (; i < end; ++i)
+		{
+			uint8 symbol = data[i];
+			switch (maxOrder)
+			{
+			case 8: COUNT_HASHED(8, 0xFFFFFFFFFFFFFFFFull); // Fall through
+			case 7: COUNT_HASHED(7, 0xFFFFFFFFFFFFFFull); // Fall through
+			case 6: COUNT_HASHED(6, 0xFFFFFFFFFFFFull); // Fall through
+			case 5: COUNT_HASHED(5, 0xFFFFFFFFFFull); // Fall through
+			case 4: COUNT_HASHED(4, 0xFFFFFFFFull); // Fall through
+			case 3: COUNT_HASHED(3, 0xFFFFFFull); // Fall through
+			case 2: COUNT_HASHED(2, 0xFFFFull); // Fall through
+			case 1: ++counts[1][(history & 0xFF) * 256 + symbol]; // Fall through
+			default: ++counts[0][symbol];
+			}
+			history = (history << 8) | symbol;
+		}
+#undef COUNT_HASHED
+	}
+
+	flushCounts(analysis, counts);
+	for (uint32 order = 0; order <= analysis->order; ++order)
+		free(counts[order]);
+}
+
+// H(X | context) from rows of 256 counts, the entropy of each row weighted
+//    by how many symbols it saw. *contexts is set to how many rows were used.
+double getConditionalEntropy(const uint64* rows, uint64 rowCount, uint64* contexts)
+{
+	double bits = 0;
+	uint64 total = 0;
+	*contexts = 0;
+	for (uint64 row = 0; row < rowCount; ++row)
+	{
+		const uint64* counts = rows + row * 256;
+		uint64 rowTotal = 0;
+		for (uint32 i = 0; i < 256; ++i)
+			rowTotal += counts[i];
+		if (rowTotal == 0) continue;
+
+		++*contexts;
+		total += rowTotal;
+		for (uint32 i = 0; i < 256; ++i)
+			if (counts[i] > 0)
+				bits += counts[i] * log2((double)rowTotal / (double)counts[i]);
+	}
+	return total > 0 ? bits / (double)total : 0;
+}
+
+// Analyzes the file at path and prints its entropy for every order up to
+//    order. Returns false if it couldn't be read.
+bool analyzeFile(const char* path, uint32 order, uint32 bucketBits, uint32 threadCount)
+{
+	Analysis analysis = { 0 };
+	analysis.data = mapFile(path, &analysis.size);
+	if (analysis.data == 0)
+	{
+		printf("%s: Could not be opened!\n", path);
+		return false;
+	}
+	analysis.order = order;
+	analysis.bucketBits = bucketBits;
+	analysis.segmentCount = (analysis.size + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+	if (threadCount > analysis.segmentCount)
+		threadCount = analysis.segmentCount > 0 ? (uint32)analysis.segmentCount : 1;
+
+	bool allocated = true;
+	for (uint32 o = 0; o <= order; ++o)
+	{
+		analysis.rows[o] = o == 0 ? 1 : o == 1 ? 256 : (uint64)1 << bucketBits;
+		analysis.totals[o] = calloc(analysis.rows[o] * 256, sizeof(uint64));
+		allocated &= analysis.totals[o] != NULL;
+	}
+
+	if (allocated)
+	{
+		double start = now();
+		runOnThreads(threadCount, analyzeWorker, &analysis);
+		double seconds = now() - start;
+
+		double megabytes = (double)analysis.size / (1024.0 * 1024.0);
+		printf("%s: %llu Bytes on %u Threads in %.2f Seconds (%.1f MB/s)\n", path, analysis.size, threadCount, seconds,
+			seconds > 0 ? megabytes / seconds : 0);
+		printf("%7s %18s %14s\n", "Order", "Entropy (Bits)", "Contexts");
+		for (uint32 o = 0; o <= order; ++o)
+		{
+			uint64 contexts;
+			double entropy = getConditionalEntropy(analysis.totals[o], analysis.rows[o], &contexts);
+			if (o < 2)
+				printf("%7u %18.4f %14llu\n", o, entropy, contexts);
+			else
+				printf("%7u %18.4f %14llu of %llu hashed, an upper bound\n", o, entropy, contexts, analysis.rows[o]);
+		}
+	}
+	else
+		printf("%s: Not enough memory for %u orders of 2^%u contexts!\n", path, order, bucketBits);
+
+	for (uint32 o = 0; o <= order; ++o)
+		free(analysis.totals[o]);
+	unmapFile(analysis.data, analysis.size);
+	return allocated;
+}
+
+// ---- Window Profile ----
+//
+// With -w the order 0 entropy of every window of that many bytes, starting
+//    every step bytes, is written as CSV instead. The windows are tumbling
+//    when step is the window and sliding when it's smaller, the last is cut
+//    short by the end of the file. The histogram is kept up to date a byte
+//    at a time as the window moves, along with the sum of c * log2(c) over
+//    its counts c, which is all the entropy needs:
+//
+//    H = log2(n) - sum(c * log2(c)) / n
+//
+//    The sum is kept in fixed point, c * log2(c) for every count a window
+//    can have is looked up in a table rounded to 1/2^ENTROPY_FIXED_BITS of
+//    a bit, so it's exact integer adds and never drifts however long the
+//    file is. Every byte enters the window once and leaves it once.
+#define MAX_WINDOW ((uint64)1 << 24)
+#define ENTROPY_FIXED_BITS 20
+
+// Builds the table of c * log2(c), in fixed point, for c up to window.
+uint64* createEntropyTable(uint64 window)
+{
+	uint64* table = malloc((window + 1) * sizeof(uint64));
+	if (table == NULL) return 0;
+	table[0] = 0;
+	for (uint64 c = 1; c <= window; ++c)
+		table[c] = (uint64)((double)c * log2((double)c) * (double)(1 << ENTROPY_FIXED_BITS) + 0.5);
+	return table;
+}
+
+// Writes a line of CSV for every window of the file at path, see above.
+//    Returns false if the file couldn't be read.
+bool profileFile(const char* path, uint64 window, uint64 step, const uint64* table)
+{
+	uint64 size;
+	const uint8* data = mapFile(path, &size);
+	if (data == 0)
+	{
+		fprintf(stderr, "%s: Could not be opened!\n", path);
+		return false;
+	}
+
+	// Quote the path for the CSV, doubling any quotes in it.
+	char quoted[1024];
+	size_t q = 0;
+	quoted[q++] = '"';
+	for (const char* p = path; *p != '\0' && q < sizeof(quoted) - 3; ++p)
+	{
+		if (*p == '"')
+			quoted[q++] = '"';
+		quoted[q++] = *p;
+	}
+	quoted[q++] = '"';
+	quoted[q] = '\0';
+
+	uint64 counts[256] = { 0 };
+	uint64 sum = 0;
+	// The window is [start, end) of the file.
+	uint64 start = 0, end = 0;
+	for (uint64 offset = 0; offset < size; offset += step)
+	{
+		uint64 windowEnd = offset + window < size ? offset + window : size;
+
+		// Steps larger than the window skip bytes altogether.
+		if (offset > end)
+		{
+			memset(counts, 0, sizeof(counts));
+			sum = 0;
+			start = end = offset;
+		}
+		// Bytes that have left the window go before new ones come in, so
+		//    no count is ever more than the window and past the table.
+		for (; start < offset; ++start)
+		{
+			uint64* c = counts + data[start];
+			sum -= table[*c] - table[*c - 1];
+			--*c;
+		}
+		for (; end < windowEnd; ++end)
+		{
+			uint64* c = counts + data[end];
+			sum += table[*c + 1] - table[*c];
+			++*c;
+		}
+
+		uint64 n = end - start;
+		double entropy = log2((double)n) - (double)sum / (double)(1 << ENTROPY_FIXED_BITS) / (double)n;
+		printf("%s,%llu,%llu,%.4f\n", quoted, start, n, entropy < 0 ? 0 : entropy);
+		if (windowEnd == size) break;
+	}
+
+	unmapFile(data, size);
+	return true;
+}
+
+void printUsage()
+{
+	printf("usage: entropy [-k <order>] [-b <bits>] [-t <threads>] [-w <bytes> [-s <bytes>]] <file>...\n\n");
+	printf("With no files the built in string and dictionary are measured.\n\n");
+	printf("    -k <order> Report the entropy of each byte given the up to 8 bytes before it, 3 by default.\n");
+	printf("    -b <bits> Orders above 1 hash their contexts into 2^bits rows of counts, 14 by default.\n");
+	printf("       Each row is 1KB per thread, more rows are more accurate.\n");
+	printf("    -t <threads> Threads to count with, every processor by default.\n");
+	printf("    -w <bytes> Write the entropy of every window of this many bytes, up to 16MB, as CSV\n");
+	printf("       (file,offset,bytes,entropy) instead, windows start every -s <bytes>, by default\n");
+	printf("       the window so they don't overlap.\n");
+}
+
+int main(int argc, char** argv)
+{
+	uint32 order = DEFAULT_ORDER, bucketBits = DEFAULT_BUCKET_BITS, threadCount = getProcessorCount();
+	uint64 window = 0, step = 0;
+	uint64* entropyTable = 0;
+	int files = 0, failed = 0;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (argv[i][0] == '-' && argv[i][1] != '\0' && argv[i][2] == '\0' && i + 1 < argc)
+		{
+			long long value = atoll(argv[++i]);
+			switch (argv[i - 1][1])
+			{
+			case 'w':
+				window = value < 1 ? 1 : value > (long long)MAX_WINDOW ? MAX_WINDOW : (uint64)value;
+				continue;
+			case 's':
+				step = value < 1 ? 1 : value;
+				continue;
+			case 'k':
+				order = value < 0 ? 0 : value > MAX_ORDER ? MAX_ORDER : value;
+				continue;
+			case 'b':
+				bucketBits = value < 8 ? 8 : value > MAX_BUCKET_BITS ? MAX_BUCKET_BITS : value;
+				continue;
+			case 't':
+				threadCount = value < 1 ? 1 : value;
+				continue;
+			}
+			printUsage();
+			return -1;
+		}
+		if (window > 0)
+		{
+			if (entropyTable == 0)
+			{
+				entropyTable = createEntropyTable(window);
+				if (entropyTable == 0)
+				{
+					printf("Not enough memory for a window of %llu bytes!\n", window);
+					return -1;
+				}
+				// The profile can be millions of lines.
+				setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+				printf("file,offset,bytes,entropy\n");
+			}
+			++files;
+			failed += !profileFile(argv[i], window, step > 0 ? step : window, entropyTable);
+			continue;
+		}
+
+		if (files++ > 0)
+			printf("\n");
+		failed += !analyzeFile(argv[i], order, bucketBits, threadCount);
+	}
+
+	if (files == 0)
+		runDemo();
+	free(entropyTable);
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Checks the windowed entropy profile (-w/-s) on a file of one repeated
+#    byte, every window of it must have an entropy of exactly 0. Builds
+#    with AddressSanitizer so reading past the entropy table fails too.
+#    usage: ./test.sh [compiler], run from anywhere.
+cd "$(dirname "$0")" || exit 1
+CC=${1:-cc}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+$CC -O1 -g -fsanitize=address -o "$dir/entropy" main.c -lm -pthread || exit 1
+printf 'aaaaaaaaaaaaaaaa' > "$dir/single"
+
+failed=0
+# check <name> <expected windows> <flags...>
+check()
+{
+	name=$1
+	expected=$2
+	shift 2
+	if ! "$dir/entropy" "$@" "$dir/single" > "$dir/out"; then
+		echo "FAIL $name: entropy exited with an error"
+		failed=1
+		return
+	fi
+	windows=$(tail -n +2 "$dir/out" | wc -l)
+	nonzero=$(tail -n +2 "$dir/out" | awk -F, '$4 != "0.0000"' | wc -l)
+	if [ "$windows" -ne "$expected" ] || [ "$nonzero" -ne 0 ]; then
+		echo "FAIL $name: $windows windows, $nonzero not 0, expected $expected windows all 0"
+		cat "$dir/out"
+		failed=1
+	else
+		echo "ok   $name"
+	fi
+}
+
+check "step < window" 7 -w 4 -s 2
+check "step == window" 4 -w 4 -s 4
+check "default step" 4 -w 4
+exit $failed
@@ -0,0 +1,116 @@
+#include "checksum.h"
+#include <stdbool.h>
+#include <string.h>
+
+// Hardware CRC32C is only available on x86-64 with SSE4.2, everywhere
+//    else we fall back to the slicing-by-8 tables.
+#if defined(_M_X64) || defined(__x86_64__)
+#define CRC32C_HARDWARE
+#ifdef _WIN32
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <nmmintrin.h>
+#endif
+
+// Reversed Castagnoli polynomial
+#define CRC32C_POLYNOMIAL 0x82F63B78
+
+static uint32 crcTable[8][256];
+static bool crcInitialized = false;
+static bool crcHardware = false;
+
+void initCRC32C()
+{
+	if (crcInitialized) return;
+
+	// crcTable[0] is the classic byte at a time table, each following
+	//    table is the crc of that byte followed by n zero bytes which
+	//    lets us fold 8 bytes per step rather than 1.
+	for (uint32 i = 0; i < 256; ++i)
+	{
+		uint32 crc = i;
+		for (uint8 bit = 0; bit < 8; ++bit)
+			crc = (crc >> 1) ^ (CRC32C_POLYNOMIAL & (0 - (crc & 1)));
+		crcTable[0][i] = crc;
+	}
+	for (uint32 i = 0; i < 256; ++i)
+		for (uint8 t = 1; t < 8; ++t)
+			crcTable[t][i] = (crcTable[t - 1][i] >> 8) ^ crcTable[0][crcTable[t - 1][i] & 0xFF];
+
+#ifdef CRC32C_HARDWARE
+#ifdef _WIN32
+	int info[4];
+	__cpuid(info, 1);
+	crcHardware = (info[2] & (1 << 20)) != 0;
+#else
+	unsigned int a, b, c, d;
+	crcHardware = __get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_2) != 0;
+#endif
+#endif
+
+	crcInitialized = true;
+}
+
+static uint32 _crc32cSoftware(uint32 crc, const uint8* p, uint64 size)
+{
+	// Byte at a time until we are 8 byte aligned
+	for (; size > 0 && ((size_t)p & 7) != 0; --size)
+		crc = (crc >> 8) ^ crcTable[0][(crc ^ *p++) & 0xFF];
+
+	// Little endian only, as is everything else in this program.
+	for (; size >= 8; size -= 8, p += 8)
+	{
+		uint32 lo, hi;
+		memcpy(&lo, p, 4);
+		memcpy(&hi, p + 4, 4);
+		lo ^= crc;
+		crc = crcTable[7][lo & 0xFF] ^ crcTable[6][(lo >> 8) & 0xFF] ^
+			crcTable[5][(lo >> 16) & 0xFF] ^ crcTable[4][lo >> 24] ^
+			crcTable[3][hi & 0xFF] ^ crcTable[2][(hi >> 8) & 0xFF] ^
+			crcTable[1][(hi >> 16) & 0xFF] ^ crcTable[0][hi >> 24];
+	}
+
+	for (; size > 0; --size)
+		crc = (crc >> 8) ^ crcTable[0][(crc ^ *p++) & 0xFF];
+
+	return crc;
+}
+
+#ifdef CRC32C_HARDWARE
+#ifndef _WIN32
+__attribute__((target("sse4.2")))
+#endif
+static uint32 _crc32cHardware(uint32 crc, const uint8* p, uint64 size)
+{
+	for (; size > 0 && ((size_t)p & 7) != 0; --size)
+		crc = _mm_crc32_u8(crc, *p++);
+
+	uint64 crc64 = crc;
+	for (; size >= 8; size -= 8, p += 8)
+	{
+		uint64 v;
+		memcpy(&v, p, 8);
+		crc64 = _mm_crc32_u64(crc64, v);
+	}
+	crc = (uint32)crc64;
+
+	for (; size > 0; --size)
+		crc = _mm_crc32_u8(crc, *p++);
+
+	return crc;
+}
+#endif
+
+uint32 crc32c(uint32 crc, const void* data, uint64 size)
+{
+	if (!crcInitialized) initCRC32C();
+
+	crc = ~crc;
+#ifdef CRC32C_HARDWARE
+	if (crcHardware)
+		return ~_crc32cHardware(crc, (const uint8*)data, size);
+#endif
+	return ~_crc32cSoftware(crc, (const uint8*)data, size);
+}
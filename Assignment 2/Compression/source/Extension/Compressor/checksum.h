@@ -0,0 +1,12 @@
+#ifndef COMPRESSOR_CHECKSUM_H
+#define COMPRESSOR_CHECKSUM_H
+
+#include "common.h"
+
+// CRC32C (Castagnoli), the same checksum used by iSCSI, ext4 and SSE4.2's
+//    crc32 instruction. Calls can be chained, passing the result of the
+//    previous call as crc, so crc32c(crc32c(0, a), b) == crc32c(0, a + b).
+void initCRC32C();
+uint32 crc32c(uint32 crc, const void* data, uint64 size);
+
+#endif
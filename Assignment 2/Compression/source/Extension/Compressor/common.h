@@ -0,0 +1,11 @@
+#ifndef COMPRESSOR_COMMON_H
+#define COMPRESSOR_COMMON_H
+
+typedef unsigned char uint8;
+typedef unsigned short uint16;
+typedef short int16;
+typedef unsigned int uint32;
+typedef unsigned long long uint64;
+typedef long long int64;
+
+#endif
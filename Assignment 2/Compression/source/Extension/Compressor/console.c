@@ -0,0 +1,69 @@
+#include "console.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// The 8 characters each byte expands to, built the first time they're needed.
+static uint64 bitStrings[256];
+static bool bitStringsBuilt = false;
+
+static bool _writeAll(const uint8* p, uint64 count)
+{
+	while (count > 0)
+	{
+		unsigned int size = count > CONSOLE_CHUNK_SIZE ? CONSOLE_CHUNK_SIZE : (unsigned int)count;
+		long long written = write(1, p, size);
+		if (written <= 0)
+		{
+#ifndef _WIN32
+			if (written < 0 && errno == EINTR) continue;
+#endif
+			return false;
+		}
+		p += written;
+		count -= written;
+	}
+	return true;
+}
+
+bool writeConsole(const uint8* buffer, uint64 count)
+{
+	fflush(stdout);
+	return _writeAll(buffer, count);
+}
+
+bool writeConsoleBits(const uint8* buffer, uint64 count)
+{
+	if (!bitStringsBuilt)
+	{
+		for (uint16 i = 0; i < 256; ++i)
+		{
+			char bits[8];
+			for (uint8 bit = 0; bit < 8; ++bit)
+				bits[bit] = '0' + ((i >> (7 - bit)) & 1);
+			memcpy(bitStrings + i, bits, 8);
+		}
+		bitStringsBuilt = true;
+	}
+
+	fflush(stdout);
+	uint8 chunk[CONSOLE_CHUNK_SIZE];
+	while (count > 0)
+	{
+		uint64 bytes = count > CONSOLE_CHUNK_SIZE / 8 ? CONSOLE_CHUNK_SIZE / 8 : count;
+		for (uint64 i = 0; i < bytes; ++i)
+			memcpy(chunk + i * 8, bitStrings + buffer[i], 8);
+		if (!_writeAll(chunk, bytes * 8))
+			return false;
+		buffer += bytes;
+		count -= bytes;
+	}
+	return true;
+}
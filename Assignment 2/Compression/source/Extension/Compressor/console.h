@@ -0,0 +1,19 @@
+#ifndef COMPRESSOR_CONSOLE_H
+#define COMPRESSOR_CONSOLE_H
+
+#include <stdbool.h>
+#include "common.h"
+
+// Size of the chunks handed to write(), printing a byte at a time with
+//    printf made dumping even a few MB take minutes.
+#define CONSOLE_CHUNK_SIZE (1 << 16)
+
+// Writes count bytes straight to stdout's file descriptor. Anything still
+//    sitting in printf's buffer is flushed first so the order is kept.
+//    Returns false if the write failed.
+bool writeConsole(const uint8* buffer, uint64 count);
+
+// Writes every byte as 8 '0' / '1' characters, most significant bit first.
+bool writeConsoleBits(const uint8* buffer, uint64 count);
+
+#endif
@@ -0,0 +1,142 @@
+#include "fixedlength.h"
+#include <string.h>
+
+// With SSSE3 we can remap 16 symbols at once with pshufb when there are
+//    16 or fewer of them, which covers every width up to 4.
+#if defined(__SSSE3__) || defined(__AVX__)
+#define FIXED_LENGTH_SHUFFLE
+#include <tmmintrin.h>
+#endif
+
+uint8 getFixedLengthWidth(uint16 uniqueCount)
+{
+	uint8 width = 0;
+	while (((uint16)1 << width) < uniqueCount)
+		++width;
+	return width;
+}
+
+uint64 getFixedLengthPackedSize(uint64 count, uint8 width)
+{
+	return (count + 7) / 8 * width;
+}
+
+// Width is a constant in every call below so the compiler can unroll and
+//    vectorise the inner loops for each width separately. This relies on
+//    the machine being little endian, as does the rest of the program.
+static inline void _packGroups(const uint8* in, uint64 groups, const uint8 width, const uint8* index, uint8* out)
+{
+	for (uint64 g = 0; g < groups; ++g, in += 8, out += width)
+	{
+		uint64 v = 0;
+		for (uint8 j = 0; j < 8; ++j)
+			v |= (uint64)index[in[j]] << (j * width);
+		memcpy(out, &v, width);
+	}
+}
+
+static inline void _unpackGroups(const uint8* in, uint64 groups, const uint8 width, uint8* out)
+{
+	const uint64 mask = ((uint64)1 << width) - 1;
+	for (uint64 g = 0; g < groups; ++g, in += width, out += 8)
+	{
+		uint64 v;
+		memcpy(&v, in, 8);
+		for (uint8 j = 0; j < 8; ++j)
+			out[j] = (uint8)((v >> (j * width)) & mask);
+	}
+}
+
+static void _packWidth(const uint8* in, uint64 groups, uint8 width, const uint8* index, uint8* out)
+{
+	switch (width)
+	{
+	case 1: _packGroups(in, groups, 1, index, out); break;
+	case 2: _packGroups(in, groups, 2, index, out); break;
+	case 3: _packGroups(in, groups, 3, index, out); break;
+	case 4: _packGroups(in, groups, 4, index, out); break;
+	case 5: _packGroups(in, groups, 5, index, out); break;
+	case 6: _packGroups(in, groups, 6, index, out); break;
+	case 7: _packGroups(in, groups, 7, index, out); break;
+	case 8: _packGroups(in, groups, 8, index, out); break;
+	}
+}
+
+static void _unpackWidth(const uint8* in, uint64 groups, uint8 width, uint8* out)
+{
+	switch (width)
+	{
+	case 1: _unpackGroups(in, groups, 1, out); break;
+	case 2: _unpackGroups(in, groups, 2, out); break;
+	case 3: _unpackGroups(in, groups, 3, out); break;
+	case 4: _unpackGroups(in, groups, 4, out); break;
+	case 5: _unpackGroups(in, groups, 5, out); break;
+	case 6: _unpackGroups(in, groups, 6, out); break;
+	case 7: _unpackGroups(in, groups, 7, out); break;
+	case 8: _unpackGroups(in, groups, 8, out); break;
+	}
+}
+
+void packFixedLength(const uint8* in, uint64 count, uint8 width, const uint8* index, uint8* out)
+{
+	if (width == 0) return;
+
+	uint64 groups = count / 8;
+	_packWidth(in, groups, width, index, out);
+
+	// Pad the last partial group with the first symbol.
+	uint8 remaining = count % 8;
+	if (remaining > 0)
+	{
+		uint8 last[8];
+		memset(last, in[0], 8);
+		memcpy(last, in + groups * 8, remaining);
+		_packWidth(last, 1, width, index, out + groups * width);
+	}
+}
+
+void unpackFixedLength(const uint8* in, uint64 count, uint8 width, const uint8* remap, uint16 remapCount, uint8* out)
+{
+	if (width == 0)
+	{
+		memset(out, remap[0], count);
+		return;
+	}
+
+	// Groups are unpacked with 8 byte loads, so stop the fast loop before
+	//    it can read past the end of the input and do the rest from a copy.
+	//    At most 8 groups are left over, when the width is 1.
+	uint64 groups = count / 8;
+	uint64 size = getFixedLengthPackedSize(count, width);
+	uint64 safeGroups = size >= 8 ? (size - 8) / width + 1 : 0;
+	if (safeGroups > groups)
+		safeGroups = groups;
+	_unpackWidth(in, safeGroups, width, out);
+
+	uint8 tail[24] = { 0 };
+	uint8 tailOut[64];
+	uint64 tailGroups = (count + 7) / 8 - safeGroups;
+	memcpy(tail, in + safeGroups * width, tailGroups * width);
+	_unpackWidth(tail, tailGroups, width, tailOut);
+	memcpy(out + safeGroups * 8, tailOut, count - safeGroups * 8);
+
+	// Turn the indices back into bytes.
+	uint64 i = 0;
+#ifdef FIXED_LENGTH_SHUFFLE
+	if (remapCount <= 16)
+	{
+		uint8 table[16] = { 0 };
+		memcpy(table, remap, remapCount);
+		__m128i lookup = _mm_loadu_si128((const __m128i*)table);
+		for (; i + 16 <= count; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(out + i));
+			_mm_storeu_si128((__m128i*)(out + i), _mm_shuffle_epi8(lookup, v));
+		}
+	}
+#else
+	(void)remapCount;
+#endif
+	for (; i < count; ++i)
+		out[i] = remap[out[i]];
+}
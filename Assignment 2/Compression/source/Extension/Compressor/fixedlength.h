@@ -0,0 +1,22 @@
+#ifndef COMPRESSOR_FIXEDLENGTH_H
+#define COMPRESSOR_FIXEDLENGTH_H
+
+#include "common.h"
+
+// Fixed length bit packing. Every symbol is replaced by its index in the
+//    block's sorted set of symbols, written in width bits. Values are packed
+//    in groups of 8 so a group is always exactly width bytes, the first
+//    value in the lowest bits, which lets each group be unpacked with a
+//    single load and a few shifts.
+
+// The number of bits needed per symbol for uniqueCount distinct symbols.
+uint8 getFixedLengthWidth(uint16 uniqueCount);
+// Bytes needed to pack count symbols width bits each.
+uint64 getFixedLengthPackedSize(uint64 count, uint8 width);
+// index maps a byte value to its position in the symbol set.
+void packFixedLength(const uint8* in, uint64 count, uint8 width, const uint8* index, uint8* out);
+// remap maps a position in the symbol set back to a byte value,
+//    remapCount is the number of symbols in the set.
+void unpackFixedLength(const uint8* in, uint64 count, uint8 width, const uint8* remap, uint16 remapCount, uint8* out);
+
+#endif
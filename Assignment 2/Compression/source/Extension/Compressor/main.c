@@ -14,13 +14,110 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <limits.h>
+#include <setjmp.h>
+#include "common.h"
 #include "timing.h"
+#include "checksum.h"
+#include "fixedlength.h"
+#include "numericfilter.h"
+#include "platform.h"
+#include "progress.h"
+#include "console.h"
+#include "writer.h"
+
+// Compressed files can be larger than 2GB so we need 64 bit offsets.
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
 
-typedef unsigned char uint8;
-typedef unsigned short uint16;
-typedef short int16;
-typedef unsigned int uint32;
-typedef unsigned long long uint64;
+// Files written with -o are a stream of independently checksummed blocks:
+//
+//    Stream header : "HUFC" magic, version, 3 reserved bytes
+//    Block         : flags (1 byte), symbol count (4), body size (4),
+//                    body, CRC32C of the body (4)
+//    End block     : a block header with BLOCK_FLAG_END whose body is the
+//                    block index, an offset (8) and first symbol (8) for
+//                    every block in the stream
+//    Trailer       : total symbol count (8), CRC32C of the whole decoded
+//                    stream (4), offset of the end block (8), "HUFC" (4)
+//
+//    A block body is the dictionary, if the block has one, followed by
+//    the encoded symbols, padded with 0's to a whole byte. Blocks without
+//    a dictionary are decoded with the most recent one. The dictionary is
+//    either the full bitmap dictionary or the compact dictionary which
+//    can be a delta of the most recent one. Fixed length blocks have no
+//    dictionary and don't replace the most recent one. Integer column
+//    blocks hold the filtered bytes (see numericfilter.h), their symbol
+//    count is the filtered size and they always have their own dictionary
+//    unless they are also fixed length. All integers are
+//    little endian. The trailer is a fixed size so appending only needs
+//    to seek to the end of the file to find the index and overwrite it.
+//
+//    A solid archive (-m) is a stream of its members one after another
+//    followed by the member table, the last block before the end block,
+//    with BLOCK_FLAG_MEMBERS and no symbols. Its body is the member count
+//    then for each member its size, CRC32C (4), dictionary block, the
+//    length of the start of its name it shares with the previous member's,
+//    the length of the rest and the rest, all varints but the CRC.
+//    Members with the same extension are a group, they share a dictionary
+//    and small ones are packed together into blocks of ARCHIVE_BLOCK_SIZE,
+//    every group starts a new block. The dictionary block is 1 + the index of
+//    the block holding the dictionary the block the member starts in
+//    starts with, or 0 if that block brings its own. It is never a delta
+//    so any member can be extracted by reading just that block and the
+//    blocks the member is in.
+//
+//    Blocks with BLOCK_FLAG_RESTARTS (-k) are split into chunks of a fixed
+//    number of symbols that each start on a byte boundary, so they can be
+//    decoded independently of each other. After the dictionary the body is
+//    padded to a whole byte and holds the number of symbols per chunk (4)
+//    then, for every chunk but the first, where it starts (4) counting from
+//    the start of the first chunk.
+#define STREAM_MAGIC "HUFC"
+#define STREAM_VERSION 2
+#define STREAM_HEADER_SIZE 8
+#define STREAM_TRAILER_SIZE 24
+#define INDEX_ENTRY_SIZE 16
+#define BLOCK_HEADER_SIZE 9
+#define BLOCK_TRAILER_SIZE 4
+#define BLOCK_FLAG_DICTIONARY 0x01
+#define BLOCK_FLAG_COMPACT_DICTIONARY 0x02
+#define BLOCK_FLAG_SHORT_CODES 0x04
+#define BLOCK_FLAG_FIXED_LENGTH 0x08
+// Fixed length blocks start with a 32 byte symbol bitmap and a width byte
+#define FIXED_LENGTH_HEADER_SIZE 33
+// Percentage larger than Huffman a fixed length block may be and still be used
+#define FIXED_LENGTH_THRESHOLD 2
+#define BLOCK_FLAG_INTEGER_COLUMN 0x10
+#define BLOCK_FLAG_MEMBERS 0x20
+#define ARCHIVE_BLOCK_SIZE (1 << 16)
+#define ARCHIVE_NO_DICTIONARY ((uint64)-1)
+#define BLOCK_FLAG_RESTARTS 0x40
+// Fewer symbols per chunk than this and the table costs more than it's worth.
+#define MIN_RESTART_INTERVAL 64
+// How many chunks are decoded together, each with its own bit reader.
+#define RESTART_LANES 4
+// -c reads a sample this big every stride bytes.
+#define SAMPLE_CHUNK_SIZE 4096
+#define BLOCK_FLAG_END 0x80
+// Number of input bytes encoded per block
+#define BLOCK_SIZE (1 << 20)
+// The smallest blocks --mem-limit will make, below this the headers and
+//    dictionaries start to cost more than the memory saved.
+#define MIN_BLOCK_SIZE (1 << 12)
+#define MIN_MEMORY_LIMIT_MB 4
+// Roughly how many bytes of buffers a Workspace needs per byte of block,
+//    the input, filtered input and worst case encoded block when encoding
+//    and the block, output and unfiltered text when decoding.
+#define WORKSPACE_BYTES_PER_BLOCK_BYTE 8
+// Worst case dictionary is 33 bytes plus (5 + MAX_CODE_BITS) bits per symbol
+#define MAX_DICTIONARY_SIZE (33 + (256 * (5 + MAX_CODE_BITS) + 7) / 8)
 
 
 // TODO: right is not needed since it is always left + 1,
@@ -56,14 +153,57 @@ typedef struct
 	CountMap* map;
 } HuffmanTree;
 
+// The tree as flat arrays indexed by node, see buildHuffmanLayout. With
+//    n symbols there are n leaves and n - 1 internal nodes.
+typedef struct
+{
+	uint64 count[511];
+	uint16 children[255][2];
+	uint8 symbol[256];
+	uint16 leafCount;
+	uint16 nodeCount;
+} HuffmanLayout;
+
 typedef struct
 {
 	uint8 depth;
 	uint32 code;
 } HuffmanCode;
 
-// Global unnamed struct instance to store statistics  
-struct
+typedef struct
+{
+	uint64 offset;
+	uint64 firstSymbol;
+} BlockIndexEntry;
+
+typedef struct
+{
+	BlockIndexEntry* entries;
+	uint64 count;
+	uint64 capacity;
+	uint64 totalSymbols;
+	uint32 streamChecksum;
+	// Where the end block starts, this is where appended blocks go.
+	uint64 endOffset;
+} BlockIndex;
+
+// Where a stream is read from or written to, a file, a FileWriter for
+//    large outputs, the console or a block of memory that grows as it is
+//    written to.
+typedef struct
+{
+	FILE* file;
+	FileWriter* writer;
+	bool console;
+	uint8* memory;
+	uint64 size;
+	uint64 capacity;
+	uint64 position;
+} ByteStream;
+
+// Global unnamed struct instance to store statistics, one per thread
+//    so verify (-v) can run files in parallel.
+THREAD_LOCAL struct
 {
 	double compressionRatio;
 	double shannonEntropy;
@@ -74,6 +214,20 @@ struct
 	uint64 dictionaryBitLength;
 	uint64 encodedDictionaryBits;
 	uint64 bytesAfterDecoding;
+	uint64 containerBytes;
+	uint64 fileBytes;
+	uint64 blockCount;
+	uint64 payloadBits;
+	uint64 fixedLengthBlocks;
+	uint64 integerColumnBlocks;
+	// The filtered bytes integer column blocks encoded and their payload.
+	uint64 integerColumnSymbols;
+	uint64 integerColumnBits;
+	uint64 restartPoints;
+	uint64 appendedToBlocks;
+	uint64 bufferBytes;
+	uint64 peakBufferBytes;
+	uint32 streamChecksum;
 	double timeTaken;
 } stats = { 0 };
 
@@ -91,7 +245,23 @@ typedef enum
 	CORRUPT_DICTIONARY = 9,
 	DECODE_CLI_UNSUPPORTED = 10,
 	CORRUPT_ENCODED_FILE = 11,
-	NO_INPUT = 12
+	NO_INPUT = 12,
+	UNKNOWN_FORMAT = 13,
+	BLOCK_CHECKSUM_MISMATCH = 14,
+	STREAM_CHECKSUM_MISMATCH = 15,
+	APPEND_REQUIRES_OUTPUT = 16,
+	PROGRESS_DESCRIPTOR_INVALID = 17,
+	INVALID_BUFFER_SIZE = 18,
+	SOCKET_LISTEN_FAILED = 19,
+	INVALID_DAEMON_REQUEST = 20,
+	ARCHIVE_REQUIRES_FILES = 21,
+	NOT_AN_ARCHIVE = 22,
+	MEMBER_NOT_FOUND = 23,
+	INVALID_MEMBER_NAME = 24,
+	INVALID_MEMORY_LIMIT = 25,
+	INVALID_RESTART_INTERVAL = 26,
+	INVALID_SAMPLE_STRIDE = 27,
+	INSPECT_REQUIRES_FILES = 28
 } ErrorCode;
 
 typedef enum
@@ -121,7 +291,23 @@ const char* ErrorMessages[] =
 	"The dictionary of the file you are trying to decode is corrupt!",
 	"Decoding messages from the command line is not supported..",
 	"The file is corrupt and cannot be decoded!",
-	"You must provide an input string or, when using the -f flag a filepath"
+	"You must provide an input string or, when using the -f flag a filepath",
+	"The file you are trying to decode was not created by this program or is from an older version!",
+	"A block failed its checksum, the file is corrupt and cannot be decoded!",
+	"The decoded output does not match the checksum it was encoded with!",
+	"Appending (-a) requires an output file to append to (-o <filepath>)!",
+	"-g<fd> must be a file descriptor, 2 or above, that is open for writing!",
+	"-w must be followed by the output buffer size in MB!",
+	"Could not listen on the socket given to -u, it may be in use or this OS may not support UNIX sockets!",
+	"The daemon received a request it doesn't understand!",
+	"Solid mode (-m) needs -f <input> and, unless extracting (-r), -o <filepath> to write the archive to!",
+	"The file is not a solid archive, it was not created with -m!",
+	"The member given to -e is not in the archive!",
+	"A member's name is too long or would extract outside of the output directory!",
+	"--mem-limit must be followed by the most memory to use in MB, at least 4!",
+	"-k must be followed by how many symbols go between restarts, at least 64!",
+	"-c must be followed by how many bytes apart the samples are, at least 4096!",
+	"Inspecting (-i) needs -f <filepath> pointing to an encoded file or a directory of them!"
 };
 
 // Flags and command line argument state.
@@ -133,11 +319,29 @@ bool rFlag = false;
 bool sFlag = false;
 bool bFlag = false;
 bool nFlag = false;
+bool aFlag = false;
+bool pFlag = false;
+bool lFlag = false;
+bool vFlag = false;
+bool gFlag = false; int progressDescriptor = 2; FILE* progressFile = 0;
+bool xFlag = false;
+bool uFlag = false; const char* socketPath = 0;
+bool mFlag = false; const char* memberName = 0;
+// -k, how many symbols go in each independently decodable chunk, 0 for none.
+uint32 restartInterval = 0;
+// -c, estimate the output from a sample every sampleStride bytes.
+bool cFlag = false; uint64 sampleStride = 0;
+bool iFlag = false;
+bool wFlag = false; uint64 writeBufferSize = (uint64)DEFAULT_WRITER_BUFFER_MB << 20;
+// --mem-limit in bytes, 0 if there isn't one, and the block size the
+//    encoder uses which is lowered to fit in it.
+uint64 memoryLimit = 0;
+uint32 encodeBlockSize = BLOCK_SIZE;
 const char* input = 0;
 
 void printUsage()
 {
-	printf("usage: comp [-b] [-s] [-t] [-r] [-d] [-n] [-o <filepath>] [-f] <input>  \n\n");
+	printf("usage: comp [-b] [-s] [-t] [-r] [-d] [-n] [-a] [-p] [-l] [-v] [-g[fd]] [-w <MB>] [-x] [-u <socket>] [-m] [-e <member>] [-k <symbols>] [-c <stride>] [-i] [--mem-limit <MB>] [-o <filepath>] [-f] <input>  \n\n");
 	printf("<input> is interpreted as a string unless -f is provided.\n\n");
 	printf("Flags: \n");
 	printf("    -f Interpret <input> as a filepath and compress the file it points to.\n");
@@ -148,6 +352,27 @@ void printUsage()
 	printf("    -r Decode the input, as this does not produce a Huffman tree the t flag is ignored.\n");
 	printf("    -o <filepath> Write the encoded / decoded message to the file pointed to by filepath.\n");
 	printf("    -n Do not output the encoded message (Useful for gathering statistics).\n");
+	printf("    -p Build a separate dictionary for every block rather than one for the whole input.\n");
+	printf("    -l Use fixed length encoding for every block, larger but much faster to decode.\n");
+	printf("    -v Encode and decode the input in memory, check it matches and report the throughput of each.\n");
+	printf("       With -f <input> may be a directory, every file under it is verified in parallel.\n");
+	printf("    -w <MB> Size of the buffer output files are written through, 4MB by default.\n");
+	printf("    -x Write output files directly to disk, bypassing the page cache, where the OS supports it.\n");
+	printf("    -g Report progress, throughput, ratio and time left on stderr, or on file descriptor fd with -g<fd>.\n");
+	printf("    -u <socket> Run as a daemon answering compress / decompress requests on a UNIX socket,\n");
+	printf("       with -f <input> is used to train the dictionary used for requests it covers.\n");
+	printf("    -m Solid mode, compress every file under the directory <input> into one archive, files with\n");
+	printf("       the same extension share a dictionary. With -r list the members or, with -o <dir>, extract them.\n");
+	printf("    -e <member> With -r extract just this member of a solid archive, to -o or the console.\n");
+	printf("    -k <symbols> Restart the encoding on a byte boundary every this many symbols so the chunks can\n");
+	printf("       be decoded side by side, a little larger but faster to decode and search.\n");
+	printf("    -c <stride> Predict the size -o would write, from 4KB samples every stride bytes of the\n");
+	printf("       input, with a 95%% confidence interval. Nothing is encoded.\n");
+	printf("    -i Inspect the encoded file, or every one under the directory, given to -f: how each block's\n");
+	printf("       codes compare to the entropy of its symbols and how many bits went on anything else.\n");
+	printf("    --mem-limit <MB> Keep buffers, blocks and threads within this much memory, using smaller\n");
+	printf("       blocks and fewer threads rather than more memory. -s reports the peak.\n");
+	printf("    -a Append the encoded input as new blocks to the end of the file given with -o, without re-encoding it.\n");
 }
 
 bool printErrorMessageIf(bool condition, const char* message, ErrorSeverity severity)
@@ -162,12 +387,21 @@ bool printErrorMessageIf(bool condition, const char* message, ErrorSeverity seve
 //     is true and returns the condition. Cleans up error reporting.
 bool printErrorIf(bool condition, ErrorCode error, ErrorSeverity severity)
 {
+	// Callers may pass a code that's only valid when condition is true.
+	if (!condition) return false;
 	return printErrorMessageIf(condition, ErrorMessages[error], severity);
 }
 
+// Threads that have to survive errors, the daemon's workers, point this
+//    at where to go instead of exiting. longjmp is passed the error + 1.
+THREAD_LOCAL jmp_buf* errorHandler = 0;
+
 // Basically an Assert with re-usable error codes rather than strings.
 void fatalErrorIf(bool condition, ErrorCode error)
 {
+	if (condition && errorHandler)
+		longjmp(*errorHandler, error + 1);
+
 	if (printErrorIf(condition, error, SEVERITY_FATAL))
 	{
 		printf("\nFor usage help provide no input.\n");
@@ -175,58 +409,151 @@ void fatalErrorIf(bool condition, ErrorCode error)
 	}
 }
 
+// Sorts the leaves' keys, count << 8 | symbol, which are made in order of
+//    symbol. Few keys are insertion sorted, more are radix sorted a byte
+//    of the count at a time from the least significant. Either way it's
+//    stable so the symbol byte itself never needs sorting, and count bytes
+//    that are the same in every key, most of the high ones, are skipped so
+//    it's usually only 1 or 2 passes over at most 256 keys.
+#define LEAF_INSERTION_SORT_MAX 48
+void _sortLeafKeys(uint64* keys, uint64* scratch, uint16 count)
+{
+	if (count <= LEAF_INSERTION_SORT_MAX)
+	{
+		for (uint16 i = 1; i < count; ++i)
+		{
+			uint64 key = keys[i];
+			uint16 j = i;
+			for (; j > 0 && keys[j - 1] > key; --j)
+				keys[j] = keys[j - 1];
+			keys[j] = key;
+		}
+		return;
+	}
+
+	uint64 differs = 0;
+	for (uint16 i = 1; i < count; ++i)
+		differs |= keys[i] ^ keys[0];
+
+	for (uint8 shift = 8; shift < 64; shift += 8)
+	{
+		if (((differs >> shift) & 0xFF) == 0) continue;
+
+		uint16 offsets[256] = { 0 };
+		for (uint16 i = 0; i < count; ++i)
+			++offsets[(keys[i] >> shift) & 0xFF];
+		uint16 total = 0;
+		for (uint16 b = 0; b < 256; ++b)
+		{
+			uint16 n = offsets[b];
+			offsets[b] = total;
+			total += n;
+		}
+		for (uint16 i = 0; i < count; ++i)
+			scratch[offsets[(keys[i] >> shift) & 0xFF]++] = keys[i];
+		memcpy(keys, scratch, sizeof(uint64) * count);
+	}
+}
+
+// Builds the tree into layout without allocating. The leaves are sorted
+//    once and then merged with two queues, the sorted leaves and the nodes
+//    we have made, which come out in order of count on their own, so the
+//    two smallest are always at the front of one or the other. Nodes are
+//    indices, leaves 0 to leafCount - 1 then the internal nodes with the
+//    root last, children always come before their parents.
+void buildHuffmanLayout(const CountMap* map, HuffmanLayout* layout)
+{
+	uint64 keys[256], scratch[256];
+	uint16 n = 0;
+	for (uint16 s = 0; s < 256; ++s)
+		if (map->map[s] > 0)
+			keys[n++] = (map->map[s] << 8) | s;
+	_sortLeafKeys(keys, scratch, n);
+
+	for (uint16 i = 0; i < n; ++i)
+	{
+		layout->count[i] = keys[i] >> 8;
+		layout->symbol[i] = (uint8)keys[i];
+	}
+	layout->leafCount = n;
+	layout->nodeCount = n > 0 ? n * 2 - 1 : 0;
+
+	// leaf is the front of the leaf queue, node the front of the internal
+	//    one and next where the next internal node goes. On a tie we take
+	//    the leaf which keeps the tree as shallow as it can be.
+	uint16 leaf = 0, node = n;
+	for (uint16 next = n; next < layout->nodeCount; ++next)
+	{
+		uint16 pair[2];
+		for (uint8 c = 0; c < 2; ++c)
+			pair[c] = node >= next || (leaf < n && layout->count[leaf] <= layout->count[node]) ? leaf++ : node++;
+
+		layout->children[next - n][0] = pair[0];
+		layout->children[next - n][1] = pair[1];
+		layout->count[next] = layout->count[pair[0]] + layout->count[pair[1]];
+	}
+}
+
+// Sets the depth of every symbol in map in codeMap, the codes themselves
+//    are left to assignCanonicalCodes.
+void buildCodeLengths(const CountMap* map, HuffmanCode* codeMap)
+{
+	HuffmanLayout layout;
+	buildHuffmanLayout(map, &layout);
+	uint16 n = layout.leafCount;
+	if (n == 0) return;
+
+	// If there is only a single symbol the root is a leaf and its code
+	//    would be 0 bits long which we can't decode, so give it 1 bit.
+	if (n == 1)
+	{
+		codeMap[layout.symbol[0]].depth = 1;
+		return;
+	}
+
+	// Parents come after their children so walking back from the root
+	//    every node's depth is known before its children need it.
+	uint8 depth[511];
+	depth[layout.nodeCount - 1] = 0;
+	for (uint16 i = layout.nodeCount - 1; i >= n; --i)
+	{
+		// We have set a hard limit on huffman tree depth of 32 here..
+		//    I believe this is a reasonable maximum consideriong that although the worst
+		//    case is 255 bits anything beyond 32 bits is unlikely requiring
+		//    over 4GB of a repeating character.
+		fatalErrorIf(depth[i] >= MAX_CODE_BITS, DEPTH_LIMIT_EXCEEDED);
+		depth[layout.children[i - n][0]] = depth[i] + 1;
+		depth[layout.children[i - n][1]] = depth[i] + 1;
+	}
+
+	for (uint16 i = 0; i < n; ++i)
+		codeMap[layout.symbol[i]].depth = depth[i];
+}
+
+// Only -t needs the tree itself, it's made from the same layout as the
+//    codes so what is printed is what we used.
 HuffmanTree createHuffmanTree(CountMap* map)
 {
-	// Maximum nodes = n * 2
-	TreeNode* nodes = calloc(map->uniqueCount * 2, sizeof(TreeNode));
+	HuffmanLayout layout;
+	buildHuffmanLayout(map, &layout);
+
+	TreeNode* nodes = calloc(layout.nodeCount > 0 ? layout.nodeCount : 1, sizeof(TreeNode));
 	fatalErrorIf(nodes == NULL, CALLOC_FAILED);
 
-	uint16 count = 0;
-	uint8 symbol = 0;
-	for (; count < map->uniqueCount; ++symbol)
-	{
-		// Find next symbol
-		for (; symbol < 256; ++symbol)
-			if (map->map[symbol] > 0) break;
-
-		// Find insertion point
-		uint8 i = count;
-		for (; i > 0 && map->map[symbol] < nodes[i - 1].count; --i)
-			memcpy(nodes + i, nodes + i - 1, sizeof(TreeNode));
-
-		// Insert element
-		nodes[i].count = map->map[symbol];
-		nodes[i].left = 0;
-		nodes[i].right.uint8Value = symbol;
-		++count;
-	}
-
-	// Ok, so we are going to start using the nodes array from both ends.
-	//    From the end of the array going backwards (right array) are the 
-	//    sorted nodes from smallest to largest count and from the start
-	//    of the array going forwards (left array) are the unsorted nodes 
-	//    again from smallest to largest count. We can guarantee these will
-	//    never overlap due to the binary tree at max having 2n nodes. Once
-	//    the left array has 1 item we are done.
-	uint16 rightTail = map->uniqueCount * 2 - 1;
-	for (;count > 1; --count)
-	{
-		// Copy 2 elements to right array.
-		memcpy(&nodes[rightTail--], nodes, sizeof(TreeNode));
-		memcpy(&nodes[rightTail--], nodes + 1, sizeof(TreeNode));
-		// Move left array left by 2 elements
-		memcpy(nodes, nodes + 2, sizeof(TreeNode) * (count - 2));
-
-		// Find insertion point
-		uint64 newNodeCount = nodes[rightTail + 1].count + nodes[rightTail + 2].count;
-		uint8 i = count - 2;
-		for (; i > 0 && newNodeCount < nodes[i - 1].count; --i)
-			memcpy(nodes + i, nodes + i - 1, sizeof(TreeNode));
-
-		// Insert element
-		nodes[i].count = newNodeCount;
-		nodes[i].left = nodes + rightTail + 1;
-		nodes[i].right.p = nodes + rightTail + 2;
+	// The root is last in the layout but has to be first here so it's what
+	//    destroyHuffmanTree frees, so the order is reversed.
+	uint16 last = layout.nodeCount - 1;
+	for (uint16 i = 0; i < layout.nodeCount; ++i)
+	{
+		TreeNode* node = nodes + last - i;
+		node->count = layout.count[i];
+		if (i < layout.leafCount)
+			node->right.uint8Value = layout.symbol[i];
+		else
+		{
+			node->left = nodes + last - layout.children[i - layout.leafCount][0];
+			node->right.p = nodes + last - layout.children[i - layout.leafCount][1];
+		}
 	}
 
 	HuffmanTree tree;
@@ -240,6 +567,15 @@ void destroyHuffmanTree(HuffmanTree* tree)
 	free(tree->root);
 }
 
+// Adds the occurances of every byte in buffer to map.
+void countBytes(CountMap* map, const uint8* buffer, uint64 count)
+{
+	for (uint64 i = 0; i < count; ++i)
+		if (map->map[buffer[i]]++ == 0)
+			++map->uniqueCount;
+	map->count += count;
+}
+
 CountMap createCountMap(const char* string)
 {
 	CountMap map = { 0 };
@@ -266,12 +602,7 @@ CountMap createCountMap(const char* string)
 		size_t bytesRead = fread(buffer, 1, 1024, f);
 		while (bytesRead > 0)
 		{
-			for (int i = 0; i < bytesRead; ++i)
-			{
-				if(map.map[buffer[i]]++ == 0)// Count occurances of buffer[i] 
-					++map.uniqueCount;       // Count unique uint8's in string
-				++map.count;                 // Count total uint8's in string
-			}
+			countBytes(&map, buffer, bytesRead);
 
 			if (bytesRead != 1024) break;
 
@@ -300,83 +631,68 @@ CountMap createCountMap(const char* string)
 
 void printHuffmanCode(HuffmanCode code)
 {
+	char bits[MAX_CODE_BITS + 1];
+	uint8 length = 0;
+
 	// When i goes below 0 it will be 255.
 	for (uint8 i = code.depth - 1; i < code.depth; --i)
 	{
-		// Branchless, print the bits in a code from left
-		//    to right.
-		printf("%c", ((code.code >> i) & (uint32)1) + 48);
+		// Branchless, the bits in a code from left to right.
+		bits[length++] = ((code.code >> i) & (uint32)1) + 48;
 	}
+	bits[length] = '\0';
+	printf("%s", bits);
 }
 
-void _recurseHuffmanTree(HuffmanCode* map, TreeNode* n, uint8 depth, uint32 code, uint32 lines, bool parse, bool print)
+void _recurseHuffmanTree(HuffmanCode* map, TreeNode* n, uint8 depth, uint32 code, uint32 lines)
 {
-	// We have set a hard limit on huffman tree depth of 32 here..
-	//    I believe this is a reasonable maximum consideriong that although the worst
-	//    case is 255 bits anything beyond 32 bits is unlikely requiring
-	//    over 4GB of a repeating character.
-	fatalErrorIf(depth > MAX_CODE_BITS, DEPTH_LIMIT_EXCEEDED);
-	HuffmanCode hCode = { depth, code };
-
-	if (print)
+	if (depth > 0)
 	{
-		if (depth > 0)
+		for (uint8 i = depth - 1; i > 0; --i)
 		{
-			for (uint8 i = depth - 1; i > 0; --i)
-			{
-				if ((lines & ((uint32)1 << i)) != 0)
-					printf(" %c ", 179);
-				else
-					printf("   ");
-			}
+			if ((lines & ((uint32)1 << i)) != 0)
+				printf(" %c ", 179);
+			else
+				printf("   ");
+		}
 
-			// Mod2 but we want to flip it so that it's 1 when it would
-			// have been 0 and vice versa as it makes the logic easier.
-			uint32 mod = (code % 2 + 1) % 2;
+		// Mod2 but we want to flip it so that it's 1 when it would
+		// have been 0 and vice versa as it makes the logic easier.
+		uint32 mod = (code % 2 + 1) % 2;
 
-			// Branchless programming, we are changing what character we
-			//    draw in the table based on the value of mod, where if
-			//    mod == 0 we are at the start of a right branch.
-			uint8 c = 192 + mod * 3;
+		// Branchless programming, we are changing what character we
+		//    draw in the table based on the value of mod, where if
+		//    mod == 0 we are at the start of a right branch.
+		uint8 c = 192 + mod * 3;
 
-			// Again, the next line will be 1 depth deeper, if it's a left
-			//    branch we need to draw an up-down line otherwise a space.
-			//    Essentialy lines is a bitmap that tells us what to draw.
-			lines = (lines + mod) << 1;
-			printf(" %c ", c);
-		}
-		if(n->left != 0)
-			printf(" %llu\n", n->count);
-		else
-		{
-			printf("%llu = (Symbol: %u, Code: ", n->count, n->right.uint8Value);
-			printHuffmanCode(hCode);
-			printf(")\n");
-		}
+		// Again, the next line will be 1 depth deeper, if it's a left
+		//    branch we need to draw an up-down line otherwise a space.
+		//    Essentialy lines is a bitmap that tells us what to draw.
+		lines = (lines + mod) << 1;
+		printf(" %c ", c);
 	}
-	
-	if (n->left == 0)
+	if(n->left != 0)
+		printf(" %llu\n", n->count);
+	else
 	{
-		if(parse)
-			map[n->right.uint8Value] = hCode;
+		printf("%llu = (Symbol: %u, Code: ", n->count, n->right.uint8Value);
+		// Print the code we actually use, which has been made canonical.
+		printHuffmanCode(map[n->right.uint8Value]);
+		printf(")\n");
 	}
-	else
+
+	if (n->left != 0)
 	{
-		_recurseHuffmanTree(map, n->left, ++depth, code << 1, lines, parse, print);
-		_recurseHuffmanTree(map, n->right.p, depth, (code << 1) + 1, lines, parse, print);
+		_recurseHuffmanTree(map, n->left, ++depth, code << 1, lines);
+		_recurseHuffmanTree(map, n->right.p, depth, (code << 1) + 1, lines);
 	}
 		
 }
 
 
-void parseHuffmanTree(HuffmanCode * map, HuffmanTree* tree)
-{
-	_recurseHuffmanTree(map, tree->root, 0, 0, 0, true, false);
-}
-
 void printHuffmanTree(HuffmanCode* map, HuffmanTree* tree)
 {
-	_recurseHuffmanTree(map, tree->root, 0, 0, 0, false, true);
+	_recurseHuffmanTree(map, tree->root, 0, 0, 0);
 }
 
 void insertCodeIntoBuffer(uint8** buffer, uint64* bitCount, uint8* bufferBit, HuffmanCode code)
@@ -477,21 +793,8 @@ void decodeCode(uint8 ** pOut, uint8 **pIn, HuffmanCode* codeMap, uint64 pInSize
 
 void printBuffer(uint8* buffer, uint64 count)
 {
-	if (bFlag)
-	{
-		HuffmanCode code = { 0 };
-		code.depth = 8;
-		for (uint64 i = 0; i < count; ++i)
-		{
-			code.code = buffer[i];
-			printHuffmanCode(code);
-		}
-	}
-	else
-	{
-		for (uint64 i = 0; i < count; ++i)
-			printf("%c", buffer[i]);
-	}
+	bool written = bFlag ? writeConsoleBits(buffer, count) : writeConsole(buffer, count);
+	fatalErrorIf(!written, FILE_WRITE_FAILED);
 }
 
 void printBufferBits(uint8* buffer, uint64 count)
@@ -506,337 +809,3213 @@ void printBufferBits(uint8* buffer, uint64 count)
 	printHuffmanCode(last);
 }
 
-// Returns a huffman code of any remaining bits
-HuffmanCode encodeDictionary(HuffmanCode* codeMap, FILE* file)
+// Writes the dictionary into the bit buffer at *pOut. payloadBits is the
+//    number of encoded bits which will follow the dictionary so that we
+//    can record how many bits of the final byte are used.
+void encodeDictionary(HuffmanCode* codeMap, uint64 payloadBits, uint8** pOut, uint64* bitCount, uint8* bufferBit)
 {
-	// Worst case would be 2048 Bytes where average bit
-	//    length is 8 plus 32 bytes for a bit mask, 3 bits for the
-	//    size of the last byte, leaving 5 bits for any flags.
+	// Worst case would be 1152 Bytes where every code is MAX_CODE_BITS
+	//    long plus 32 bytes for a bit mask, 3 bits for the size of the
+	//    last byte, leaving 5 bits for any flags.
 	// 
 	// TODO: I think we could sort the codes in this function to
 	//    move them around so we don't need to send as much 
 	//    information, however, this would invalidate the Huffman 
 	//    tree so maybe we should be doing it when creating the tree..
-	stats.encodedDictionaryBits = 33 * 8 + stats.dictionaryBitLength;
-
-	uint8 buffer[2081] = { 0 };
-
+	uint64 start = *bitCount;
+	uint64 dictionaryBits = 33 * 8;
+	for (uint16 i = 0; i < 256; ++i)
+		if (codeMap[i].depth > 0)
+			dictionaryBits += 5 + codeMap[i].depth;
 
-	uint8* bitmapLocation = buffer + 1;
-	uint8* dictionaryLocation = bitmapLocation + 32;
+	// 5 unused flag bits followed by the 3 bit size of the last byte.
+	HuffmanCode flags = { 8, (dictionaryBits + payloadBits) % 8 };
+	insertCodeIntoBuffer(pOut, bitCount, bufferBit, flags);
 
-	uint8 bitmapBit = 0;
-	uint8 dictionaryBit = 0;
-	uint64 dictionaryBitCount = 0;
+	// 256 bit bitmap of the byte values that have codes.
+	HuffmanCode exists = { 1, 0 };
+	for (uint16 i = 0; i < 256; ++i)
+	{
+		exists.code = codeMap[i].depth > 0;
+		insertCodeIntoBuffer(pOut, bitCount, bufferBit, exists);
+	}
 
-	// We could use another insertCodeIntoBuffer call but the bitmap
-	//    is so simple I just did it inline
+	// A 5 bit depth followed by the code itself for every byte in the bitmap.
 	HuffmanCode depthCode = { 5, 0 };
 	for (uint16 i = 0; i < 256; ++i)
 	{
-		if (codeMap[i].depth > 0)
-		{
-			*bitmapLocation = (*bitmapLocation << 1) + 1;
-			depthCode.code = codeMap[i].depth;
-			insertCodeIntoBuffer(&dictionaryLocation, &dictionaryBitCount, &dictionaryBit, depthCode);
-			insertCodeIntoBuffer(&dictionaryLocation, &dictionaryBitCount, &dictionaryBit, codeMap[i]);
-		}
-		else
-		{
-			*bitmapLocation = *bitmapLocation << 1;
-		}
-		if (++bitmapBit == 8)
-		{
-			++bitmapLocation;
-			bitmapBit = 0;
-		}
+		if (codeMap[i].depth == 0) continue;
+		depthCode.code = codeMap[i].depth;
+		insertCodeIntoBuffer(pOut, bitCount, bufferBit, depthCode);
+		insertCodeIntoBuffer(pOut, bitCount, bufferBit, codeMap[i]);
 	}
 
-	// Calculate the leftover bits at the end of the full file
-	//    we don't add 33 bytes since this doen't affect the outcome.
-	uint8 lastByteSize = (dictionaryBitCount + stats.bitsAfterEncoding) % 8;
-	// Insert into bits 6-8 of the buffer. 
-	buffer[0] += lastByteSize;
-
-	// Write the file
-	uint64 bufferSize = (dictionaryBitCount / 8) + 33; // Ignore any leftover bits.
-	if(!nFlag) // Skip writing if nFlag set
-		fatalErrorIf(bufferSize != fwrite(buffer, sizeof(uint8), bufferSize, file), FILE_WRITE_FAILED);
+	stats.encodedDictionaryBits += *bitCount - start;
+}
 
-	stats.encodedDictionaryBits = bufferSize * 8 + dictionaryBit;
+// Reads count bits from the buffer most significant bit first, advancing
+//    the buffer location and bit. Exits if fewer than count bits remain
+//    before bufferEnd.
+uint32 readBits(uint8** bufferLocation, uint8* bufferBit, const uint8* bufferEnd, uint8 count)
+{
+	fatalErrorIf((uint64)(bufferEnd - *bufferLocation) * 8 < (uint64)(*bufferBit) + count, CORRUPT_DICTIONARY);
 
-	HuffmanCode leftover = { dictionaryBitCount % 8, *dictionaryLocation };
-	return leftover;
+	uint32 value = 0;
+	for (uint8 i = 0; i < count; ++i)
+	{
+		value = (value << 1) + (((**bufferLocation) >> (7 - (*bufferBit)++)) & 1);
+		*bufferLocation += ((*bufferBit) >> 3) & 1;
+		*bufferBit %= 8;
+	}
+	return value;
 }
 
-// This function will populate the codeMap provided with the dictionary it finds in the file,
-//    it will also advance the bufferLocation past the dictionary, loading more of the file
-//    into the buffer if needed. The return value is the number of bits used in the last byte
-//    of the file. It is assumed that the buffer has 1024 bytes of capacity, that bufferLocation
-//    points to the first element in the buffer, and that codeMap is 0 initialized.
-uint8 decodeDictionary(HuffmanCode* codeMap, uint8** bufferLocation, uint8* bufferBit, uint16* bufferCount, uint64* bitCount, FILE* file)
+// This function will populate the codeMap provided with the dictionary it finds at
+//    bufferLocation, advancing bufferLocation and bufferBit past the dictionary. It will
+//    not read at or past bufferEnd. The return value is the number of bits used in the
+//    last byte of the block. It is assumed that bufferBit is 0 and that codeMap is 0
+//    initialized.
+uint8 decodeDictionary(HuffmanCode* codeMap, uint8** bufferLocation, uint8* bufferBit, const uint8* bufferEnd, uint64* bitCount)
 {
+	fatalErrorIf(bufferEnd - *bufferLocation < 33, CORRUPT_DICTIONARY);
 	// This only stands true so long as we are not using the first 5 flag bits...
 	fatalErrorIf(**bufferLocation > 7, CORRUPT_DICTIONARY);
-	fatalErrorIf(*bufferCount < 33, CORRUPT_DICTIONARY);
-
-	uint8* bufferStart = *bufferLocation;
 
 	// The first byte contains 5 currently unused flag bits followed by 
-	//    a 3 bit number. TODO: Test... cast shouldn't be needed... could just be vs being dumb
-	uint8 finalByteBits = ((*(*bufferLocation)++) << 5) >> 5;
-	;
+	//    a 3 bit number.
+	uint8 finalByteBits = *(*bufferLocation)++;
 
 	// The next 32 bytes or 256 bits are a bitmask telling us what byte values have codes.
 	// We just set the depths of the codes to 1 if they are included and count them.
 	uint16 codeCount = 0;
-	codeMap[0].depth = **bufferLocation >> 7; // 1 or 0
-	*bufferBit = 1;
-	for (uint8 i = 1; i > 0; ++i) // When the uint8 overflows i == 0
+	for (uint16 i = 0; i < 256; ++i)
 	{
 		// Who needs if statements anyway
-		uint8 exists = ((**bufferLocation) >> (7 - (*bufferBit)++)) & 1;
+		uint8 exists = ((*bufferLocation)[i / 8] >> (7 - i % 8)) & 1;
 		codeCount += exists;
 		codeMap[i].depth = exists;
-		*bufferLocation += ((*bufferBit) >> 3) & 1;
-		*bufferBit %= 8;
 	}
+	*bufferLocation += 32;
+	*bitCount += 33 * 8;
 
-	uint8 currentCode = 0;
-	bool eofFound = (*bufferCount) == 1024 ? false : true;
 	// The number of bits to represent the number of bits in a code
 	//    where the maximum code depth is MAX_CODE_BITS
-	uint16 maxCodeDepthBits = ((uint16)(log2(MAX_CODE_BITS) + 1.0));
-	// The maximum size of an entry in the dictionary: n + ceil(log2(n)).
-	//    where n is the maximum allowed code depth.
-	uint16 maxEntryBits = maxCodeDepthBits + MAX_CODE_BITS;
+	uint8 maxCodeDepthBits = ((uint8)(log2(MAX_CODE_BITS) + 1.0));
+
 	// Now read the codes into the codeMap
-	for (uint16 i = 0; i < codeCount; ++i)
+	for (uint16 i = 0; i < 256; ++i)
 	{
-		// Find next valid code location in codeMap
-		while (codeMap[currentCode].depth == 0)
-			++currentCode;
-		
-		// Load more of the file into the buffer if needed.
-		if (!eofFound && *bufferLocation + maxEntryBits >= bufferStart + *bufferCount)
-		{
-			// Copy remaining contents to start of buffer.
-			uint16 remaining = ((bufferStart + *bufferCount) - bufferLocation);
-			memcpy(bufferStart, *bufferLocation, remaining);
-			
-			// Read to buffer after remaining content
-			*bufferCount = fread(bufferStart + remaining, sizeof(uint8), 1024 - remaining, file) + remaining;
-			*bufferLocation = bufferStart;
-			
-			if (*bufferCount < 1024)
-				eofFound = true;
-		}
-
-		// There should be at least 1 bit after the depth.
-		fatalErrorIf(*bufferLocation + (((*bufferBit) + maxCodeDepthBits + 7) / 8) >= bufferStart + *bufferCount, CORRUPT_DICTIONARY);
+		if (codeMap[i].depth == 0) continue;
 
-		// Read the code into the codeMap
-		// Read Depth
-		codeMap[currentCode].depth = 0;
-		for (uint8 i = 0; i < maxCodeDepthBits; ++i)
-		{
-			codeMap[currentCode].depth = codeMap[currentCode].depth << 1;
-			codeMap[currentCode].depth += ((**bufferLocation) >> (7 - (*bufferBit)++)) & 1;
-			*bufferLocation += ((*bufferBit) >> 3) & 1;
-			*bufferBit %= 8;
-		}
+		codeMap[i].depth = readBits(bufferLocation, bufferBit, bufferEnd, maxCodeDepthBits);
+		fatalErrorIf(codeMap[i].depth == 0, CORRUPT_DICTIONARY);
+		codeMap[i].code = readBits(bufferLocation, bufferBit, bufferEnd, codeMap[i].depth);
 
-		// There must be at least as many bits left as the depth of the code
-		fatalErrorIf((*bufferLocation) + (((*bufferBit) + codeMap[currentCode].depth + 7) / 8) >= bufferStart + *bufferCount, CORRUPT_DICTIONARY);
+		*bitCount += codeMap[i].depth + maxCodeDepthBits;
+	}
 
-		// Read Code
-		for (uint16 i = 0; i < codeMap[currentCode].depth; ++i)
-		{
-			codeMap[currentCode].code = codeMap[currentCode].code << 1;
-			codeMap[currentCode].code += ((**bufferLocation) >> (7 - (*bufferBit)++)) & 1;
-			*bufferLocation += ((*bufferBit) >> 3) & 1;
-			*bufferBit %= 8;
-		}
+	return finalByteBits;
+}
 
-		*bitCount += codeMap[currentCode].depth + maxCodeDepthBits;
-		++currentCode;
+// Replaces the codes in codeMap with canonical codes of the same depths,
+//    shorter codes first and symbols of the same depth in order. The
+//    compression is unchanged but the codes can now be rebuilt from
+//    their depths alone. Returns false if the depths can't form a
+//    prefix code, which only happens with a corrupt dictionary.
+bool assignCanonicalCodes(HuffmanCode* codeMap, uint16 symbolCount)
+{
+	uint32 depthCount[MAX_CODE_BITS + 1] = { 0 };
+	for (uint16 i = 0; i < symbolCount; ++i)
+		++depthCount[codeMap[i].depth];
+	depthCount[0] = 0;
+
+	// Kraft inequality, the sum of 2^-depth must not exceed 1. 
+	uint64 kraft = 0;
+	for (uint8 depth = 1; depth <= MAX_CODE_BITS; ++depth)
+		kraft += (uint64)depthCount[depth] << (MAX_CODE_BITS - depth);
+	if (kraft > ((uint64)1 << MAX_CODE_BITS))
+		return false;
+
+	uint32 nextCode[MAX_CODE_BITS + 1] = { 0 };
+	uint32 code = 0;
+	for (uint8 depth = 1; depth <= MAX_CODE_BITS; ++depth)
+	{
+		code = (code + depthCount[depth - 1]) << 1;
+		nextCode[depth] = code;
 	}
 
-	return finalByteBits;
+	for (uint16 i = 0; i < symbolCount; ++i)
+		if (codeMap[i].depth > 0)
+			codeMap[i].code = nextCode[codeMap[i].depth]++;
+
+	return true;
 }
 
- 
-// I would like to break this problem down a bit more and
-//    refactor this function but realistically there's not
-//    enough time to debug it afterwards even if I managed
-//    to refactor it in time! I don't want to split it into
-//    seperate encode/decode functions as there is so much
-//    shared methodology but I think that viewing the problem
-//    from a different angle would be fruitful.
+// Replaces codeMap with canonical huffman codes for the counts in map.
+void createHuffmanCodes(const CountMap* map, HuffmanCode* codeMap)
+{
+	memset(codeMap, 0, sizeof(HuffmanCode) * 256);
+	buildCodeLengths(map, codeMap);
+	assignCanonicalCodes(codeMap, 256);
+}
 
-// This function performs both encoding and decoding as well
-//    as printing the result to the console or a file 
-//    1024 bytes at a time. As such it is quite abstract.
-void transformInput(HuffmanCode* codeMap, uint64 characterCount)
+// The compact dictionary stores only the depth of each code, run length
+//    coded and then Huffman coded much like deflate does. Depths 0 to
+//    MAX_CODE_BITS are literals and the symbols below are runs. A delta
+//    dictionary stores the difference from the previous block's depths
+//    instead so an unchanged dictionary is a couple of runs of 0's.
+#define CL_REPEAT 32       // Repeat the previous value 3-6 times, 2 extra bits
+#define CL_ZEROS 33        // 3-10 zeros, 3 extra bits
+#define CL_LONG_ZEROS 34   // 11-138 zeros, 7 extra bits
+#define CL_ALPHABET 35
+#define CL_DEPTH_BITS 4
+
+// Order the code length code depths are written in, trailing zero depths
+//    are not written so the rarely used symbols go last.
+const uint8 codeLengthOrder[CL_ALPHABET] =
 {
-	uint8 bufferBit = 0;
-	uint64 bitsCount = 0;
-	uint64 count = 0;
-	FILE* inFile = 0;
-	uint8 inFileBuffer[1024];
-	uint16 inFileBufferCount = 0;
-	FILE* outFile = 0;
-	uint8 outBuffer[1032] = { 0 };
-	uint16 outBufferCount = 0;
-	uint8* pIn = input;
-	uint8* pOut = outBuffer;
-	uint8 finalByteSize = 0;
+	CL_ZEROS, CL_LONG_ZEROS, CL_REPEAT, 0, 5, 6, 4, 7, 8, 3, 9, 10, 2, 11, 12,
+	1, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31
+};
 
-	if (fFlag)
-	{
-		inFile = fopen(input, "rb");
-		fatalErrorIf(inFile == NULL, FILE_NON_EXISTENT);
-		pIn = inFileBuffer;
-		inFileBufferCount = fread(inFileBuffer, sizeof(uint8), 1024, inFile);
-		if (rFlag)
-		{
-			finalByteSize = decodeDictionary(codeMap, &pIn, &bufferBit, &inFileBufferCount, &bitsCount, inFile);
-			stats.dictionaryBitLength = bitsCount + 33 *8;
-			bitsCount = 0;
-		}
-	}
+const uint8 codeLengthExtraBits[CL_ALPHABET - MAX_CODE_BITS - 1] = { 2, 3, 7 };
+const uint8 codeLengthRunBase[CL_ALPHABET - MAX_CODE_BITS - 1] = { 3, 3, 11 };
 
-	if (oFlag)
+// Writes the compact dictionary for codeMap, which must have canonical codes,
+//    into the bit buffer. If previous is not 0 it is written as a delta.
+void encodeCompactDictionary(HuffmanCode* codeMap, HuffmanCode* previous, uint8** pOut, uint64* bitCount, uint8* bufferBit)
+{
+	uint8 values[256];
+	for (uint16 i = 0; i < 256; ++i)
+		values[i] = previous ? (codeMap[i].depth - previous[i].depth) & MAX_CODE_BITS : codeMap[i].depth;
+
+	// Run length code the values
+	uint8 symbols[256];
+	uint8 extras[256];
+	uint16 symbolCount = 0;
+	for (uint16 i = 0; i < 256;)
 	{
-		// No need to open the file if we aren't writing
-		if (!nFlag)
+		uint16 run = 1;
+		while (i + run < 256 && values[i + run] == values[i])
+			++run;
+
+		if (values[i] == 0 && run >= 3)
 		{
-			outFile = fopen(output, "wb");
-			fatalErrorIf(outFile == NULL, WRITE_FILE_OPEN_FAILED);
+			if (run > 138) run = 138;
+			symbols[symbolCount] = run >= 11 ? CL_LONG_ZEROS : CL_ZEROS;
+			extras[symbolCount++] = run - (run >= 11 ? 11 : 3);
+			i += run;
+			continue;
 		}
-		if (!rFlag)
+
+		symbols[symbolCount] = values[i++];
+		extras[symbolCount++] = 0;
+		for (--run; run >= 3;)
 		{
-			HuffmanCode leftover = encodeDictionary(codeMap, outFile);
-			insertCodeIntoBuffer(&pOut, &bitsCount, &bufferBit, leftover);
+			uint16 repeat = run > 6 ? 6 : run;
+			symbols[symbolCount] = CL_REPEAT;
+			extras[symbolCount++] = repeat - 3;
+			i += repeat;
+			run -= repeat;
 		}
 	}
 
+	// Huffman code the run length symbols with the same tree builder we use
+	//    for the data. There are at most 256 symbols so the deepest code is
+	//    14 bits, which always fits in CL_DEPTH_BITS.
+	CountMap map = { 0 };
+	for (uint16 i = 0; i < symbolCount; ++i)
+		if (map.map[symbols[i]]++ == 0)
+			++map.uniqueCount;
+	map.count = symbolCount;
+
+	HuffmanCode codes[256];
+	createHuffmanCodes(&map, codes);
+
+	uint8 depthsWritten = CL_ALPHABET;
+	while (depthsWritten > 0 && codes[codeLengthOrder[depthsWritten - 1]].depth == 0)
+		--depthsWritten;
+
+	HuffmanCode field = { 1, previous != 0 };
+	insertCodeIntoBuffer(pOut, bitCount, bufferBit, field);
+	field.depth = 6;
+	field.code = depthsWritten;
+	insertCodeIntoBuffer(pOut, bitCount, bufferBit, field);
+	field.depth = CL_DEPTH_BITS;
+	for (uint8 i = 0; i < depthsWritten; ++i)
+	{
+		field.code = codes[codeLengthOrder[i]].depth;
+		insertCodeIntoBuffer(pOut, bitCount, bufferBit, field);
+	}
 
-	// Since decoding requires fFlag we don't need to worry about
-	//    decoding from the command line.
-	bool eofFound = (inFileBufferCount < 1024);
-	for (; count < characterCount || rFlag; rFlag ? ++pOut : ++pIn) // <- not allowed an if... ternary works I guess
+	for (uint16 i = 0; i < symbolCount; ++i)
 	{
-		if (rFlag)
+		insertCodeIntoBuffer(pOut, bitCount, bufferBit, codes[symbols[i]]);
+		if (symbols[i] > MAX_CODE_BITS)
 		{
-			if(eofFound)
-			{
-				if (pIn >= inFileBuffer + inFileBufferCount)
-					break;
-			}
-			else if (pIn + 4 >= inFileBuffer + inFileBufferCount)
+			field.depth = codeLengthExtraBits[symbols[i] - CL_REPEAT];
+			field.code = extras[i];
+			insertCodeIntoBuffer(pOut, bitCount, bufferBit, field);
+		}
+	}
+}
+
+// Reads a compact dictionary written by encodeCompactDictionary into codeMap.
+//    codeMap must hold the previous dictionary in case this is a delta.
+void decodeCompactDictionary(HuffmanCode* codeMap, uint8** bufferLocation, uint8* bufferBit, const uint8* bufferEnd, uint64* bitCount)
+{
+	uint8* start = *bufferLocation;
+	uint8 startBit = *bufferBit;
+
+	bool delta = readBits(bufferLocation, bufferBit, bufferEnd, 1);
+	uint8 depthsWritten = readBits(bufferLocation, bufferBit, bufferEnd, 6);
+	fatalErrorIf(depthsWritten > CL_ALPHABET, CORRUPT_DICTIONARY);
+
+	HuffmanCode codes[CL_ALPHABET] = { 0 };
+	for (uint8 i = 0; i < depthsWritten; ++i)
+		codes[codeLengthOrder[i]].depth = readBits(bufferLocation, bufferBit, bufferEnd, CL_DEPTH_BITS);
+	fatalErrorIf(!assignCanonicalCodes(codes, CL_ALPHABET), CORRUPT_DICTIONARY);
+
+	// Canonical codes can be decoded a bit at a time by keeping track of
+	//    the first code at each depth, we only have 35 symbols to worry
+	//    about so there is no need for anything clever.
+	uint8 sorted[CL_ALPHABET];
+	uint8 depthCount[16] = { 0 };
+	uint8 sortedCount = 0;
+	for (uint8 depth = 1; depth < 16; ++depth)
+		for (uint8 i = 0; i < CL_ALPHABET; ++i)
+			if (codes[i].depth == depth)
 			{
-				// Should always be 4..?
-				uint16 remaining = inFileBuffer + inFileBufferCount - pIn;
-				memcpy(inFileBuffer, pIn, remaining);
-				inFileBufferCount = fread(inFileBuffer + remaining, sizeof(uint8), 1024 - remaining, inFile) + remaining;
-				pIn = inFileBuffer;
-				if (inFileBufferCount < 1024)
-					eofFound = true;
+				sorted[sortedCount++] = i;
+				++depthCount[depth];
 			}
-		}
-		else if (fFlag && pIn >= (inFileBuffer + inFileBufferCount))
-		{
-			inFileBufferCount = fread(inFileBuffer, sizeof(uint8), 1024, inFile);
-			pIn = inFileBuffer;
+	fatalErrorIf(sortedCount == 0, CORRUPT_DICTIONARY);
 
-			// I think this can only happen if the file changed between
-			//    us previously reading it and now since we know how
-			//    many bytes we should be reading..?
-			fatalErrorIf(inFileBufferCount == 0, UNEXPECTED_ERROR);
-		}
-		if (pOut - 1024 > outBuffer)
-		{
-			// Only if nFlag not set
-			if(!nFlag) if (oFlag)
-				fatalErrorIf(1024 != fwrite(outBuffer, sizeof(uint8), 1024, outFile), FILE_WRITE_FAILED);
-			else // for second if
-				printBuffer(outBuffer, 1024);
-			// Copy bits written past 1024 bytes to the start of the buffer and
-			//    move pOut back by 1024 bytes.
-			memcpy(outBuffer, outBuffer + 1024, sizeof(uint8) * 4);
-			pOut -= 1024;
-		}
-		if (rFlag)
+	uint8 values[256];
+	for (uint16 i = 0; i < 256;)
+	{
+		uint32 code = 0;
+		uint32 first = 0;
+		uint16 index = 0;
+		uint8 symbol = CL_ALPHABET;
+		for (uint8 depth = 1; depth < 16; ++depth)
 		{
-			// If we are on the last byte and we have read finalByteSize bits we're done.
-			if (pIn + 1 >= inFileBuffer + inFileBufferCount && bufferBit >= finalByteSize)
+			code |= readBits(bufferLocation, bufferBit, bufferEnd, 1);
+			if (code - first < depthCount[depth])
+			{
+				symbol = sorted[index + code - first];
 				break;
-			decodeCode(&pOut, &pIn, codeMap, (inFileBuffer + inFileBufferCount) - pIn, &bufferBit, &bitsCount);
+			}
+			index += depthCount[depth];
+			first = (first + depthCount[depth]) << 1;
+			code <<= 1;
 		}
-		else
+		fatalErrorIf(symbol == CL_ALPHABET, CORRUPT_DICTIONARY);
+
+		if (symbol <= MAX_CODE_BITS)
 		{
-			insertCodeIntoBuffer(&pOut, &bitsCount, &bufferBit, codeMap[*pIn]);
+			values[i++] = symbol;
+			continue;
 		}
 
-		count++;
+		uint16 run = codeLengthRunBase[symbol - CL_REPEAT] + readBits(bufferLocation, bufferBit, bufferEnd, codeLengthExtraBits[symbol - CL_REPEAT]);
+		fatalErrorIf(i + run > 256, CORRUPT_DICTIONARY);
+		fatalErrorIf(symbol == CL_REPEAT && i == 0, CORRUPT_DICTIONARY);
+		uint8 value = symbol == CL_REPEAT ? values[i - 1] : 0;
+		for (; run > 0; --run)
+			values[i++] = value;
 	}
 
-	if (rFlag)
+	for (uint16 i = 0; i < 256; ++i)
+		codeMap[i].depth = delta ? (codeMap[i].depth + values[i]) & MAX_CODE_BITS : values[i];
+	fatalErrorIf(!assignCanonicalCodes(codeMap, 256), CORRUPT_DICTIONARY);
+
+	*bitCount += (uint64)(*bufferLocation - start) * 8 + *bufferBit - startBit;
+}
+
+// Writes whichever dictionary is smallest, the full bitmap dictionary, the
+//    compact dictionary, or if there is a previous dictionary a delta of it.
+//    Returns the block flag for the dictionary written.
+uint8 encodeBlockDictionary(HuffmanCode* codeMap, HuffmanCode* previous, uint64 payloadBits, uint8** pOut, uint64* bitCount, uint8* bufferBit)
+{
+	uint64 fullBits = 33 * 8;
+	for (uint16 i = 0; i < 256; ++i)
+		if (codeMap[i].depth > 0)
+			fullBits += 5 + codeMap[i].depth;
+
+	// Encode the compact dictionaries into scratch buffers to measure them.
+	uint8 compact[2][MAX_DICTIONARY_SIZE];
+	uint64 compactBits[2] = { 0, UINT64_MAX };
+	uint8 compactBit[2] = { 0 };
+	uint8* compactEnd[2] = { compact[0], compact[1] };
+	encodeCompactDictionary(codeMap, 0, &compactEnd[0], &compactBits[0], &compactBit[0]);
+	if (previous)
 	{
-		stats.bitsAfterEncoding = bitsCount;
-		bitsCount = count * 8;
-		stats.bytesAfterDecoding = count;
+		compactBits[1] = 0;
+		encodeCompactDictionary(codeMap, previous, &compactEnd[1], &compactBits[1], &compactBit[1]);
 	}
 
-	if (fFlag)
-		fclose(inFile);
+	uint8 best = compactBits[1] < compactBits[0];
+	if (fullBits <= compactBits[best])
+	{
+		encodeDictionary(codeMap, payloadBits, pOut, bitCount, bufferBit);
+		return BLOCK_FLAG_DICTIONARY;
+	}
 
-	// If we have a partial byte left over we fill the remaining space with
-	//    0's so we don't use whatever happens to be in memory when outputing
-	if (!rFlag && bufferBit > 0)
+	// The dictionary is always the first thing in a block so the scratch
+	//    buffer can be copied straight in, including the partial last byte.
+	uint64 bytes = compactEnd[best] - compact[best];
+	memcpy(*pOut, compact[best], bytes + 1);
+	*pOut += bytes;
+	*bufferBit = compactBit[best];
+	*bitCount += compactBits[best];
+	stats.encodedDictionaryBits += compactBits[best];
+	return BLOCK_FLAG_COMPACT_DICTIONARY;
+}
+
+// Builds a code map for a single block from its own byte counts.
+void createBlockCodeMap(const uint8* pIn, uint32 count, HuffmanCode* codeMap)
+{
+	CountMap map = { 0 };
+	for (uint32 i = 0; i < count; ++i)
+		if (map.map[pIn[i]]++ == 0)
+			++map.uniqueCount;
+	map.count = count;
+
+	createHuffmanCodes(&map, codeMap);
+}
+
+void writeUint32(uint8* p, uint32 value)
+{
+	for (uint8 i = 0; i < 4; ++i)
+		p[i] = (uint8)(value >> (i * 8));
+}
+
+void writeUint64(uint8* p, uint64 value)
+{
+	for (uint8 i = 0; i < 8; ++i)
+		p[i] = (uint8)(value >> (i * 8));
+}
+
+uint32 readUint32(const uint8* p)
+{
+	uint32 value = 0;
+	for (uint8 i = 4; i > 0; --i)
+		value = (value << 8) + p[i - 1];
+	return value;
+}
+
+uint64 readUint64(const uint8* p)
+{
+	uint64 value = 0;
+	for (uint8 i = 8; i > 0; --i)
+		value = (value << 8) + p[i - 1];
+	return value;
+}
+
+// Table driven decoding. The next DECODE_TABLE_BITS bits of the input index
+//    a table telling us which symbol they start with and how long its code
+//    is, so most symbols cost a single lookup rather than a search through
+//    the codeMap. When codes are short (the block's average code length is
+//    below MULTI_SYMBOL_AVERAGE_BITS) each entry instead holds every whole
+//    code that fits in MULTI_SYMBOL_TABLE_BITS bits, up to 4 symbols. Codes
+//    longer than the table are decoded a depth at a time, which relies on
+//    the codes being canonical. Dictionaries from before codes were made
+//    canonical fall back on decodeCode.
+#define DECODE_TABLE_BITS 11
+#define MULTI_SYMBOL_TABLE_BITS 12
+#define MULTI_SYMBOL_MAX 4
+#define MULTI_SYMBOL_AVERAGE_BITS 5.5
+
+typedef struct
+{
+	uint8 symbols[MULTI_SYMBOL_MAX];
+	uint8 count;	// 0 if the code is longer than the table
+	uint8 length;	// Bits used by all the symbols
+} DecodeTableEntry;
+
+typedef struct
+{
+	DecodeTableEntry single[1 << DECODE_TABLE_BITS];
+	DecodeTableEntry multi[1 << MULTI_SYMBOL_TABLE_BITS];
+	bool multiBuilt;
+	bool canonical;
+	// For codes longer than the table, per depth, the first canonical
+	//    code, how many codes there are and where their symbols start
+	//    in sorted which is ordered by depth then symbol.
+	uint32 firstCode[MAX_CODE_BITS + 1];
+	uint16 depthCount[MAX_CODE_BITS + 1];
+	uint16 depthOffset[MAX_CODE_BITS + 1];
+	uint8 sorted[256];
+} DecodeTable;
+
+void buildDecodeTable(DecodeTable* table, HuffmanCode* codeMap, bool multiSymbol)
+{
+	HuffmanCode canonical[256];
+	memcpy(canonical, codeMap, sizeof(canonical));
+	table->canonical = assignCanonicalCodes(canonical, 256) && memcmp(canonical, codeMap, sizeof(canonical)) == 0;
+	table->multiBuilt = false;
+	if (!table->canonical) return;
+
+	memset(table->single, 0, sizeof(table->single));
+	for (uint16 i = 0; i < 256; ++i)
 	{
-		HuffmanCode c = { 8 - bufferBit, 0 };
-		uint64 t = 0; // We don't want to increment the bitCount
-		insertCodeIntoBuffer(&pOut, &t, &bufferBit, c);
+		uint8 depth = codeMap[i].depth;
+		if (depth == 0 || depth > DECODE_TABLE_BITS) continue;
+
+		// Every index starting with the code decodes to this symbol.
+		uint32 first = codeMap[i].code << (DECODE_TABLE_BITS - depth);
+		uint32 last = first + ((uint32)1 << (DECODE_TABLE_BITS - depth));
+		for (uint32 e = first; e < last; ++e)
+		{
+			table->single[e].symbols[0] = (uint8)i;
+			table->single[e].count = 1;
+			table->single[e].length = depth;
+		}
 	}
 
+	memset(table->depthCount, 0, sizeof(table->depthCount));
+	for (uint16 i = 0; i < 256; ++i)
+		++table->depthCount[codeMap[i].depth];
+	table->depthCount[0] = 0;
 
-	// Write remaining bytes to output if nFlag not set
-	if(!nFlag) if (oFlag)
+	uint32 code = 0;
+	uint16 offset = 0;
+	for (uint8 depth = 1; depth <= MAX_CODE_BITS; ++depth)
 	{
-		uint64 remainingBytes = ((bitsCount + 7) / 8) % 1024;
-		fatalErrorIf(remainingBytes != fwrite(outBuffer, sizeof(uint8), remainingBytes, outFile), FILE_WRITE_FAILED);
-		fclose(outFile);
+		code = (code + table->depthCount[depth - 1]) << 1;
+		table->firstCode[depth] = code;
+		table->depthOffset[depth] = offset;
+		offset += table->depthCount[depth];
 	}
-	else // for second if
+	uint16 next[MAX_CODE_BITS + 1];
+	memcpy(next, table->depthOffset, sizeof(next));
+	for (uint16 i = 0; i < 256; ++i)
+		if (codeMap[i].depth > 0)
+			table->sorted[next[codeMap[i].depth]++] = (uint8)i;
+
+	if (!multiSymbol) return;
+
+	// Build each multi symbol entry by repeatedly looking up the single
+	//    symbol table with whatever bits are left, padded with 0's. A code
+	//    is only taken if it fits entirely within the bits we know.
+	uint32 mask = (1 << MULTI_SYMBOL_TABLE_BITS) - 1;
+	for (uint32 e = 0; e <= mask; ++e)
 	{
-		printBufferBits(outBuffer, bitsCount % (1024 * 8));
+		DecodeTableEntry* entry = &table->multi[e];
+		entry->count = 0;
+		entry->length = 0;
+		while (entry->count < MULTI_SYMBOL_MAX)
+		{
+			uint32 bits = (e << entry->length) & mask;
+			DecodeTableEntry* s = &table->single[bits >> (MULTI_SYMBOL_TABLE_BITS - DECODE_TABLE_BITS)];
+			if (s->count == 0 || s->length > MULTI_SYMBOL_TABLE_BITS - entry->length) break;
+			entry->symbols[entry->count++] = s->symbols[0];
+			entry->length += s->length;
+		}
 	}
+	table->multiBuilt = true;
 }
 
-void computeAverageCodeLength(CountMap map, HuffmanCode* codeMap)
+// Reads bits most significant first, bitBuffer holds the next bitsAvailable
+//    bits at its top with 0's or later bits below them.
+typedef struct
 {
-	double total = map.map[0] * codeMap[0].depth;
-	stats.dictionaryBitLength = codeMap[0].depth;
-	for (uint8 i = 1; i > 0; ++i) // When the uint8 overflows i == 0
+	const uint8* p;
+	const uint8* end;
+	uint64 bitBuffer;
+	uint8 bitsAvailable;
+} BitReader;
+
+void refillBitReader(BitReader* r)
+{
+	if (r->end - r->p >= 8)
 	{
-		total += map.map[i] * codeMap[i].depth;
-		stats.dictionaryBitLength = codeMap[0].depth;
+		// Load 8 bytes at once and keep as many whole bytes as fit, the
+		//    rest are loaded again next time which is harmless.
+		uint64 v = 0;
+		for (uint8 i = 0; i < 8; ++i)
+			v = (v << 8) | r->p[i];
+		r->bitBuffer |= v >> r->bitsAvailable;
+		uint8 bytes = (63 - r->bitsAvailable) >> 3;
+		r->p += bytes;
+		r->bitsAvailable += bytes * 8;
+		return;
 	}
 
-	stats.bitsAfterEncoding = total;
-	stats.averageCodeLength = (double)total / (double)map.count;
+	while (r->bitsAvailable <= 56 && r->p < r->end)
+	{
+		r->bitBuffer |= (uint64)(*r->p++) << (56 - r->bitsAvailable);
+		r->bitsAvailable += 8;
+	}
 }
 
+void consumeBits(BitReader* r, uint8 count)
+{
+	r->bitBuffer <<= count;
+	r->bitsAvailable -= count;
+}
 
-// main controls the program flow by parsing arguments and
-//     deciding what functions should run from there.
-int main(int argc, char** argv)
+// Decodes a code longer than the table a depth at a time.
+uint8 decodeLongCode(BitReader* r, DecodeTable* table)
 {
-// Useful for debugging in Visual Studio, if the configuration
-//    is set to debug _DEBUG is defined and the input can be
-//    modified here instead of on the command line.
+	for (uint8 depth = DECODE_TABLE_BITS + 1; depth <= MAX_CODE_BITS && depth <= r->bitsAvailable; ++depth)
+	{
+		uint32 code = (uint32)(r->bitBuffer >> (64 - depth));
+		if (code - table->firstCode[depth] < table->depthCount[depth])
+		{
+			consumeBits(r, depth);
+			return table->sorted[table->depthOffset[depth] + code - table->firstCode[depth]];
+		}
+	}
+	fatalErrorIf(true, CORRUPT_ENCODED_FILE);
+	return 0;
+}
+
+// Decodes symbols from r into pOut until it reaches outEnd.
+void decodeSymbols(BitReader* r, DecodeTable* table, uint8* pOut, uint8* outEnd)
+{
+	if (table->multiBuilt)
+	{
+		while (outEnd - pOut >= MULTI_SYMBOL_MAX)
+		{
+			if (r->bitsAvailable < 32)
+			{
+				refillBitReader(r);
+				if (r->bitsAvailable < MULTI_SYMBOL_TABLE_BITS) break;
+			}
+
+			DecodeTableEntry* e = &table->multi[r->bitBuffer >> (64 - MULTI_SYMBOL_TABLE_BITS)];
+			if (e->count == 0)
+			{
+				*pOut++ = decodeLongCode(r, table);
+				continue;
+			}
+
+			// Always store every symbol, it's cheaper than checking the count.
+			pOut[0] = e->symbols[0];
+			pOut[1] = e->symbols[1];
+			pOut[2] = e->symbols[2];
+			pOut[3] = e->symbols[3];
+			pOut += e->count;
+			consumeBits(r, e->length);
+		}
+	}
+
+	while (pOut < outEnd)
+	{
+		if (r->bitsAvailable < 32)
+			refillBitReader(r);
+
+		DecodeTableEntry* e = &table->single[r->bitBuffer >> (64 - DECODE_TABLE_BITS)];
+		if (e->count == 0 || e->length > r->bitsAvailable)
+		{
+			*pOut++ = decodeLongCode(r, table);
+			continue;
+		}
+		*pOut++ = e->symbols[0];
+		consumeBits(r, e->length);
+	}
+}
+
+// Decodes a block with BLOCK_FLAG_RESTARTS, pIn is just after its
+//    dictionary. The chunks are decoded RESTART_LANES at a time, a step of
+//    each in turn, so while one lane waits on its table lookup the others
+//    have work to do. Each lane only steps while it is at least 8 bytes from
+//    the end of its chunk, which keeps refills to a single load, whatever
+//    is left is finished a lane at a time by decodeSymbols.
+void decodeRestartBlock(uint8* pIn, uint8 bufferBit, const uint8* bodyEnd, DecodeTable* table, uint8* pOut, uint32 count, uint64* bitCount)
+{
+	if (bufferBit > 0)
+		++pIn;
+	fatalErrorIf(bodyEnd - pIn < 4, CORRUPT_ENCODED_FILE);
+	uint32 interval = readUint32(pIn);
+	fatalErrorIf(interval < MIN_RESTART_INTERVAL, CORRUPT_ENCODED_FILE);
+	uint32 chunks = (uint32)(((uint64)count + interval - 1) / interval);
+	const uint8* offsets = pIn + 4;
+	fatalErrorIf((uint64)(bodyEnd - offsets) < (uint64)(chunks > 0 ? chunks - 1 : 0) * 4, CORRUPT_ENCODED_FILE);
+	const uint8* start = offsets + (uint64)(chunks > 0 ? chunks - 1 : 0) * 4;
+	uint64 payloadSize = bodyEnd - start;
+	stats.restartPoints += chunks;
+
+	for (uint32 first = 0; first < chunks; first += RESTART_LANES)
+	{
+		uint32 lanes = chunks - first < RESTART_LANES ? chunks - first : RESTART_LANES;
+		BitReader r[RESTART_LANES];
+		uint8* out[RESTART_LANES];
+		uint8* outEnd[RESTART_LANES];
+		uint64 previous = first > 0 ? readUint32(offsets + (first - 1) * 4) : 0;
+		for (uint32 lane = 0; lane < lanes; ++lane)
+		{
+			uint32 chunk = first + lane;
+			uint64 next = chunk + 1 < chunks ? readUint32(offsets + chunk * 4) : payloadSize;
+			fatalErrorIf(next < previous || next > payloadSize, CORRUPT_ENCODED_FILE);
+			r[lane] = (BitReader){ start + previous, start + next, 0, 0 };
+			out[lane] = pOut + (uint64)chunk * interval;
+			outEnd[lane] = chunk + 1 < chunks ? out[lane] + interval : pOut + count;
+			previous = next;
+		}
+
+		uint64 startBits = 0;
+		for (uint32 lane = 0; lane < lanes; ++lane)
+			startBits += (uint64)(r[lane].end - r[lane].p) * 8;
+
+		if (lanes == RESTART_LANES)
+		{
+			DecodeTableEntry* entries = table->multiBuilt ? table->multi : table->single;
+			uint8 entryBits = table->multiBuilt ? MULTI_SYMBOL_TABLE_BITS : DECODE_TABLE_BITS;
+			for (;;)
+			{
+				bool ready = true;
+				for (uint32 lane = 0; lane < RESTART_LANES; ++lane)
+					ready &= outEnd[lane] - out[lane] >= MULTI_SYMBOL_MAX && r[lane].end - r[lane].p >= 8;
+				if (!ready) break;
+
+				for (uint32 lane = 0; lane < RESTART_LANES; ++lane)
+				{
+					BitReader* l = r + lane;
+					if (l->bitsAvailable < 32)
+						refillBitReader(l);
+					DecodeTableEntry* e = &entries[l->bitBuffer >> (64 - entryBits)];
+					if (e->count == 0)
+					{
+						*out[lane]++ = decodeLongCode(l, table);
+						continue;
+					}
+					memcpy(out[lane], e->symbols, MULTI_SYMBOL_MAX);
+					out[lane] += e->count;
+					consumeBits(l, e->length);
+				}
+			}
+		}
+
+		for (uint32 lane = 0; lane < lanes; ++lane)
+		{
+			decodeSymbols(r + lane, table, out[lane], outEnd[lane]);
+			startBits -= (uint64)(r[lane].end - r[lane].p) * 8 + r[lane].bitsAvailable;
+		}
+		*bitCount += startBits;
+	}
+}
+
+// Decodes count symbols from the block body at pIn into pOut, reading no
+//    further than bodyEnd.
+void decodeBlock(uint8* pIn, uint8 bufferBit, const uint8* bodyEnd, DecodeTable* table, HuffmanCode* codeMap, uint8* pOut, uint32 count, uint64* bitCount)
+{
+	if (!table->canonical)
+	{
+		for (uint32 i = 0; i < count; ++i, ++pOut)
+		{
+			fatalErrorIf(pIn >= bodyEnd, CORRUPT_ENCODED_FILE);
+			decodeCode(&pOut, &pIn, codeMap, bodyEnd - pIn, &bufferBit, bitCount);
+		}
+		return;
+	}
+
+	BitReader r = { pIn, bodyEnd, 0, 0 };
+	refillBitReader(&r);
+	consumeBits(&r, bufferBit);
+	uint64 startBits = (uint64)(bodyEnd - pIn) * 8 - bufferBit;
+	decodeSymbols(&r, table, pOut, pOut + count);
+	*bitCount += startBits - ((uint64)(r.end - r.p) * 8 + r.bitsAvailable);
+}
+
+// The buffers encoding and decoding need. Keeping them between calls saves
+//    allocating them again for every file or daemon request and, since it's
+//    the owner that frees them, nothing leaks when a request fails part way.
+typedef struct
+{
+	uint8* blockBuffer;
+	uint64 blockCapacity;
+	uint8* filterBuffer;
+	uint64 filterCapacity;
+	uint8* inBuffer;
+	uint64 inCapacity;
+	uint8* outBuffer;
+	uint64 outCapacity;
+	uint8* textBuffer;
+	uint64 textCapacity;
+	DecodeTable* table;
+	uint64 tableCapacity;
+	BlockIndex index;
+} Workspace;
+
+// Counts buffers being allocated, or freed when bytes is negative, towards
+//    the -s statistics.
+void trackBuffer(int64 bytes)
+{
+	stats.bufferBytes += bytes;
+	if (stats.bufferBytes > stats.peakBufferBytes)
+		stats.peakBufferBytes = stats.bufferBytes;
+}
+
+// Makes sure *buffer can hold at least size bytes, what it held is lost.
+uint8* reserveBuffer(uint8** buffer, uint64* capacity, uint64 size)
+{
+	if (size > *capacity || *buffer == 0)
+	{
+		free(*buffer);
+		trackBuffer(-(int64)*capacity);
+		*capacity = 0;
+		*buffer = malloc(size > 0 ? size : 1);
+		fatalErrorIf(*buffer == NULL, CALLOC_FAILED);
+		*capacity = size;
+		trackBuffer(size);
+	}
+	return *buffer;
+}
+
+void freeWorkspace(Workspace* workspace)
+{
+	trackBuffer(-(int64)(workspace->blockCapacity + workspace->filterCapacity + workspace->inCapacity +
+		workspace->outCapacity + workspace->textCapacity + workspace->tableCapacity));
+	free(workspace->blockBuffer);
+	free(workspace->filterBuffer);
+	free(workspace->inBuffer);
+	free(workspace->outBuffer);
+	free(workspace->textBuffer);
+	free(workspace->table);
+	free(workspace->index.entries);
+	memset(workspace, 0, sizeof(Workspace));
+}
+
+// The largest a block encoding count symbols can be, including its header and trailer.
+//    The restart table and padding are allowed for whether there is one or
+//    not since the decoder doesn't know until it has read the body.
+uint64 getMaxBlockSize(uint64 count)
+{
+	uint64 restartBytes = 1 + 4 + (count / MIN_RESTART_INTERVAL + 1) * 5;
+	return BLOCK_HEADER_SIZE + MAX_DICTIONARY_SIZE + (count * MAX_CODE_BITS + 7) / 8 + restartBytes + BLOCK_TRAILER_SIZE;
+}
+
+// Fills in the header and checksum of a block whose body has already been
+//    written. Returns the size of the block in bytes.
+uint64 finishBlock(uint8* blockBuffer, uint8 flags, uint32 count, uint32 bodySize)
+{
+	uint8* body = blockBuffer + BLOCK_HEADER_SIZE;
+	blockBuffer[0] = flags;
+	writeUint32(blockBuffer + 1, count);
+	writeUint32(blockBuffer + 5, bodySize);
+	writeUint32(body + bodySize, crc32c(0, body, bodySize));
+
+	stats.containerBytes += BLOCK_HEADER_SIZE + BLOCK_TRAILER_SIZE;
+	++stats.blockCount;
+	return BLOCK_HEADER_SIZE + bodySize + BLOCK_TRAILER_SIZE;
+}
+
+// Encodes a block with the fixed length codec. The body is a 32 byte
+//    bitmap of the symbols used, like the dictionary's, the width in
+//    bits of each symbol and then the packed symbols.
+uint64 encodeFixedLengthBlock(const uint8* pIn, uint32 count, const bool* used, uint8* blockBuffer)
+{
+	uint8* body = blockBuffer + BLOCK_HEADER_SIZE;
+	uint8 index[256];
+	uint16 uniqueCount = 0;
+
+	memset(body, 0, 32);
+	for (uint16 i = 0; i < 256; ++i)
+	{
+		if (!used[i]) continue;
+		body[i / 8] |= 0x80 >> (i % 8);
+		index[i] = (uint8)uniqueCount++;
+	}
+
+	uint8 width = getFixedLengthWidth(uniqueCount);
+	body[32] = width;
+	packFixedLength(pIn, count, width, index, body + FIXED_LENGTH_HEADER_SIZE);
+
+	uint64 packedSize = getFixedLengthPackedSize(count, width);
+	stats.payloadBits += (uint64)count * width;
+	stats.encodedDictionaryBits += FIXED_LENGTH_HEADER_SIZE * 8;
+	++stats.fixedLengthBlocks;
+	return finishBlock(blockBuffer, BLOCK_FLAG_FIXED_LENGTH, count, (uint32)(FIXED_LENGTH_HEADER_SIZE + packedSize));
+}
+
+// Pads the last byte with 0's, without counting them in the bitCount.
+void padToByte(uint8** pOut, uint8* bufferBit)
+{
+	if (*bufferBit == 0) return;
+	HuffmanCode c = { 8 - *bufferBit, 0 };
+	uint64 t = 0;
+	insertCodeIntoBuffer(pOut, &t, bufferBit, c);
+}
+
+// Encodes count bytes from pIn as chunks of restartInterval symbols each
+//    starting on a byte boundary, after the restart table. See BLOCK_FLAG_RESTARTS.
+void encodeRestartChunks(const uint8* pIn, uint32 count, HuffmanCode* codeMap, uint8** pOut, uint64* bitCount, uint8* bufferBit)
+{
+	padToByte(pOut, bufferBit);
+	uint32 chunks = (count + restartInterval - 1) / restartInterval;
+	uint8* table = *pOut;
+	writeUint32(table, restartInterval);
+	uint8* start = table + 4 + (uint64)(chunks > 0 ? chunks - 1 : 0) * 4;
+	*pOut = start;
+	for (uint32 chunk = 0; chunk < chunks; ++chunk)
+	{
+		if (chunk > 0)
+			writeUint32(table + chunk * 4, (uint32)(*pOut - start));
+		uint32 end = count - chunk * restartInterval > restartInterval ? (chunk + 1) * restartInterval : count;
+		for (uint32 i = chunk * restartInterval; i < end; ++i)
+			insertCodeIntoBuffer(pOut, bitCount, bufferBit, codeMap[pIn[i]]);
+		padToByte(pOut, bufferBit);
+	}
+	stats.containerBytes += start - table;
+	stats.restartPoints += chunks;
+}
+
+// Encodes count bytes from pIn as a single block into blockBuffer which must
+//    be at least getMaxBlockSize(count) bytes. The body is checksummed here
+//    while it is still in cache. Returns the size of the block in bytes.
+//    If previous is not 0 the dictionary may be written as a delta of it.
+//    If the fixed length codec would be within FIXED_LENGTH_THRESHOLD percent
+//    of the Huffman encoding, or -l is set, it is used instead as it is much
+//    faster to decode.
+uint64 encodeBlock(const uint8* pIn, uint32 count, HuffmanCode* codeMap, bool writeDictionary, HuffmanCode* previous, uint8* blockBuffer)
+{
+	uint8* body = blockBuffer + BLOCK_HEADER_SIZE;
+	uint8* pOut = body;
+	uint64 bitCount = 0;
+	uint8 bufferBit = 0;
+	uint8 flags = 0;
+
+	bool used[256] = { 0 };
+	uint64 payloadBits = 0;
+	for (uint32 i = 0; i < count; ++i)
+	{
+		payloadBits += codeMap[pIn[i]].depth;
+		used[pIn[i]] = true;
+	}
+
+	if (writeDictionary)
+		flags = encodeBlockDictionary(codeMap, previous, payloadBits, &pOut, &bitCount, &bufferBit);
+
+	uint16 uniqueCount = 0;
+	for (uint16 i = 0; i < 256; ++i)
+		uniqueCount += used[i];
+	uint64 fixedLengthBits = (FIXED_LENGTH_HEADER_SIZE + getFixedLengthPackedSize(count, getFixedLengthWidth(uniqueCount))) * 8;
+	// The restart table and, on average, half a byte of padding per chunk.
+	uint64 restartBits = restartInterval ? ((uint64)count / restartInterval + 1) * (32 + 4) : 0;
+	if (lFlag || fixedLengthBits * 100 <= (bitCount + payloadBits + restartBits) * (100 + FIXED_LENGTH_THRESHOLD))
+	{
+		// Forget the dictionary we just wrote
+		stats.encodedDictionaryBits -= bitCount;
+		return encodeFixedLengthBlock(pIn, count, used, blockBuffer);
+	}
+	stats.payloadBits += payloadBits;
+
+	// The same average code length computeAverageCodeLength gives us but for
+	//    just this block, if it's short the decoder should use multi symbol tables.
+	if (count > 0 && (double)payloadBits / (double)count < MULTI_SYMBOL_AVERAGE_BITS)
+		flags |= BLOCK_FLAG_SHORT_CODES;
+
+	if (restartInterval)
+	{
+		encodeRestartChunks(pIn, count, codeMap, &pOut, &bitCount, &bufferBit);
+		flags |= BLOCK_FLAG_RESTARTS;
+	}
+	else
+		for (uint32 i = 0; i < count; ++i)
+			insertCodeIntoBuffer(&pOut, &bitCount, &bufferBit, codeMap[pIn[i]]);
+
+	// Pad the last byte with 0's, the symbol count tells the decoder where to stop.
+	padToByte(&pOut, &bufferBit);
+
+	return finishBlock(blockBuffer, flags, count, (uint32)(pOut - body));
+}
+
+// Whether count bytes of text are better off as the filteredSize bytes
+//    filterIntegerColumn made of them, building the filtered bytes'
+//    dictionary in codeMap. They are if their codes come in under the
+//    entropy of the text itself.
+bool integerColumnWins(const uint8* pIn, uint32 count, const uint8* filterBuffer, uint64 filteredSize, HuffmanCode* codeMap)
+{
+	uint32 textCounts[256] = { 0 };
+	for (uint32 i = 0; i < count; ++i)
+		++textCounts[pIn[i]];
+	double textBits = 0;
+	for (uint16 i = 0; i < 256; ++i)
+		if (textCounts[i] > 0)
+			textBits += textCounts[i] * log2((double)count / textCounts[i]);
+
+	createBlockCodeMap(filterBuffer, (uint32)filteredSize, codeMap);
+	uint64 filteredBits = 0;
+	for (uint64 i = 0; i < filteredSize; ++i)
+		filteredBits += codeMap[filterBuffer[i]].depth;
+	return (double)filteredBits < textBits;
+}
+
+// Tries to encode count bytes of text as an integer column into blockBuffer,
+//    building the filtered bytes' dictionary in codeMap. Returns 0, having
+//    written nothing, if the text isn't an integer column or the filtered
+//    bytes wouldn't beat the entropy of the text itself.
+uint64 encodeIntegerColumnBlock(const uint8* pIn, uint32 count, HuffmanCode* codeMap, HuffmanCode* previous, uint8* filterBuffer, uint8* blockBuffer)
+{
+	// Only worth it if it's smaller, which also keeps it within blockBuffer.
+	uint64 filteredSize = filterIntegerColumn(pIn, count, filterBuffer, count);
+	if (filteredSize == 0) return 0;
+	if (!integerColumnWins(pIn, count, filterBuffer, filteredSize, codeMap)) return 0;
+
+	uint64 payloadBits = stats.payloadBits;
+	uint64 blockSize = encodeBlock(filterBuffer, (uint32)filteredSize, codeMap, true, previous, blockBuffer);
+	blockBuffer[0] |= BLOCK_FLAG_INTEGER_COLUMN;
+	++stats.integerColumnBlocks;
+	stats.integerColumnSymbols += filteredSize;
+	stats.integerColumnBits += stats.payloadBits - payloadBits;
+	return blockSize;
+}
+
+// Decodes a block written by encodeFixedLengthBlock.
+void decodeFixedLengthBlock(const uint8* body, uint32 bodySize, uint8* pOut, uint32 count, uint64* bitCount)
+{
+	fatalErrorIf(bodySize < FIXED_LENGTH_HEADER_SIZE, CORRUPT_ENCODED_FILE);
+
+	uint8 remap[256];
+	uint16 remapCount = 0;
+	for (uint16 i = 0; i < 256; ++i)
+		if ((body[i / 8] >> (7 - i % 8)) & 1)
+			remap[remapCount++] = (uint8)i;
+
+	uint8 width = body[32];
+	fatalErrorIf(remapCount == 0 || width != getFixedLengthWidth(remapCount), CORRUPT_ENCODED_FILE);
+	fatalErrorIf(bodySize != FIXED_LENGTH_HEADER_SIZE + getFixedLengthPackedSize(count, width), CORRUPT_ENCODED_FILE);
+
+	unpackFixedLength(body + FIXED_LENGTH_HEADER_SIZE, count, width, remap, remapCount, pOut);
+	*bitCount += (uint64)count * width;
+}
+
+// Writing to a 0 stream discards the bytes.
+void writeOrExit(const void* buffer, uint64 size, ByteStream* stream)
+{
+	if (stream == 0) return;
+
+	if (stream->file)
+		fatalErrorIf(size != fwrite(buffer, sizeof(uint8), size, stream->file), FILE_WRITE_FAILED);
+	else if (stream->writer)
+		fatalErrorIf(!writeFileWriter(stream->writer, buffer, size), FILE_WRITE_FAILED);
+	else if (stream->console)
+		printBuffer((uint8*)buffer, size);
+	else
+	{
+		if (stream->size + size > stream->capacity)
+		{
+			stream->capacity = (stream->size + size) * 2;
+			stream->memory = realloc(stream->memory, stream->capacity);
+			fatalErrorIf(stream->memory == NULL, CALLOC_FAILED);
+		}
+		memcpy(stream->memory + stream->size, buffer, size);
+		stream->size += size;
+	}
+}
+
+// Returns false if there weren't size bytes left in the stream.
+bool readStream(void* buffer, uint64 size, ByteStream* stream)
+{
+	if (stream->file)
+		return size == fread(buffer, sizeof(uint8), size, stream->file);
+
+	if (size > stream->size - stream->position) return false;
+	memcpy(buffer, stream->memory + stream->position, size);
+	stream->position += size;
+	return true;
+}
+
+void readOrExit(void* buffer, uint64 size, ByteStream* stream)
+{
+	fatalErrorIf(!readStream(buffer, size, stream), CORRUPT_ENCODED_FILE);
+}
+
+void addBlockToIndex(BlockIndex* index, uint64 offset, uint64 firstSymbol)
+{
+	if (index->count == index->capacity)
+	{
+		index->capacity = index->capacity ? index->capacity * 2 : 64;
+		index->entries = realloc(index->entries, index->capacity * sizeof(BlockIndexEntry));
+		fatalErrorIf(index->entries == NULL, CALLOC_FAILED);
+	}
+	index->entries[index->count].offset = offset;
+	index->entries[index->count].firstSymbol = firstSymbol;
+	++index->count;
+}
+
+// Writes the end block, the index and the trailer. Returns the number of bytes written.
+uint64 writeStreamEnd(BlockIndex* index, ByteStream* out)
+{
+	// The index can be any size so it goes out a few entries at a time.
+	uint8 buffer[64 * INDEX_ENTRY_SIZE];
+	memset(buffer, 0, BLOCK_HEADER_SIZE);
+	buffer[0] = BLOCK_FLAG_END;
+	writeUint32(buffer + 5, (uint32)(index->count * INDEX_ENTRY_SIZE));
+	writeOrExit(buffer, BLOCK_HEADER_SIZE, out);
+
+	uint8* p = buffer;
+	for (uint64 i = 0; i < index->count; ++i)
+	{
+		writeUint64(p, index->entries[i].offset);
+		writeUint64(p + 8, index->entries[i].firstSymbol);
+		p += INDEX_ENTRY_SIZE;
+		if (p == buffer + sizeof(buffer) || i + 1 == index->count)
+		{
+			writeOrExit(buffer, p - buffer, out);
+			p = buffer;
+		}
+	}
+
+	writeUint64(buffer, index->totalSymbols);
+	writeUint32(buffer + 8, index->streamChecksum);
+	writeUint64(buffer + 12, index->endOffset);
+	memcpy(buffer + 20, STREAM_MAGIC, 4);
+	writeOrExit(buffer, STREAM_TRAILER_SIZE, out);
+	return BLOCK_HEADER_SIZE + index->count * INDEX_ENTRY_SIZE + STREAM_TRAILER_SIZE;
+}
+
+// Loads the index and trailer from the end of an existing compressed file.
+void readStreamEnd(BlockIndex* index, FILE* file)
+{
+	ByteStream stream = { .file = file };
+	uint8 header[STREAM_HEADER_SIZE];
+	fatalErrorIf(fseek64(file, 0, SEEK_SET) != 0, UNKNOWN_FORMAT);
+	fatalErrorIf(STREAM_HEADER_SIZE != fread(header, sizeof(uint8), STREAM_HEADER_SIZE, file), UNKNOWN_FORMAT);
+	fatalErrorIf(memcmp(header, STREAM_MAGIC, 4) != 0 || header[4] != STREAM_VERSION, UNKNOWN_FORMAT);
+
+	uint8 trailer[STREAM_TRAILER_SIZE];
+	fatalErrorIf(fseek64(file, -STREAM_TRAILER_SIZE, SEEK_END) != 0, UNKNOWN_FORMAT);
+	uint64 trailerOffset = ftell64(file);
+	readOrExit(trailer, STREAM_TRAILER_SIZE, &stream);
+	fatalErrorIf(memcmp(trailer + 20, STREAM_MAGIC, 4) != 0, UNKNOWN_FORMAT);
+
+	index->totalSymbols = readUint64(trailer);
+	index->streamChecksum = readUint32(trailer + 8);
+	index->endOffset = readUint64(trailer + 12);
+	fatalErrorIf(index->endOffset + BLOCK_HEADER_SIZE > trailerOffset, CORRUPT_ENCODED_FILE);
+
+	uint8 blockHeader[BLOCK_HEADER_SIZE];
+	fatalErrorIf(fseek64(file, index->endOffset, SEEK_SET) != 0, CORRUPT_ENCODED_FILE);
+	readOrExit(blockHeader, BLOCK_HEADER_SIZE, &stream);
+	uint64 entryCount = readUint32(blockHeader + 5) / INDEX_ENTRY_SIZE;
+	fatalErrorIf(!(blockHeader[0] & BLOCK_FLAG_END), CORRUPT_ENCODED_FILE);
+	fatalErrorIf(index->endOffset + BLOCK_HEADER_SIZE + entryCount * INDEX_ENTRY_SIZE != trailerOffset, CORRUPT_ENCODED_FILE);
+
+	for (uint64 i = 0; i < entryCount; ++i)
+	{
+		uint8 entry[INDEX_ENTRY_SIZE];
+		readOrExit(entry, INDEX_ENTRY_SIZE, &stream);
+		addBlockToIndex(index, readUint64(entry), readUint64(entry + 8));
+	}
+}
+
+// Progress goes to stderr unless -g was given a file descriptor.
+FILE* openProgressFile()
+{
+	if (progressDescriptor == 2)
+		return stderr;
+	FILE* file = openDescriptor(progressDescriptor);
+	fatalErrorIf(file == NULL, PROGRESS_DESCRIPTOR_INVALID);
+	return file;
+}
+
+// Writes the stream header and starts the index after it.
+void writeStreamHeader(BlockIndex* index, ByteStream* out)
+{
+	uint8 header[STREAM_HEADER_SIZE] = { 0 };
+	memcpy(header, STREAM_MAGIC, 4);
+	header[4] = STREAM_VERSION;
+	index->endOffset = STREAM_HEADER_SIZE;
+	stats.containerBytes += STREAM_HEADER_SIZE;
+	stats.fileBytes += STREAM_HEADER_SIZE;
+	writeOrExit(header, STREAM_HEADER_SIZE, out);
+}
+
+void readStreamHeader(ByteStream* in)
+{
+	uint8 header[STREAM_HEADER_SIZE];
+	fatalErrorIf(!readStream(header, STREAM_HEADER_SIZE, in), UNKNOWN_FORMAT);
+	fatalErrorIf(memcmp(header, STREAM_MAGIC, 4) != 0 || header[4] != STREAM_VERSION, UNKNOWN_FORMAT);
+	stats.containerBytes += STREAM_HEADER_SIZE;
+	stats.fileBytes += STREAM_HEADER_SIZE;
+}
+
+// Encodes characterCount bytes, read from inFile or from pIn if inFile is 0,
+//    encodeBlockSize bytes at a time as blocks written to out and added to index.
+//    out may be 0 to only gather statistics. The stream checksum is taken
+//    over each chunk of input as it is read rather than in a separate pass.
+//    progress is updated once per block if it isn't 0.
+//    If dictionaryPending is false the decoder is already using codeMap's
+//    dictionary, otherwise the first block that needs it writes it. No
+//    dictionary is ever a delta of one from before this run. Returns
+//    whether the decoder is using codeMap's dictionary after the run, if
+//    so *dictionaryBlock is the index of the block it was last written in.
+bool encodeBlockRun(const uint8* pIn, FILE* inFile, uint64 characterCount, HuffmanCode* codeMap, bool dictionaryPending, uint64* dictionaryBlock, BlockIndex* index, ByteStream* out, Progress* progress, Workspace* workspace)
+{
+	uint64 chunkSize = characterCount < encodeBlockSize ? characterCount : encodeBlockSize;
+	uint8* blockBuffer = reserveBuffer(&workspace->blockBuffer, &workspace->blockCapacity, getMaxBlockSize(chunkSize));
+	uint8* filterBuffer = reserveBuffer(&workspace->filterBuffer, &workspace->filterCapacity, chunkSize);
+	uint8* inBuffer = inFile ? reserveBuffer(&workspace->inBuffer, &workspace->inCapacity, chunkSize) : 0;
+
+	uint32 streamChecksum = index->streamChecksum;
+	uint64 firstOffset = index->endOffset;
+	// With -p every block gets its own dictionary, written as a delta of
+	//    the previous block's when that is smaller.
+	HuffmanCode blockCodeMaps[2][256];
+	HuffmanCode* blockCodeMap = codeMap;
+	HuffmanCode* previousCodeMap = 0;
+	for (uint64 remaining = characterCount; remaining > 0;)
+	{
+		uint32 count = remaining > encodeBlockSize ? encodeBlockSize : (uint32)remaining;
+		if (inFile)
+		{
+			// I think this can only happen if the file changed between
+			//    us previously reading it and now since we know how
+			//    many bytes we should be reading..?
+			double ioStart = progress ? hFTNow() : 0;
+			fatalErrorIf(count != fread(inBuffer, sizeof(uint8), count, inFile), UNEXPECTED_ERROR);
+			pIn = inBuffer;
+			if (progress)
+				progress->ioTime += hFTNow() - ioStart;
+		}
+
+		streamChecksum = crc32c(streamChecksum, pIn, count);
+
+		// Never build a dictionary over the one the next delta is against,
+		//    it isn't always the last block's when there are fixed length
+		//    blocks in between.
+		HuffmanCode* freeCodeMap = previousCodeMap == blockCodeMaps[0] ? blockCodeMaps[1] : blockCodeMaps[0];
+		HuffmanCode* writtenCodeMap = freeCodeMap;
+
+		uint64 blockSize = encodeIntegerColumnBlock(pIn, count, freeCodeMap, previousCodeMap, filterBuffer, blockBuffer);
+		if (blockSize > 0)
+		{
+			// The decoder now has the filtered bytes' dictionary so the
+			//    next text block has to bring its own again.
+			if (!(blockBuffer[0] & BLOCK_FLAG_FIXED_LENGTH))
+				dictionaryPending = true;
+		}
+		else
+		{
+			if (pFlag)
+			{
+				blockCodeMap = freeCodeMap;
+				createBlockCodeMap(pIn, count, blockCodeMap);
+			}
+			writtenCodeMap = blockCodeMap;
+
+			// Every stream starts with a dictionary so appended blocks never
+			//    depend on the dictionary of the blocks before them. Fixed
+			//    length blocks don't use it so it waits for the next block.
+			//    Only -p's dictionaries are deltas, the shared one always
+			//    stands on its own so archive members can start from it.
+			blockSize = encodeBlock(pIn, count, blockCodeMap, dictionaryPending || pFlag, pFlag ? previousCodeMap : 0, blockBuffer);
+			if (!(blockBuffer[0] & BLOCK_FLAG_FIXED_LENGTH))
+			{
+				if (dictionaryPending && !pFlag)
+					*dictionaryBlock = index->count;
+				dictionaryPending = false;
+			}
+		}
+		if (blockBuffer[0] & (BLOCK_FLAG_DICTIONARY | BLOCK_FLAG_COMPACT_DICTIONARY))
+			previousCodeMap = writtenCodeMap;
+
+		addBlockToIndex(index, index->endOffset, index->totalSymbols);
+		index->endOffset += blockSize;
+		index->totalSymbols += count;
+		stats.fileBytes += blockSize;
+		double ioStart = progress ? hFTNow() : 0;
+		writeOrExit(blockBuffer, blockSize, out);
+
+		if (!inFile)
+			pIn += count;
+		remaining -= count;
+
+		if (progress)
+		{
+			progress->ioTime += hFTNow() - ioStart;
+			uint64 processed = characterCount - remaining;
+			updateProgress(progress, processed, (double)(index->endOffset - firstOffset) / (double)processed);
+		}
+	}
+
+	index->streamChecksum = streamChecksum;
+	return !dictionaryPending && !pFlag;
+}
+
+// Writes the end of a stream of characterCount symbols, returns its size.
+uint64 finishStream(BlockIndex* index, ByteStream* out, uint64 characterCount)
+{
+	// The digest size is whatever the blocks actually used, with -p it
+	//    will differ from the estimate made with the global dictionary.
+	stats.streamChecksum = index->streamChecksum;
+	stats.bitsAfterEncoding = stats.payloadBits;
+	if (characterCount > 0)
+		stats.averageCodeLength = (double)stats.payloadBits / (double)characterCount;
+
+	uint64 endSize = writeStreamEnd(index, out);
+	stats.containerBytes += endSize;
+	stats.fileBytes += endSize;
+	return endSize;
+}
+
+// Encodes characterCount bytes as blocks, see encodeBlockRun, followed by
+//    the end block.
+void encodeBlocks(const uint8* pIn, FILE* inFile, uint64 characterCount, HuffmanCode* codeMap, BlockIndex* index, ByteStream* out, Progress* progress, Workspace* workspace)
+{
+	uint64 firstOffset = index->endOffset;
+	uint64 dictionaryBlock;
+	encodeBlockRun(pIn, inFile, characterCount, codeMap, true, &dictionaryBlock, index, out, progress, workspace);
+	uint64 endSize = finishStream(index, out, characterCount);
+	if (progress && characterCount > 0)
+		finishProgress(progress, characterCount, (double)(index->endOffset + endSize - firstOffset) / (double)characterCount);
+}
+
+// Prints the encoded input to the console as one continuous bit stream, so
+//    partial bytes are carried over between chunks. Input is read from
+//    inFile or from pIn if inFile is 0.
+void printEncodedInput(const uint8* pIn, FILE* inFile, uint64 characterCount, HuffmanCode* codeMap)
+{
+	uint64 chunkSize = characterCount < encodeBlockSize ? characterCount : encodeBlockSize;
+	uint8* buffer = malloc(getMaxBlockSize(chunkSize));
+	fatalErrorIf(buffer == NULL, CALLOC_FAILED);
+	uint8* inBuffer = 0;
+	if (inFile)
+	{
+		inBuffer = malloc(chunkSize);
+		fatalErrorIf(inBuffer == NULL, CALLOC_FAILED);
+	}
+
+	uint8* pOut = buffer;
+	uint8 bufferBit = 0;
+	uint64 bitsCount = 0;
+	for (uint64 remaining = characterCount; remaining > 0;)
+	{
+		uint32 count = remaining > encodeBlockSize ? encodeBlockSize : (uint32)remaining;
+		if (inFile)
+		{
+			fatalErrorIf(count != fread(inBuffer, sizeof(uint8), count, inFile), UNEXPECTED_ERROR);
+			pIn = inBuffer;
+		}
+
+		for (uint32 i = 0; i < count; ++i)
+			insertCodeIntoBuffer(&pOut, &bitsCount, &bufferBit, codeMap[pIn[i]]);
+
+		// Print the full bytes and move the partial byte to the start of the buffer.
+		if (!nFlag)
+			printBuffer(buffer, pOut - buffer);
+		*buffer = *pOut;
+		pOut = buffer;
+
+		if (!inFile)
+			pIn += count;
+		remaining -= count;
+	}
+
+	// If we have a partial byte left over we fill the remaining space with
+	//    0's so we don't use whatever happens to be in memory when outputing
+	if (bufferBit > 0)
+	{
+		HuffmanCode c = { 8 - bufferBit, 0 };
+		uint64 t = 0; // We don't want to increment the bitCount
+		insertCodeIntoBuffer(&pOut, &t, &bufferBit, c);
+	}
+
+	if (!nFlag)
+		printBufferBits(buffer, bitsCount % 8);
+
+	free(inBuffer);
+	free(buffer);
+}
+
+// Encodes the input either writing the blocks to the output file or
+//    printing the encoded message to the console.
+void encodeInput(HuffmanCode* codeMap, uint64 characterCount)
+{
+	FILE* inFile = 0;
+	const uint8* pIn = (const uint8*)input;
+	if (fFlag)
+	{
+		inFile = fopen(input, "rb");
+		fatalErrorIf(inFile == NULL, FILE_NON_EXISTENT);
+		pIn = 0;
+	}
+
+	if (!oFlag)
+		printEncodedInput(pIn, inFile, characterCount, codeMap);
+	else
+	{
+		BlockIndex index = { 0 };
+
+		// When appending to an existing file we pick up its index and
+		//    checksum and start writing over its end block, otherwise
+		//    we start a new stream.
+		if (aFlag && !nFlag)
+		{
+			FILE* existing = fopen(output, "rb");
+			if (existing != NULL)
+			{
+				readStreamEnd(&index, existing);
+				fclose(existing);
+				stats.appendedToBlocks = index.count;
+			}
+		}
+
+		// No need to open the file if we aren't writing. The space reserved
+		//    is the estimate main made with the global dictionary plus the
+		//    worst case for every block's container and dictionary.
+		FileWriter writer;
+		ByteStream out = { 0 };
+		if (!nFlag)
+		{
+			uint64 offset = index.count > 0 ? index.endOffset : 0;
+			uint64 blocks = characterCount / encodeBlockSize + 1;
+			uint64 expectedSize = offset + STREAM_HEADER_SIZE + (stats.bitsAfterEncoding + 7) / 8 +
+				(index.count + blocks) * (BLOCK_HEADER_SIZE + MAX_DICTIONARY_SIZE + BLOCK_TRAILER_SIZE + INDEX_ENTRY_SIZE) +
+				BLOCK_HEADER_SIZE + STREAM_TRAILER_SIZE;
+			fatalErrorIf(!openFileWriter(&writer, output, offset, writeBufferSize, xFlag, expectedSize), WRITE_FILE_OPEN_FAILED);
+			out.writer = &writer;
+		}
+
+		if (index.count == 0)
+			writeStreamHeader(&index, nFlag ? 0 : &out);
+
+		Progress progress;
+		if (gFlag)
+			startProgress(&progress, progressFile, progressDescriptor == 2, characterCount);
+		Workspace workspace = { 0 };
+		encodeBlocks(pIn, inFile, characterCount, codeMap, &index, nFlag ? 0 : &out, gFlag ? &progress : 0, &workspace);
+		freeWorkspace(&workspace);
+
+		if (out.writer)
+			fatalErrorIf(!closeFileWriter(out.writer), FILE_WRITE_FAILED);
+		free(index.entries);
+	}
+
+	if (inFile)
+		fclose(inFile);
+}
+
+// What the decoder carries from one block to the next.
+typedef struct
+{
+	HuffmanCode* codeMap;
+	DecodeTable* table;
+	bool dictionaryFound;
+	bool tableStale;
+	bool tableMultiSymbol;
+	uint64 bitsCount;
+} BlockDecoder;
+
+void startBlockDecoder(BlockDecoder* decoder, HuffmanCode* codeMap, Workspace* workspace)
+{
+	memset(decoder, 0, sizeof(BlockDecoder));
+	decoder->codeMap = codeMap;
+	decoder->table = (DecodeTable*)reserveBuffer((uint8**)&workspace->table, &workspace->tableCapacity, sizeof(DecodeTable));
+	decoder->tableStale = true;
+}
+
+// Reads the dictionary at the start of a block's body if it has one,
+//    leaving *pIn and *bufferBit just after it.
+void readBlockDictionary(BlockDecoder* decoder, uint8 flags, uint8* body, uint32 bodySize, uint8** pIn, uint8* bufferBit)
+{
+	*pIn = body;
+	*bufferBit = 0;
+	if (flags & BLOCK_FLAG_DICTIONARY)
+	{
+		memset(decoder->codeMap, 0, sizeof(HuffmanCode) * 256);
+		decodeDictionary(decoder->codeMap, pIn, bufferBit, body + bodySize, &stats.dictionaryBitLength);
+		decoder->dictionaryFound = true;
+		decoder->tableStale = true;
+	}
+	else if (flags & BLOCK_FLAG_COMPACT_DICTIONARY)
+	{
+		decodeCompactDictionary(decoder->codeMap, pIn, bufferBit, body + bodySize, &stats.dictionaryBitLength);
+		decoder->dictionaryFound = true;
+		decoder->tableStale = true;
+	}
+}
+
+// Decodes the body of a block that has already passed its checksum.
+//    Returns the decoded text, which is in one of workspace's buffers, and
+//    its size in *textSize.
+uint8* decodeBlockBody(BlockDecoder* decoder, uint8 flags, uint32 symbolCount, uint8* body, uint32 bodySize, Workspace* workspace, uint64* textSize)
+{
+	uint8* outBuffer = reserveBuffer(&workspace->outBuffer, &workspace->outCapacity, symbolCount);
+
+	if (flags & BLOCK_FLAG_FIXED_LENGTH)
+	{
+		decodeFixedLengthBlock(body, bodySize, outBuffer, symbolCount, &decoder->bitsCount);
+		stats.dictionaryBitLength += FIXED_LENGTH_HEADER_SIZE * 8;
+		++stats.fixedLengthBlocks;
+	}
+	else
+	{
+		uint8* pIn;
+		uint8 bufferBit;
+		readBlockDictionary(decoder, flags, body, bodySize, &pIn, &bufferBit);
+		fatalErrorIf(!decoder->dictionaryFound, CORRUPT_DICTIONARY);
+
+		// Only rebuild the decode table when the dictionary or the table mode changes.
+		bool multiSymbol = (flags & BLOCK_FLAG_SHORT_CODES) != 0;
+		if (decoder->tableStale || multiSymbol != decoder->tableMultiSymbol)
+		{
+			buildDecodeTable(decoder->table, decoder->codeMap, multiSymbol);
+			decoder->tableMultiSymbol = multiSymbol;
+			decoder->tableStale = false;
+		}
+
+		if (flags & BLOCK_FLAG_RESTARTS)
+		{
+			// Restarts came after canonical codes so can always use the table.
+			fatalErrorIf(!decoder->table->canonical, CORRUPT_DICTIONARY);
+			decodeRestartBlock(pIn, bufferBit, body + bodySize, decoder->table, outBuffer, symbolCount, &decoder->bitsCount);
+		}
+		else
+			decodeBlock(pIn, bufferBit, body + bodySize, decoder->table, decoder->codeMap, outBuffer, symbolCount, &decoder->bitsCount);
+	}
+
+	*textSize = symbolCount;
+	if (flags & BLOCK_FLAG_INTEGER_COLUMN)
+	{
+		uint64 capacity = getUnfilteredCapacity(outBuffer, symbolCount);
+		fatalErrorIf(capacity == 0, CORRUPT_ENCODED_FILE);
+		uint8* textBuffer = reserveBuffer(&workspace->textBuffer, &workspace->textCapacity, capacity);
+		*textSize = unfilterIntegerColumn(outBuffer, symbolCount, textBuffer, capacity);
+		fatalErrorIf(*textSize == 0, CORRUPT_ENCODED_FILE);
+		++stats.integerColumnBlocks;
+		return textBuffer;
+	}
+	return outBuffer;
+}
+
+// Reads the rest of a block whose header has been read, checks it against
+//    its checksum and returns its body which is in workspace's block buffer.
+uint8* readBlockBody(ByteStream* in, uint8 flags, uint32 symbolCount, uint32 bodySize, Workspace* workspace, Progress* progress)
+{
+	// Bodies can never be larger than the worst case encoding of their
+	//    symbols, the member table has no symbols and is whatever it is.
+	fatalErrorIf(!(flags & BLOCK_FLAG_MEMBERS) && bodySize + BLOCK_HEADER_SIZE + BLOCK_TRAILER_SIZE > getMaxBlockSize(symbolCount), CORRUPT_ENCODED_FILE);
+	fatalErrorIf((flags & BLOCK_FLAG_MEMBERS) && symbolCount != 0, CORRUPT_ENCODED_FILE);
+
+	uint8* blockBuffer = reserveBuffer(&workspace->blockBuffer, &workspace->blockCapacity, (uint64)bodySize + BLOCK_TRAILER_SIZE);
+	double ioStart = progress ? hFTNow() : 0;
+	readOrExit(blockBuffer, (uint64)bodySize + BLOCK_TRAILER_SIZE, in);
+	if (progress)
+		progress->ioTime += hFTNow() - ioStart;
+	fatalErrorIf(crc32c(0, blockBuffer, bodySize) != readUint32(blockBuffer + bodySize), BLOCK_CHECKSUM_MISMATCH);
+	stats.containerBytes += BLOCK_HEADER_SIZE + BLOCK_TRAILER_SIZE;
+	stats.fileBytes += BLOCK_HEADER_SIZE + bodySize + BLOCK_TRAILER_SIZE;
+	++stats.blockCount;
+	return blockBuffer;
+}
+
+// Decodes the blocks after the stream header, checking every block against
+//    its checksum before decoding it and the decoded output against the
+//    stream checksum as it is produced. The output goes to out which may
+//    be 0 to only gather statistics. progress, if it isn't 0, counts the
+//    encoded bytes read. An archive's member table is checked and skipped,
+//    its members come out one after another.
+void decodeBlocks(ByteStream* in, HuffmanCode* codeMap, ByteStream* out, Progress* progress, Workspace* workspace)
+{
+	BlockDecoder decoder;
+	startBlockDecoder(&decoder, codeMap, workspace);
+	uint32 streamChecksum = 0;
+	uint64 count = 0;
+	BlockIndex* index = &workspace->index;
+	index->count = 0;
+	uint64 offset = STREAM_HEADER_SIZE;
+
+	for (;;)
+	{
+		uint8 blockHeader[BLOCK_HEADER_SIZE];
+		readOrExit(blockHeader, BLOCK_HEADER_SIZE, in);
+		uint8 flags = blockHeader[0];
+		uint32 symbolCount = readUint32(blockHeader + 1);
+		uint32 bodySize = readUint32(blockHeader + 5);
+
+		if (flags & BLOCK_FLAG_END)
+		{
+			// The index must describe exactly the blocks we just decoded.
+			fatalErrorIf(bodySize != index->count * INDEX_ENTRY_SIZE, CORRUPT_ENCODED_FILE);
+			for (uint64 i = 0; i < index->count; ++i)
+			{
+				uint8 entry[INDEX_ENTRY_SIZE];
+				readOrExit(entry, INDEX_ENTRY_SIZE, in);
+				fatalErrorIf(readUint64(entry) != index->entries[i].offset, CORRUPT_ENCODED_FILE);
+				fatalErrorIf(readUint64(entry + 8) != index->entries[i].firstSymbol, CORRUPT_ENCODED_FILE);
+			}
+
+			uint8 trailer[STREAM_TRAILER_SIZE];
+			readOrExit(trailer, STREAM_TRAILER_SIZE, in);
+			stats.containerBytes += BLOCK_HEADER_SIZE + bodySize + STREAM_TRAILER_SIZE;
+			stats.fileBytes += BLOCK_HEADER_SIZE + bodySize + STREAM_TRAILER_SIZE;
+			fatalErrorIf(readUint64(trailer) != count, CORRUPT_ENCODED_FILE);
+			fatalErrorIf(readUint32(trailer + 8) != streamChecksum, STREAM_CHECKSUM_MISMATCH);
+			fatalErrorIf(readUint64(trailer + 12) != offset || memcmp(trailer + 20, STREAM_MAGIC, 4) != 0, CORRUPT_ENCODED_FILE);
+			if (progress)
+				finishProgress(progress, offset + BLOCK_HEADER_SIZE + bodySize + STREAM_TRAILER_SIZE, count > 0 ? (double)offset / (double)count : 0);
+			break;
+		}
+
+		uint8* body = readBlockBody(in, flags, symbolCount, bodySize, workspace, progress);
+		addBlockToIndex(index, offset, count);
+		offset += BLOCK_HEADER_SIZE + bodySize + BLOCK_TRAILER_SIZE;
+		if (flags & BLOCK_FLAG_MEMBERS)
+		{
+			stats.containerBytes += bodySize;
+			continue;
+		}
+
+		uint64 textSize;
+		uint8* text = decodeBlockBody(&decoder, flags, symbolCount, body, bodySize, workspace, &textSize);
+		streamChecksum = crc32c(streamChecksum, text, textSize);
+		count += textSize;
+
+		if (progress)
+		{
+			double ioStart = hFTNow();
+			writeOrExit(text, textSize, out);
+			progress->ioTime += hFTNow() - ioStart;
+			updateProgress(progress, offset, (double)offset / (double)count);
+		}
+		else
+			writeOrExit(text, textSize, out);
+	}
+
+	stats.bitsAfterEncoding = decoder.bitsCount;
+	stats.bytesAfterDecoding = count;
+	stats.streamChecksum = streamChecksum;
+}
+
+// Decodes the input file to the output file or the console.
+void decodeInput(HuffmanCode* codeMap)
+{
+	FILE* inFile = fopen(input, "rb");
+	fatalErrorIf(inFile == NULL, FILE_NON_EXISTENT);
+	ByteStream in = { .file = inFile };
+
+	// Progress is measured through the encoded file since we don't know
+	//    how big the output is until the end.
+	Progress progress;
+	if (gFlag)
+	{
+		fatalErrorIf(fseek64(inFile, 0, SEEK_END) != 0, UNKNOWN_FORMAT);
+		uint64 size = ftell64(inFile);
+		fatalErrorIf(fseek64(inFile, 0, SEEK_SET) != 0, UNKNOWN_FORMAT);
+		startProgress(&progress, progressFile, progressDescriptor == 2, size);
+	}
+	readStreamHeader(&in);
+
+	// No need to open the file if we aren't writing. The trailer tells us
+	//    how big the output will be so the space can be reserved, since
+	//    it hasn't been checked yet we don't trust it past the best ratio
+	//    any block can manage.
+	FileWriter writer;
+	ByteStream out = { 0 };
+	if (oFlag && !nFlag)
+	{
+		uint64 expectedSize = 0;
+		uint8 trailer[STREAM_TRAILER_SIZE];
+		if (fseek64(inFile, -STREAM_TRAILER_SIZE, SEEK_END) == 0)
+		{
+			uint64 inputSize = ftell64(inFile) + STREAM_TRAILER_SIZE;
+			if (STREAM_TRAILER_SIZE == fread(trailer, sizeof(uint8), STREAM_TRAILER_SIZE, inFile) && memcmp(trailer + 20, STREAM_MAGIC, 4) == 0)
+				expectedSize = readUint64(trailer);
+			if (expectedSize / 256 > inputSize)
+				expectedSize = 0;
+		}
+		fatalErrorIf(fseek64(inFile, STREAM_HEADER_SIZE, SEEK_SET) != 0, UNKNOWN_FORMAT);
+
+		fatalErrorIf(!openFileWriter(&writer, output, 0, writeBufferSize, xFlag, expectedSize), WRITE_FILE_OPEN_FAILED);
+		out.writer = &writer;
+	}
+	else
+		out.console = true;
+
+	Workspace workspace = { 0 };
+	decodeBlocks(&in, codeMap, nFlag ? 0 : &out, gFlag ? &progress : 0, &workspace);
+	freeWorkspace(&workspace);
+
+	fclose(inFile);
+	if (out.writer)
+		fatalErrorIf(!closeFileWriter(out.writer), FILE_WRITE_FAILED);
+}
+
+void computeAverageCodeLength(CountMap map, HuffmanCode* codeMap)
+{
+	double total = map.map[0] * codeMap[0].depth;
+	stats.dictionaryBitLength = codeMap[0].depth;
+	for (uint8 i = 1; i > 0; ++i) // When the uint8 overflows i == 0
+	{
+		total += map.map[i] * codeMap[i].depth;
+		stats.dictionaryBitLength = codeMap[0].depth;
+	}
+
+	stats.bitsAfterEncoding = total;
+	stats.averageCodeLength = (double)total / (double)map.count;
+}
+
+// The bits encodeBlockDictionary would write for codeMap with no previous
+//    dictionary, whichever of the full and compact dictionaries is smaller.
+uint64 measureDictionaryBits(HuffmanCode* codeMap)
+{
+	uint64 fullBits = 33 * 8;
+	for (uint16 i = 0; i < 256; ++i)
+		if (codeMap[i].depth > 0)
+			fullBits += 5 + codeMap[i].depth;
+
+	uint8 compact[MAX_DICTIONARY_SIZE];
+	uint8* compactEnd = compact;
+	uint64 compactBits = 0;
+	uint8 compactBit = 0;
+	encodeCompactDictionary(codeMap, 0, &compactEnd, &compactBits, &compactBit);
+	return fullBits < compactBits ? fullBits : compactBits;
+}
+
+// Symbol counts from the chunks estimateOutput sampled of one kind, text
+//    or integer column. products holds, for every pair of symbols, the sum
+//    over the chunks of their counts in the chunk multiplied together.
+typedef struct
+{
+	uint64 counts[256];
+	double* products;
+	uint64 symbols;
+	uint64 textBytes;
+	uint64 chunks;
+} SampleCounts;
+
+// Adds a chunk of length symbols, standing for textBytes of the input.
+void addSample(SampleCounts* sample, const uint8* chunk, uint64 length, uint64 textBytes)
+{
+	uint32 counts[256] = { 0 };
+	uint8 used[256];
+	uint16 usedCount = 0;
+	for (uint64 i = 0; i < length; ++i)
+		if (counts[chunk[i]]++ == 0)
+			used[usedCount++] = chunk[i];
+	for (uint16 a = 0; a < usedCount; ++a)
+	{
+		sample->counts[used[a]] += counts[used[a]];
+		for (uint16 b = 0; b < usedCount; ++b)
+			sample->products[used[a] * 256 + used[b]] += (double)counts[used[a]] * counts[used[b]];
+	}
+	sample->symbols += length;
+	sample->textBytes += textBytes;
+	++sample->chunks;
+}
+
+// Adds everything in from to sample, unless sample is 0, and empties from.
+void mergeSample(SampleCounts* sample, SampleCounts* from)
+{
+	if (from->chunks == 0) return;
+
+	// Only the symbols from has seen have products, this is once a block.
+	uint8 used[256];
+	uint16 usedCount = 0;
+	for (uint16 i = 0; i < 256; ++i)
+		if (from->counts[i] > 0)
+			used[usedCount++] = (uint8)i;
+	for (uint16 a = 0; a < usedCount; ++a)
+	{
+		if (sample)
+			sample->counts[used[a]] += from->counts[used[a]];
+		from->counts[used[a]] = 0;
+		for (uint16 b = 0; b < usedCount; ++b)
+		{
+			if (sample)
+				sample->products[used[a] * 256 + used[b]] += from->products[used[a] * 256 + used[b]];
+			from->products[used[a] * 256 + used[b]] = 0;
+		}
+	}
+	if (sample)
+	{
+		sample->symbols += from->symbols;
+		sample->textBytes += from->textBytes;
+		sample->chunks += from->chunks;
+	}
+	from->symbols = from->textBytes = from->chunks = 0;
+}
+
+// Counts a block's chunks as filtered if all of them were, otherwise as
+//    text. Every byte of them is added to allCounts either way.
+void finishSampleBlock(SampleCounts* text, SampleCounts* column, SampleCounts* blockText, SampleCounts* blockColumn, bool blockFilters, uint64* allCounts)
+{
+	for (uint16 i = 0; i < 256; ++i)
+		allCounts[i] += blockText->counts[i];
+	bool filters = blockFilters && blockColumn->chunks > 0;
+	mergeSample(filters ? column : text, filters ? blockColumn : blockText);
+	mergeSample(0, blockText);
+	mergeSample(0, blockColumn);
+}
+
+// Scales sampled counts, of sampledCount symbols, up to symbols symbols.
+//    Every symbol seen keeps at least 1.
+CountMap scaleSampleCounts(const uint64* counts, uint64 sampledCount, uint64 symbols)
+{
+	CountMap map = { 0 };
+	for (uint16 i = 0; i < 256; ++i)
+	{
+		if (counts[i] == 0) continue;
+		map.map[i] = (uint64)((double)counts[i] * symbols / sampledCount + 0.5);
+		if (map.map[i] == 0)
+			map.map[i] = 1;
+		map.count += map.map[i];
+		++map.uniqueCount;
+	}
+	return map;
+}
+
+// Scales sample up to symbols symbols and builds codeMap from them, or from
+//    codes if it isn't 0. Returns the bits they would encode to, adds the
+//    sampled chunks' bits and the sum of their squares to *sum and
+//    *sumOfSquares and sets *entropy to the entropy of the counts.
+double estimateSampleBits(const SampleCounts* sample, uint64 symbols, const CountMap* codes, HuffmanCode* codeMap, double* sum, double* sumOfSquares, double* entropy)
+{
+	CountMap map = scaleSampleCounts(sample->counts, sample->symbols, symbols);
+	memset(codeMap, 0, sizeof(HuffmanCode) * 256);
+	*entropy = 0;
+	if (map.count == 0) return 0;
+	createHuffmanCodes(codes ? codes : &map, codeMap);
+
+	double bits = 0;
+	for (uint16 i = 0; i < 256; ++i)
+	{
+		if (map.map[i] == 0) continue;
+		bits += (double)map.map[i] * codeMap[i].depth;
+		*entropy -= (double)map.map[i] / map.count * log2((double)map.map[i] / map.count);
+	}
+
+	// A chunk's bits are the dot product of its counts with the code lengths.
+	for (uint16 a = 0; a < 256; ++a)
+	{
+		*sum += (double)sample->counts[a] * codeMap[a].depth;
+		for (uint16 b = 0; b < 256; ++b)
+			*sumOfSquares += sample->products[a * 256 + b] * codeMap[a].depth * codeMap[b].depth;
+	}
+
+	// Scaling the counts can shift the total a little, the codes are
+	//    for symbols symbols.
+	return bits * symbols / map.count;
+}
+
+// Predicts what -o would write without encoding anything (-c). A chunk of
+//    SAMPLE_CHUNK_SIZE bytes is read every sampleStride bytes, seeking past
+//    the rest, and their counts scaled up to the whole input are what the
+//    codes are built from, just as createCountMap's would be.
+//
+//    Each chunk is put through the integer column filter too. When
+//    encodeIntegerColumnBlock would take every chunk sampled from a block
+//    their filtered bytes are counted, apart from the text, and otherwise
+//    the block's chunks are text, like encodeBlockRun decides a block at a
+//    time. The share of the input each kind of chunk covers is
+//    how much of it is estimated from their counts. Integer column blocks
+//    bring their own dictionary.
+//
+//    The confidence interval treats the chunks as a sample of every chunk in
+//    the input. A chunk's bits are the dot product of its counts with the code
+//    lengths, so the sum of every chunk's counts times its counts, over the
+//    symbols it has, is enough for their variance without keeping the
+//    samples until the code lengths are known. Symbols the samples never
+//    saw aren't in the estimate at all.
+void estimateOutput()
+{
+	double start = hFTNow();
+	FILE* f = 0;
+	uint64 size;
+	if (fFlag)
+	{
+		f = fopen(input, "rb");
+		fatalErrorIf(f == NULL, FILE_NON_EXISTENT);
+		fatalErrorIf(fseek64(f, 0, SEEK_END) != 0, FILE_NON_EXISTENT);
+		size = ftell64(f);
+	}
+	else
+		size = strlen(input);
+
+	// The current block's chunks are counted both ways until it's known
+	//    whether all of them filter.
+	SampleCounts text = { 0 }, column = { 0 }, blockText = { 0 }, blockColumn = { 0 };
+	text.products = calloc(256 * 256, sizeof(double));
+	column.products = calloc(256 * 256, sizeof(double));
+	blockText.products = calloc(256 * 256, sizeof(double));
+	blockColumn.products = calloc(256 * 256, sizeof(double));
+	fatalErrorIf(text.products == NULL || column.products == NULL || blockText.products == NULL || blockColumn.products == NULL, CALLOC_FAILED);
+	uint64 allCounts[256] = { 0 };
+	bool blockFilters = true;
+	uint64 block = 0;
+	uint8 chunk[SAMPLE_CHUNK_SIZE];
+	uint8 filtered[SAMPLE_CHUNK_SIZE];
+	HuffmanCode chunkCodeMap[256];
+	uint64 sampled = 0;
+	for (uint64 offset = 0; offset < size; offset += sampleStride)
+	{
+		uint64 length = size - offset < SAMPLE_CHUNK_SIZE ? size - offset : SAMPLE_CHUNK_SIZE;
+		if (f)
+			fatalErrorIf(fseek64(f, offset, SEEK_SET) != 0 || length != fread(chunk, sizeof(uint8), length, f), FILE_NON_EXISTENT);
+		else
+			memcpy(chunk, input + offset, length);
+		sampled += length;
+
+		if (offset / encodeBlockSize != block)
+		{
+			finishSampleBlock(&text, &column, &blockText, &blockColumn, blockFilters, allCounts);
+			blockFilters = true;
+			block = offset / encodeBlockSize;
+		}
+		addSample(&blockText, chunk, length, length);
+		if (!blockFilters) continue;
+
+		// The chunk goes through the filter as it is, the same as a block
+		//    that starts or ends partway through a line would.
+		uint64 filteredSize = filterIntegerColumn(chunk, length, filtered, length);
+		if (filteredSize > 0 && integerColumnWins(chunk, (uint32)length, filtered, filteredSize, chunkCodeMap))
+		{
+			// The chunk's flags, count, raw lines and first value, a delta
+			//    from 0, only happen once per block and would be overcounted,
+			//    so all but the input's first chunk start at its second value.
+			uint64 count, headSize, tailSize;
+			const uint8* deltas = filtered;
+			uint64 textBytes = length;
+			if (offset > 0)
+			{
+				uint64 value;
+				deltas = readVarint(getFilteredDeltas(filtered, filteredSize, &count, &headSize, &tailSize), filtered + filteredSize, &value);
+				uint64 line = headSize;
+				while (line < length && chunk[line++] != '\n');
+				textBytes -= line + tailSize;
+			}
+			addSample(&blockColumn, deltas, filtered + filteredSize - deltas, textBytes);
+		}
+		else
+			blockFilters = false;
+	}
+	if (f)
+		fclose(f);
+	finishSampleBlock(&text, &column, &blockText, &blockColumn, blockFilters, allCounts);
+	free(blockText.products);
+	free(blockColumn.products);
+
+	// Split the input between the two by the share of it their chunks had.
+	uint64 sampledText = text.textBytes + column.textBytes;
+	uint64 textSize = sampledText > 0 ? (uint64)((double)size * text.textBytes / sampledText + 0.5) : size;
+	uint64 columnSize = size - textSize;
+	uint64 columnSymbols = column.textBytes > 0 ? (uint64)((double)columnSize * column.symbols / column.textBytes + 0.5) : 0;
+
+	// Text blocks share the codes for the whole input, integer columns and
+	//    all, unless -p gives each block its own.
+	CountMap inputCounts = scaleSampleCounts(allCounts, sampled, size);
+	HuffmanCode codeMap[256], columnCodeMap[256];
+	double sum = 0, sumOfSquares = 0, entropy, columnEntropy;
+	double payloadBits = estimateSampleBits(&text, textSize, pFlag ? 0 : &inputCounts, codeMap, &sum, &sumOfSquares, &entropy);
+	double columnBits = estimateSampleBits(&column, columnSymbols, 0, columnCodeMap, &sum, &sumOfSquares, &columnEntropy);
+	free(text.products);
+	free(column.products);
+
+	// Bits per chunk, their mean and variance over the chunks sampled.
+	uint64 chunks = text.chunks + column.chunks;
+	double margin = 0;
+	uint64 population = (size + SAMPLE_CHUNK_SIZE - 1) / SAMPLE_CHUNK_SIZE;
+	if (chunks > 1 && population > chunks)
+	{
+		double mean = sum / chunks;
+		double variance = (sumOfSquares - chunks * mean * mean) / (chunks - 1);
+		double correction = (double)(population - chunks) / (double)(population - 1);
+		margin = 1.96 * sqrt(variance > 0 ? variance / chunks * correction : 0) * population;
+	}
+
+	// Everything that isn't payload, as encodeBlocks would write it. Text
+	//    after an integer column block needs its dictionary again.
+	uint64 blocks = size > 0 ? (size + encodeBlockSize - 1) / encodeBlockSize : 0;
+	uint64 columnBlocks = size > 0 ? (uint64)((double)blocks * columnSize / size + 0.5) : 0;
+	uint64 textBlocks = blocks - columnBlocks;
+	uint64 textDictionaries = pFlag || columnBlocks > 0 ? textBlocks : (textBlocks > 0 ? 1 : 0);
+	uint64 dictionaryBits = measureDictionaryBits(codeMap) * textDictionaries;
+	uint64 columnDictionaryBits = columnBlocks > 0 ? measureDictionaryBits(columnCodeMap) * columnBlocks : 0;
+	uint64 containerBytes = STREAM_HEADER_SIZE + blocks * (BLOCK_HEADER_SIZE + BLOCK_TRAILER_SIZE + INDEX_ENTRY_SIZE) + BLOCK_HEADER_SIZE + STREAM_TRAILER_SIZE;
+	if (restartInterval)
+		containerBytes += blocks * 5 + size / restartInterval * 4;
+
+	// The fixed length codec wins the text, as it would in encodeBlock, if it's close.
+	uint16 uniqueCount = 0;
+	for (uint16 i = 0; i < 256; ++i)
+		if (codeMap[i].depth > 0)
+			++uniqueCount;
+	uint8 fixedWidth = getFixedLengthWidth(uniqueCount);
+	double fixedBits = (double)(FIXED_LENGTH_HEADER_SIZE + getFixedLengthPackedSize(textSize, fixedWidth)) * 8;
+	bool fixedLength = textSize > 0 && (lFlag || fixedBits * 100 <= (dictionaryBits + payloadBits) * (100 + FIXED_LENGTH_THRESHOLD));
+	if (fixedLength)
+	{
+		payloadBits = (double)textSize * fixedWidth;
+		dictionaryBits = textBlocks * FIXED_LENGTH_HEADER_SIZE * 8;
+		if (columnBlocks == 0)
+			margin = 0;
+	}
+	double averageCodeLength = textSize > 0 ? (fixedLength ? (double)fixedWidth : payloadBits / textSize) : 0;
+
+	dictionaryBits += columnDictionaryBits;
+	payloadBits += columnBits;
+	uint64 headerBytes = (dictionaryBits + 7) / 8 + containerBytes;
+	double payloadBytes = payloadBits / 8;
+	double low = (payloadBits - margin) / 8, high = (payloadBits + margin) / 8;
+	double duration = hFTNow() - start;
+
+	printf("Estimate:\n");
+	printf("Sampled                   : %llu of %llu Bytes (%.2f%%) in %llu Chunks\n", sampled, size, size > 0 ? (double)sampled / size * 100.0 : 0, chunks);
+	printf("Payload Size              : %.0f Bytes +/- %.2f%% (95%%: %.0f - %.0f)%s\n", payloadBytes, payloadBytes > 0 ? margin / 8 / payloadBytes * 100.0 : 0,
+		low < 0 ? 0 : low, high, fixedLength ? " Fixed-Length" : "");
+	printf("Header Size               : %llu Bytes (%llu Dictionary, %llu Container)\n", headerBytes, (dictionaryBits + 7) / 8, containerBytes);
+	printf("Output File Size          : %.0f Bytes (95%%: %.0f - %.0f)\n", payloadBytes + headerBytes, (low < 0 ? 0 : low) + headerBytes, high + headerBytes);
+	double ratio = size > 0 ? (payloadBytes + headerBytes) / size : 0;
+	printf("File Compression Ratio    : %.3f (%.1f%%)\n", ratio, ratio * 100.0);
+	if (textSize > 0)
+	{
+		printf("Average Code Length       : %.3f Bits\n", averageCodeLength);
+		printf("Shannon Entropy           : %.3f Bits\n", entropy);
+	}
+	if (columnSize > 0)
+	{
+		// Both per filtered byte, the filter's varints aren't the text's bytes.
+		printf("Integer Column            : %llu Bytes (%.1f%%) filtered to %llu\n", columnSize, (double)columnSize / size * 100.0, columnSymbols);
+		printf("Filtered Code Length      : %.3f Bits\n", columnSymbols > 0 ? columnBits / columnSymbols : 0);
+		printf("Filtered Entropy          : %.3f Bits\n", columnEntropy);
+	}
+	printf("Time Taken                : %.2f Milli-Seconds\n", duration * 1e+03);
+}
+
+
+// How one file's round trip went. error is 0 or the ErrorCode + 1 that
+//    stopped it.
+typedef struct
+{
+	const char* name;
+	uint64 size;
+	uint64 encodedSize;
+	double encodeTime;
+	double decodeTime;
+	bool readable;
+	bool matched;
+	int error;
+} VerifyResult;
+
+typedef struct
+{
+	char** files;
+	VerifyResult* results;
+	uint64 count;
+	volatile uint64 next;
+} VerifyJob;
+
+// Encodes size bytes into memory, with the same flags as -o would, and
+//    decodes them straight back again timing each direction separately.
+//    Errors come back here, like inspectWorker's, and are kept in result
+//    so one file that fails doesn't end the run.
+void verifyRoundTrip(const uint8* data, uint64 size, VerifyResult* result, Workspace* workspace)
+{
+	// Statistics are per thread, every file starts with none.
+	memset(&stats, 0, sizeof(stats));
+	result->size = size;
+
+	ByteStream encoded = { 0 };
+	ByteStream decoded = { 0 };
+	BlockIndex index = { 0 };
+	jmp_buf handler;
+	int error = setjmp(handler);
+	if (error == 0)
+	{
+		errorHandler = &handler;
+		double start = hFTNow();
+		CountMap countMap = { 0 };
+		countBytes(&countMap, data, size);
+		HuffmanCode codeMap[256];
+		createHuffmanCodes(&countMap, codeMap);
+
+		writeStreamHeader(&index, &encoded);
+		encodeBlocks(data, 0, size, codeMap, &index, &encoded, 0, workspace);
+		result->encodeTime = hFTNow() - start;
+		result->encodedSize = encoded.size;
+
+		start = hFTNow();
+		HuffmanCode decodeMap[256] = { 0 };
+		readStreamHeader(&encoded);
+		decodeBlocks(&encoded, decodeMap, &decoded, 0, workspace);
+		result->decodeTime = hFTNow() - start;
+		result->matched = decoded.size == size && (size == 0 || memcmp(decoded.memory, data, size) == 0);
+	}
+	else
+		result->error = error;
+	errorHandler = 0;
+
+	free(index.entries);
+	free(encoded.memory);
+	free(decoded.memory);
+}
+
+// Reads a whole file into memory, returns 0 if it can't be read.
+uint8* readWholeFile(const char* path, uint64* size)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) return 0;
+
+	uint8* data = 0;
+	if (fseek64(f, 0, SEEK_END) == 0)
+	{
+		*size = ftell64(f);
+		data = malloc(*size > 0 ? *size : 1);
+		fatalErrorIf(data == NULL, CALLOC_FAILED);
+		if (fseek64(f, 0, SEEK_SET) != 0 || *size != fread(data, sizeof(uint8), *size, f))
+		{
+			free(data);
+			data = 0;
+		}
+	}
+	fclose(f);
+	return data;
+}
+
+// Each thread takes the next file nobody has started until there are none left.
+void verifyWorker(void* argument)
+{
+	VerifyJob* job = argument;
+	Workspace workspace = { 0 };
+	for (uint64 i = atomicIncrement(&job->next) - 1; i < job->count; i = atomicIncrement(&job->next) - 1)
+	{
+		VerifyResult* result = job->results + i;
+		result->name = job->files[i];
+
+		uint64 size = 0;
+		uint8* data = readWholeFile(job->files[i], &size);
+		result->readable = data != 0;
+		if (data)
+			verifyRoundTrip(data, size, result, &workspace);
+		free(data);
+	}
+	freeWorkspace(&workspace);
+}
+
+double megabytesPerSecond(uint64 bytes, double seconds)
+{
+	return seconds > 0 ? (double)bytes / (1024.0 * 1024.0) / seconds : 0;
+}
+
+// Roughly what one thread's Workspace will grow to with the current block size.
+uint64 getWorkspaceBytes()
+{
+	return (uint64)encodeBlockSize * WORKSPACE_BYTES_PER_BLOCK_BYTE;
+}
+
+// Fits the block size and write buffer into --mem-limit. Blocks get a
+//    sixteenth of it and the write buffer a quarter, threads are worked
+//    out from what's left by whatever starts them.
+void applyMemoryLimit()
+{
+	if (memoryLimit == 0) return;
+
+	uint64 blockSize = memoryLimit / 16;
+	blockSize = blockSize < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : blockSize > BLOCK_SIZE ? BLOCK_SIZE : blockSize;
+	encodeBlockSize = (uint32)blockSize;
+
+	uint64 bufferSize = (memoryLimit / 4) & ~(uint64)(WRITER_ALIGNMENT - 1);
+	if (writeBufferSize > bufferSize)
+	{
+		// Only worth a warning if it was asked for, the default is just lowered.
+		printErrorMessageIf(wFlag, "-w lowered to fit within --mem-limit", SEVERITY_WARNING);
+		writeBufferSize = bufferSize;
+	}
+}
+
+// How many threads that each need perThread bytes fit in --mem-limit,
+//    at most threadCount and never less than 1.
+uint32 fitThreadsInMemoryLimit(uint32 threadCount, uint64 perThread)
+{
+	if (memoryLimit == 0 || perThread == 0) return threadCount;
+	uint64 fit = memoryLimit / perThread;
+	return fit < 1 ? 1 : fit < threadCount ? (uint32)fit : threadCount;
+}
+
+// Round trips the input in memory, or with -f the file, or every file under
+//    the directory, it points to on as many threads as there are processors.
+//    Prints how each file did and returns how many failed.
+uint64 verifyInput()
+{
+	char** files = 0;
+	uint64 count = 0, capacity = 0;
+	VerifyResult stringResult = { .name = "<input>" };
+	VerifyResult* results = &stringResult;
+	uint32 threadCount = 1;
+
+	double start = hFTNow();
+	if (!fFlag)
+	{
+		stringResult.readable = true;
+		Workspace workspace = { 0 };
+		verifyRoundTrip((const uint8*)input, strlen(input), &stringResult, &workspace);
+		freeWorkspace(&workspace);
+		count = 1;
+	}
+	else
+	{
+		if (isDirectory(input))
+			listFiles(input, &files, &count, &capacity);
+		else
+		{
+			FILE* f = fopen(input, "rb");
+			fatalErrorIf(f == NULL, FILE_NON_EXISTENT);
+			fclose(f);
+			files = malloc(sizeof(char*));
+			fatalErrorIf(files == NULL, CALLOC_FAILED);
+			files[0] = malloc(strlen(input) + 1);
+			fatalErrorIf(files[0] == NULL, CALLOC_FAILED);
+			strcpy(files[0], input);
+			count = 1;
+		}
+
+		results = calloc(count > 0 ? count : 1, sizeof(VerifyResult));
+		fatalErrorIf(results == NULL, CALLOC_FAILED);
+		threadCount = getProcessorCount();
+		if (threadCount > count)
+			threadCount = count > 0 ? (uint32)count : 1;
+
+		// Each thread holds a file, what it encoded to and what that decoded
+		//    back to, so the largest file decides how many fit.
+		if (memoryLimit > 0)
+		{
+			uint64 largest = 0;
+			for (uint64 i = 0; i < count; ++i)
+			{
+				FILE* f = fopen(files[i], "rb");
+				if (f == NULL) continue;
+				if (fseek64(f, 0, SEEK_END) == 0 && (uint64)ftell64(f) > largest)
+					largest = ftell64(f);
+				fclose(f);
+			}
+			uint64 perThread = largest * 3 + getWorkspaceBytes();
+			printErrorMessageIf(perThread > memoryLimit, "The largest file needs more than --mem-limit to verify, running on 1 thread", SEVERITY_WARNING);
+			threadCount = fitThreadsInMemoryLimit(threadCount, perThread);
+		}
+
+		printf("Verifying %llu Files on %u Threads...\n", count, threadCount);
+		VerifyJob job = { files, results, count, 0 };
+		runOnThreads(threadCount, verifyWorker, &job);
+	}
+	double wallTime = hFTNow() - start;
+
+	// Results are printed in the order they were listed, not the order
+	//    they finished in, so runs can be compared with diff.
+	uint64 failed = 0, totalSize = 0, totalEncoded = 0;
+	double totalEncodeTime = 0, totalDecodeTime = 0;
+	printf("%-10s %14s %14s %8s %12s %12s  %s\n", "Result", "Size", "Encoded", "Ratio", "Encode MB/s", "Decode MB/s", "Input");
+	for (uint64 i = 0; i < count; ++i)
+	{
+		VerifyResult* r = results + i;
+		if (!r->readable || !r->matched)
+			++failed;
+		if (!r->readable)
+		{
+			printf("%-10s %14s %14s %8s %12s %12s  %s\n", "UNREADABLE", "-", "-", "-", "-", "-", r->name);
+			continue;
+		}
+		if (r->error != 0)
+		{
+			printf("%-10s %14llu %14s %8s %12s %12s  %s: %s\n", "ERROR", r->size, "-", "-", "-", "-", r->name, ErrorMessages[r->error - 1]);
+			continue;
+		}
+
+		totalSize += r->size;
+		totalEncoded += r->encodedSize;
+		totalEncodeTime += r->encodeTime;
+		totalDecodeTime += r->decodeTime;
+		double ratio = r->size > 0 ? (double)r->encodedSize / (double)r->size * 100.0 : 0;
+		printf("%-10s %14llu %14llu %7.1f%% %12.1f %12.1f  %s\n", r->matched ? "OK" : "MISMATCH", r->size, r->encodedSize, ratio,
+			megabytesPerSecond(r->size, r->encodeTime), megabytesPerSecond(r->size, r->decodeTime), r->name);
+	}
+
+	double ratio = totalSize > 0 ? (double)totalEncoded / (double)totalSize * 100.0 : 0;
+	printf("%-10s %14llu %14llu %7.1f%% %12.1f %12.1f  %llu Failed\n", "Total", totalSize, totalEncoded, ratio,
+		megabytesPerSecond(totalSize, totalEncodeTime), megabytesPerSecond(totalSize, totalDecodeTime), failed);
+	printf("\nPer thread throughput is shown above, all %u threads together managed %.1f MB/s\n",
+		threadCount, megabytesPerSecond(totalSize, wallTime));
+
+	for (uint64 i = 0; i < count && files; ++i)
+		free(files[i]);
+	free(files);
+	if (results != &stringResult)
+		free(results);
+	return failed;
+}
+
+// How one block's codes did against the entropy of the symbols it codes, for -i.
+typedef struct
+{
+	uint8 flags;
+	uint32 symbolCount;
+	uint64 blockBits;
+	uint64 dictionaryBits;
+	uint64 codeBits;
+	double entropyBits;
+} BlockEfficiency;
+
+// A file's blocks added together, blocks is only kept when inspecting a
+//    single file. error is 0 or the ErrorCode + 1 that stopped it.
+typedef struct
+{
+	const char* name;
+	uint64 fileBytes;
+	uint64 symbolCount;
+	uint64 blockCount;
+	uint64 dictionaryBits;
+	uint64 codeBits;
+	double entropyBits;
+	BlockEfficiency* blocks;
+	uint64 blockCapacity;
+	int error;
+} InspectResult;
+
+typedef struct
+{
+	char** files;
+	InspectResult* results;
+	uint64 count;
+	bool keepBlocks;
+	volatile uint64 next;
+} InspectJob;
+
+// Reads a stream's blocks, decoding each in memory only to count its
+//    symbols. Integer column blocks are measured by the filtered symbols
+//    their codes are for, which decodeBlockBody leaves in outBuffer, and
+//    restart blocks' padding is overhead rather than code. A solid
+//    archive's member table is all overhead.
+void inspectStream(ByteStream* in, InspectResult* result, bool keepBlocks, Workspace* workspace)
+{
+	memset(&stats, 0, sizeof(stats));
+	readStreamHeader(in);
+	HuffmanCode codeMap[256] = { 0 };
+	BlockDecoder decoder;
+	startBlockDecoder(&decoder, codeMap, workspace);
+
+	for (;;)
+	{
+		uint8 blockHeader[BLOCK_HEADER_SIZE];
+		readOrExit(blockHeader, BLOCK_HEADER_SIZE, in);
+		uint8 flags = blockHeader[0];
+		uint32 symbolCount = readUint32(blockHeader + 1);
+		uint32 bodySize = readUint32(blockHeader + 5);
+		if (flags & BLOCK_FLAG_END) break;
+
+		uint8* body = readBlockBody(in, flags, symbolCount, bodySize, workspace, 0);
+		if (flags & BLOCK_FLAG_MEMBERS) continue;
+
+		BlockEfficiency block = { .flags = flags, .symbolCount = symbolCount, .blockBits = ((uint64)BLOCK_HEADER_SIZE + bodySize + BLOCK_TRAILER_SIZE) * 8 };
+		uint64 dictionaryBits = stats.dictionaryBitLength, bitsCount = decoder.bitsCount;
+		uint64 textSize;
+		decodeBlockBody(&decoder, flags, symbolCount, body, bodySize, workspace, &textSize);
+		block.dictionaryBits = stats.dictionaryBitLength - dictionaryBits;
+
+		uint32 counts[256] = { 0 };
+		const uint8* symbols = workspace->outBuffer;
+		for (uint32 i = 0; i < symbolCount; ++i)
+			++counts[symbols[i]];
+		for (uint16 i = 0; i < 256; ++i)
+		{
+			if (counts[i] == 0) continue;
+			block.entropyBits += counts[i] * log2((double)symbolCount / counts[i]);
+			block.codeBits += (uint64)counts[i] * decoder.codeMap[i].depth;
+		}
+		if (flags & BLOCK_FLAG_FIXED_LENGTH)
+			block.codeBits = decoder.bitsCount - bitsCount;
+
+		result->symbolCount += symbolCount;
+		result->dictionaryBits += block.dictionaryBits;
+		result->codeBits += block.codeBits;
+		result->entropyBits += block.entropyBits;
+		if (keepBlocks)
+		{
+			if (result->blockCount == result->blockCapacity)
+			{
+				result->blockCapacity = result->blockCapacity ? result->blockCapacity * 2 : 64;
+				result->blocks = realloc(result->blocks, result->blockCapacity * sizeof(BlockEfficiency));
+				fatalErrorIf(result->blocks == NULL, CALLOC_FAILED);
+			}
+			result->blocks[result->blockCount] = block;
+		}
+		++result->blockCount;
+	}
+}
+
+// Each thread takes the next file nobody has started until there are none
+//    left. Errors come back here, like the daemon's, so one corrupt file
+//    or one that isn't encoded doesn't end the run.
+void inspectWorker(void* argument)
+{
+	InspectJob* job = argument;
+	Workspace workspace = { 0 };
+	for (uint64 i = atomicIncrement(&job->next) - 1; i < job->count; i = atomicIncrement(&job->next) - 1)
+	{
+		InspectResult* result = job->results + i;
+		result->name = job->files[i];
+		FILE* f = fopen(result->name, "rb");
+		if (f == NULL)
+		{
+			result->error = FILE_NON_EXISTENT + 1;
+			continue;
+		}
+
+		ByteStream in = { .file = f };
+		jmp_buf handler;
+		int error = setjmp(handler);
+		if (error == 0)
+		{
+			errorHandler = &handler;
+			inspectStream(&in, result, job->keepBlocks, &workspace);
+		}
+		else
+			result->error = error;
+		errorHandler = 0;
+
+		if (fseek64(f, 0, SEEK_END) == 0)
+			result->fileBytes = ftell64(f);
+		fclose(f);
+	}
+	freeWorkspace(&workspace);
+}
+
+// What kind of block it was, for -i's table.
+void describeBlock(uint8 flags, char* description)
+{
+	strcpy(description, flags & BLOCK_FLAG_FIXED_LENGTH ? "Fixed" : flags & BLOCK_FLAG_DICTIONARY ? "Dictionary" :
+		flags & BLOCK_FLAG_COMPACT_DICTIONARY ? "Compact" : "Reused");
+	if (flags & BLOCK_FLAG_INTEGER_COLUMN)
+		strcat(description, "+Int");
+	if (flags & BLOCK_FLAG_RESTARTS)
+		strcat(description, "+Rst");
+}
+
+double bitsPerSymbol(double bits, uint64 symbolCount)
+{
+	return symbolCount > 0 ? bits / symbolCount : 0;
+}
+
+// Audits how efficient encoded files are without writing anything out.
+//    Average code length against entropy is how good the codes were,
+//    everything else in the file, dictionaries, headers, indexes and
+//    padding, is overhead. Wasted is every bit over the entropy of the
+//    symbols. The entropy is each block's own so it's what a perfect
+//    order 0 coder could do with the same blocks. Prints every block of a
+//    single file or every encoded file under a directory, on as many
+//    threads as there are processors, and returns how many were corrupt.
+uint64 inspectInput()
+{
+	char** files = 0;
+	uint64 count = 0, capacity = 0;
+	bool directory = isDirectory(input);
+	if (directory)
+		listFiles(input, &files, &count, &capacity);
+	else
+	{
+		files = malloc(sizeof(char*));
+		fatalErrorIf(files == NULL, CALLOC_FAILED);
+		files[0] = malloc(strlen(input) + 1);
+		fatalErrorIf(files[0] == NULL, CALLOC_FAILED);
+		strcpy(files[0], input);
+		count = 1;
+	}
+
+	InspectResult* results = calloc(count > 0 ? count : 1, sizeof(InspectResult));
+	fatalErrorIf(results == NULL, CALLOC_FAILED);
+	uint32 threadCount = getProcessorCount();
+	if (threadCount > count)
+		threadCount = count > 0 ? (uint32)count : 1;
+	threadCount = fitThreadsInMemoryLimit(threadCount, getWorkspaceBytes());
+
+	double start = hFTNow();
+	InspectJob job = { files, results, count, !directory, 0 };
+	runOnThreads(threadCount, inspectWorker, &job);
+	double duration = hFTNow() - start;
+
+	if (!directory)
+	{
+		InspectResult* r = results;
+		if (r->error != 0)
+			fatalErrorIf(true, (ErrorCode)(r->error - 1));
+		printf("%8s %-16s %12s %12s %9s %9s %12s %12s %12s\n", "Block", "Type", "Symbols", "Size", "Avg Code", "Entropy", "Dictionary", "Overhead", "Wasted");
+		for (uint64 i = 0; i < r->blockCount; ++i)
+		{
+			BlockEfficiency* b = r->blocks + i;
+			char description[24];
+			describeBlock(b->flags, description);
+			printf("%8llu %-16s %12u %12llu %9.4f %9.4f %12llu %12llu %12.0f\n", i, description, b->symbolCount, b->blockBits / 8,
+				bitsPerSymbol((double)b->codeBits, b->symbolCount), bitsPerSymbol(b->entropyBits, b->symbolCount),
+				(b->dictionaryBits + 7) / 8, (b->blockBits - b->codeBits) / 8, (b->blockBits - b->entropyBits) / 8);
+		}
+		printf("\n");
+	}
+
+	// Files that aren't encoded at all are only counted, directories of
+	//    archives tend to have other things in them too.
+	uint64 corrupt = 0, skipped = 0, totalBytes = 0, totalSymbols = 0, totalCodeBits = 0, totalDictionaryBits = 0;
+	double totalEntropyBits = 0;
+	printf("%-10s %14s %8s %9s %9s %12s %12s %12s %10s  %s\n", "Result", "Size", "Blocks", "Avg Code", "Entropy", "Dictionary", "Overhead", "Wasted", "Efficiency", "File");
+	for (uint64 i = 0; i < count; ++i)
+	{
+		InspectResult* r = results + i;
+		if (r->error == UNKNOWN_FORMAT + 1)
+		{
+			++skipped;
+			continue;
+		}
+		if (r->error != 0)
+		{
+			++corrupt;
+			printf("%-10s %14llu %8s %9s %9s %12s %12s %12s %10s  %s\n", r->error == FILE_NON_EXISTENT + 1 ? "UNREADABLE" : "CORRUPT", r->fileBytes,
+				"-", "-", "-", "-", "-", "-", "-", r->name);
+			continue;
+		}
+
+		totalBytes += r->fileBytes;
+		totalSymbols += r->symbolCount;
+		totalCodeBits += r->codeBits;
+		totalDictionaryBits += r->dictionaryBits;
+		totalEntropyBits += r->entropyBits;
+		printf("%-10s %14llu %8llu %9.4f %9.4f %12llu %12llu %12.0f %9.2f%%  %s\n", "OK", r->fileBytes, r->blockCount,
+			bitsPerSymbol((double)r->codeBits, r->symbolCount), bitsPerSymbol(r->entropyBits, r->symbolCount), (r->dictionaryBits + 7) / 8,
+			r->fileBytes - r->codeBits / 8, r->fileBytes - r->entropyBits / 8, r->fileBytes > 0 ? r->entropyBits / (r->fileBytes * 8.0) * 100.0 : 0, r->name);
+	}
+	printf("%-10s %14llu %8s %9.4f %9.4f %12llu %12llu %12.0f %9.2f%%  %llu Corrupt, %llu Skipped\n", "Total", totalBytes, "",
+		bitsPerSymbol((double)totalCodeBits, totalSymbols), bitsPerSymbol(totalEntropyBits, totalSymbols), (totalDictionaryBits + 7) / 8,
+		totalBytes - totalCodeBits / 8, totalBytes - totalEntropyBits / 8, totalBytes > 0 ? totalEntropyBits / (totalBytes * 8.0) * 100.0 : 0, corrupt, skipped);
+	printf("\nInspected %llu Files on %u Threads in %.2f Milli-Seconds\n", count - skipped, threadCount, duration * 1e+03);
+
+	for (uint64 i = 0; i < count; ++i)
+	{
+		free(results[i].blocks);
+		free(files[i]);
+	}
+	free(files);
+	free(results);
+	return corrupt;
+}
+
+// A member of a solid archive (-m). When encoding path is the file and name
+//    points into it, when extracting path is the name read from the member
+//    table and name is the same string. offset is where the member starts
+//    in the decoded stream.
+typedef struct
+{
+	char* path;
+	const char* name;
+	const char* extension;
+	uint64 size;
+	uint64 offset;
+	uint32 checksum;
+	uint64 dictionaryBlock;
+} ArchiveMember;
+
+// Members are grouped by extension, which is what shares a dictionary, and
+//    in order of name within a group, which keeps the names' shared
+//    prefixes long.
+int compareMembers(const void* a, const void* b)
+{
+	const ArchiveMember* left = a;
+	const ArchiveMember* right = b;
+	int order = strcmp(left->extension, right->extension);
+	return order != 0 ? order : strcmp(left->name, right->name);
+}
+
+const char* getExtension(const char* name)
+{
+	const char* dot = strrchr(name, '.');
+	const char* slash = strrchr(name, '/');
+	return dot && (!slash || dot > slash) ? dot : "";
+}
+
+// The state of a group's blocks as its members are packed into them.
+typedef struct
+{
+	uint8* staging;
+	uint64 staged;
+	HuffmanCode* codeMap;
+	bool shared;
+	uint64 dictionaryBlock;
+} ArchivePacker;
+
+// Encodes whatever has been staged as the group's next block.
+void flushArchiveBlock(ArchivePacker* packer, BlockIndex* index, ByteStream* out, Workspace* workspace)
+{
+	if (packer->staged == 0) return;
+	packer->shared = encodeBlockRun(packer->staging, 0, packer->staged, packer->codeMap, !packer->shared, &packer->dictionaryBlock, index, out, 0, workspace);
+	packer->staged = 0;
+}
+
+// Counts the member's bytes into countMap and checksums them, size bytes
+//    of buffer at a time.
+void countArchiveMember(ArchiveMember* member, CountMap* countMap, uint8* buffer, uint64 size)
+{
+	FILE* f = fopen(member->path, "rb");
+	fatalErrorIf(f == NULL, FILE_NON_EXISTENT);
+	member->size = 0;
+	member->checksum = 0;
+	for (uint64 n; (n = fread(buffer, sizeof(uint8), size, f)) > 0;)
+	{
+		countBytes(countMap, buffer, n);
+		member->checksum = crc32c(member->checksum, buffer, n);
+		member->size += n;
+	}
+	fatalErrorIf(ferror(f), FILE_NON_EXISTENT);
+	fclose(f);
+}
+
+// Compresses every file under the directory input, or just the file, into
+//    a solid archive at output, see BLOCK_FLAG_MEMBERS. Each group is read
+//    twice, once to count it and once to encode it, and both times a block
+//    at a time so the memory used doesn't depend on how big the files are.
+void encodeArchive()
+{
+	char** files = 0;
+	uint64 count = 0, capacity = 0;
+	size_t baseLength = 0;
+	if (isDirectory(input))
+	{
+		listFiles(input, &files, &count, &capacity);
+		baseLength = strlen(input);
+	}
+	else
+	{
+		FILE* f = fopen(input, "rb");
+		fatalErrorIf(f == NULL, FILE_NON_EXISTENT);
+		fclose(f);
+		files = malloc(sizeof(char*));
+		fatalErrorIf(files == NULL, CALLOC_FAILED);
+		files[0] = malloc(strlen(input) + 1);
+		fatalErrorIf(files[0] == NULL, CALLOC_FAILED);
+		strcpy(files[0], input);
+		count = 1;
+		const char* slash = strrchr(input, '/');
+		baseLength = slash ? slash - input : 0;
+	}
+
+	ArchiveMember* members = calloc(count > 0 ? count : 1, sizeof(ArchiveMember));
+	fatalErrorIf(members == NULL, CALLOC_FAILED);
+	for (uint64 i = 0; i < count; ++i)
+	{
+		members[i].path = files[i];
+		members[i].name = files[i] + baseLength;
+		while (*members[i].name == '/')
+			++members[i].name;
+		members[i].extension = getExtension(members[i].name);
+	}
+	qsort(members, count, sizeof(ArchiveMember), compareMembers);
+
+	FileWriter writer;
+	ByteStream out = { 0 };
+	ByteStream* pOut = 0;
+	if (!nFlag)
+	{
+		fatalErrorIf(!openFileWriter(&writer, output, 0, writeBufferSize, xFlag, 0), WRITE_FILE_OPEN_FAILED);
+		out.writer = &writer;
+		pOut = &out;
+	}
+
+	BlockIndex index = { 0 };
+	writeStreamHeader(&index, pOut);
+	Workspace workspace = { 0 };
+	HuffmanCode codeMap[256];
+	ArchivePacker packer = { 0 };
+	packer.staging = malloc(ARCHIVE_BLOCK_SIZE);
+	fatalErrorIf(packer.staging == NULL, CALLOC_FAILED);
+	packer.codeMap = codeMap;
+	uint64 groups = 0;
+	for (uint64 first = 0, last = 0; first < count; first = last)
+	{
+		for (last = first; last < count && strcmp(members[last].extension, members[first].extension) == 0; ++last);
+
+		// The staging block is empty between groups so it doubles as the
+		//    buffer the group is counted through.
+		CountMap countMap = { 0 };
+		for (uint64 i = first; i < last; ++i)
+			countArchiveMember(members + i, &countMap, packer.staging, ARCHIVE_BLOCK_SIZE);
+		createHuffmanCodes(&countMap, codeMap);
+
+		// Small members are packed one after another into blocks of
+		//    ARCHIVE_BLOCK_SIZE, larger ones get encodeBlockSize blocks of
+		//    their own like any other stream. The first block to need the group's
+		//    dictionary writes it and the rest start from it until
+		//    something replaces it.
+		packer.shared = false;
+		for (uint64 i = first; i < last; ++i)
+		{
+			ArchiveMember* member = members + i;
+			uint64 size = member->size;
+			FILE* f = fopen(member->path, "rb");
+			fatalErrorIf(f == NULL, FILE_NON_EXISTENT);
+
+			if (size >= ARCHIVE_BLOCK_SIZE)
+				flushArchiveBlock(&packer, &index, pOut, &workspace);
+			member->offset = index.totalSymbols + packer.staged;
+			member->dictionaryBlock = ARCHIVE_NO_DICTIONARY;
+			if (size >= ARCHIVE_BLOCK_SIZE)
+			{
+				if (packer.shared)
+					member->dictionaryBlock = packer.dictionaryBlock;
+				packer.shared = encodeBlockRun(0, f, size, codeMap, !packer.shared, &packer.dictionaryBlock, &index, pOut, 0, &workspace);
+			}
+			for (uint64 done = size >= ARCHIVE_BLOCK_SIZE ? size : 0; done < size;)
+			{
+				if (packer.staged == ARCHIVE_BLOCK_SIZE)
+					flushArchiveBlock(&packer, &index, pOut, &workspace);
+				// The dictionary the block the member starts in starts with.
+				if (done == 0 && packer.shared)
+					member->dictionaryBlock = packer.dictionaryBlock;
+
+				uint64 n = size - done < ARCHIVE_BLOCK_SIZE - packer.staged ? size - done : ARCHIVE_BLOCK_SIZE - packer.staged;
+				fatalErrorIf(n != fread(packer.staging + packer.staged, sizeof(uint8), n, f), UNEXPECTED_ERROR);
+				packer.staged += n;
+				done += n;
+			}
+			fclose(f);
+		}
+		// The next group has a different dictionary so it can't share a block.
+		flushArchiveBlock(&packer, &index, pOut, &workspace);
+		++groups;
+	}
+	free(packer.staging);
+
+	// The member table goes in a block of its own, built in memory with
+	//    room left for the block header and trailer.
+	ByteStream table = { 0 };
+	uint8 entry[4 * 10 + 4] = { 0 };
+	writeOrExit(entry, BLOCK_HEADER_SIZE, &table);
+	writeOrExit(entry, writeVarint(entry, count) - entry, &table);
+	const char* previousName = "";
+	for (uint64 i = 0; i < count; ++i)
+	{
+		ArchiveMember* member = members + i;
+		size_t prefix = 0;
+		while (member->name[prefix] != '\0' && member->name[prefix] == previousName[prefix])
+			++prefix;
+		size_t suffix = strlen(member->name + prefix);
+
+		uint8* p = writeVarint(entry, member->size);
+		writeUint32(p, member->checksum);
+		p = writeVarint(p + 4, member->dictionaryBlock == ARCHIVE_NO_DICTIONARY ? 0 : member->dictionaryBlock + 1);
+		p = writeVarint(p, prefix);
+		p = writeVarint(p, suffix);
+		writeOrExit(entry, p - entry, &table);
+		writeOrExit(member->name + prefix, suffix, &table);
+		previousName = member->name;
+	}
+	writeOrExit(entry, BLOCK_TRAILER_SIZE, &table);
+
+	uint32 bodySize = (uint32)(table.size - BLOCK_HEADER_SIZE - BLOCK_TRAILER_SIZE);
+	uint64 blockSize = finishBlock(table.memory, BLOCK_FLAG_MEMBERS, 0, bodySize);
+	stats.containerBytes += bodySize;
+	stats.fileBytes += blockSize;
+	addBlockToIndex(&index, index.endOffset, index.totalSymbols);
+	index.endOffset += blockSize;
+	writeOrExit(table.memory, blockSize, pOut);
+	finishStream(&index, pOut, index.totalSymbols);
+	free(table.memory);
+
+	if (out.writer)
+		fatalErrorIf(!closeFileWriter(out.writer), FILE_WRITE_FAILED);
+
+	double ratio = index.totalSymbols > 0 ? (double)stats.fileBytes / (double)index.totalSymbols * 100.0 : 0;
+	printf("Archived %llu Files in %llu Groups, %llu Bytes -> %llu Bytes (%.1f%%)\n", count, groups, index.totalSymbols, stats.fileBytes, ratio);
+
+	freeWorkspace(&workspace);
+	free(index.entries);
+	for (uint64 i = 0; i < count; ++i)
+		free(files[i]);
+	free(files);
+	free(members);
+}
+
+// Reads the member table from the end of the archive in file, loading its
+//    index into index. Returns the members, *count of them.
+ArchiveMember* readMemberTable(FILE* file, BlockIndex* index, uint64* count, Workspace* workspace)
+{
+	readStreamEnd(index, file);
+	fatalErrorIf(index->count == 0, NOT_AN_ARCHIVE);
+
+	ByteStream in = { .file = file };
+	uint8 header[BLOCK_HEADER_SIZE];
+	BlockIndexEntry* tableEntry = index->entries + index->count - 1;
+	fatalErrorIf(fseek64(file, tableEntry->offset, SEEK_SET) != 0, CORRUPT_ENCODED_FILE);
+	readOrExit(header, BLOCK_HEADER_SIZE, &in);
+	fatalErrorIf(!(header[0] & BLOCK_FLAG_MEMBERS), NOT_AN_ARCHIVE);
+	uint32 bodySize = readUint32(header + 5);
+	const uint8* p = readBlockBody(&in, header[0], readUint32(header + 1), bodySize, workspace, 0);
+	const uint8* end = p + bodySize;
+
+	// Every member takes at least 8 bytes.
+	p = readVarint(p, end, count);
+	fatalErrorIf(p == 0 || *count > bodySize / 8, CORRUPT_ENCODED_FILE);
+	ArchiveMember* members = calloc(*count > 0 ? *count : 1, sizeof(ArchiveMember));
+	fatalErrorIf(members == NULL, CALLOC_FAILED);
+
+	// Members are one after another in the stream, the table's block
+	//    comes after all of them.
+	uint64 offset = 0;
+	const char* previousName = "";
+	size_t previousLength = 0;
+	for (uint64 i = 0; i < *count; ++i)
+	{
+		ArchiveMember* member = members + i;
+		uint64 dictionaryBlock, prefix, suffix;
+		p = p ? readVarint(p, end, &member->size) : 0;
+		fatalErrorIf(p == 0 || end - p < 4, CORRUPT_ENCODED_FILE);
+		member->checksum = readUint32(p);
+		p = readVarint(p + 4, end, &dictionaryBlock);
+		p = p ? readVarint(p, end, &prefix) : 0;
+		p = p ? readVarint(p, end, &suffix) : 0;
+		fatalErrorIf(p == 0 || prefix > previousLength || suffix > (uint64)(end - p), CORRUPT_ENCODED_FILE);
+
+		member->path = malloc(prefix + suffix + 1);
+		fatalErrorIf(member->path == NULL, CALLOC_FAILED);
+		memcpy(member->path, previousName, prefix);
+		memcpy(member->path + prefix, p, suffix);
+		member->path[prefix + suffix] = '\0';
+		member->name = member->path;
+		previousName = member->path;
+		previousLength = prefix + suffix;
+		p += suffix;
+
+		member->offset = offset;
+		fatalErrorIf(member->size > tableEntry->firstSymbol - offset, CORRUPT_ENCODED_FILE);
+		offset += member->size;
+		member->dictionaryBlock = dictionaryBlock == 0 ? ARCHIVE_NO_DICTIONARY : dictionaryBlock - 1;
+		fatalErrorIf(dictionaryBlock > index->count - 1, CORRUPT_ENCODED_FILE);
+	}
+	return members;
+}
+
+// Names are relative paths using /, anything that could end up outside
+//    the directory we extract to is refused.
+bool isSafeMemberName(const char* name)
+{
+	if (name[0] == '\0' || name[0] == '/' || strchr(name, '\\') || strchr(name, ':'))
+		return false;
+	for (const char* part = name; part; part = strchr(part, '/'))
+	{
+		if (*part == '/') ++part;
+		if (strncmp(part, "..", 2) == 0 && (part[2] == '/' || part[2] == '\0'))
+			return false;
+	}
+	return true;
+}
+
+// Decodes one member of the archive in file to out. Only its dictionary
+//    block, if it has one, and the blocks it is packed in are read, the
+//    parts of them belonging to other members are dropped.
+void extractMember(FILE* file, BlockIndex* index, ArchiveMember* member, BlockDecoder* decoder, ByteStream* out, Workspace* workspace)
+{
+	if (member->size == 0) return;
+
+	// The last block that starts at or before the member, the table's
+	//    block is never one of them.
+	uint64 low = 0, high = index->count - 1;
+	while (high - low > 1)
+	{
+		uint64 middle = low + (high - low) / 2;
+		if (index->entries[middle].firstSymbol <= member->offset)
+			low = middle;
+		else
+			high = middle;
+	}
+	fatalErrorIf(member->dictionaryBlock != ARCHIVE_NO_DICTIONARY && member->dictionaryBlock > low, CORRUPT_ENCODED_FILE);
+
+	ByteStream in = { .file = file };
+	uint8 header[BLOCK_HEADER_SIZE];
+	decoder->dictionaryFound = false;
+	decoder->tableStale = true;
+	if (member->dictionaryBlock != ARCHIVE_NO_DICTIONARY && member->dictionaryBlock < low)
+	{
+		fatalErrorIf(fseek64(file, index->entries[member->dictionaryBlock].offset, SEEK_SET) != 0, CORRUPT_ENCODED_FILE);
+		readOrExit(header, BLOCK_HEADER_SIZE, &in);
+		uint8 flags = header[0];
+		uint32 bodySize = readUint32(header + 5);
+		fatalErrorIf(!(flags & (BLOCK_FLAG_DICTIONARY | BLOCK_FLAG_COMPACT_DICTIONARY)) || (flags & (BLOCK_FLAG_INTEGER_COLUMN | BLOCK_FLAG_END | BLOCK_FLAG_MEMBERS)), CORRUPT_ENCODED_FILE);
+		uint8* body = readBlockBody(&in, flags, readUint32(header + 1), bodySize, workspace, 0);
+		uint8* pIn;
+		uint8 bufferBit;
+		readBlockDictionary(decoder, flags, body, bodySize, &pIn, &bufferBit);
+	}
+
+	// The blocks are one after another from there.
+	fatalErrorIf(fseek64(file, index->entries[low].offset, SEEK_SET) != 0, CORRUPT_ENCODED_FILE);
+	uint64 position = index->entries[low].firstSymbol;
+	uint64 end = member->offset + member->size;
+	uint32 checksum = 0;
+	while (position < end)
+	{
+		readOrExit(header, BLOCK_HEADER_SIZE, &in);
+		uint8 flags = header[0];
+		uint32 symbolCount = readUint32(header + 1);
+		uint32 bodySize = readUint32(header + 5);
+		fatalErrorIf(flags & (BLOCK_FLAG_END | BLOCK_FLAG_MEMBERS), CORRUPT_ENCODED_FILE);
+
+		uint8* body = readBlockBody(&in, flags, symbolCount, bodySize, workspace, 0);
+		uint64 textSize;
+		uint8* text = decodeBlockBody(decoder, flags, symbolCount, body, bodySize, workspace, &textSize);
+
+		uint64 from = member->offset > position ? member->offset - position : 0;
+		uint64 to = end - position < textSize ? end - position : textSize;
+		fatalErrorIf(from > to, CORRUPT_ENCODED_FILE);
+		checksum = crc32c(checksum, text + from, to - from);
+		writeOrExit(text + from, to - from, out);
+		position += textSize;
+	}
+
+	fatalErrorIf(checksum != member->checksum, STREAM_CHECKSUM_MISMATCH);
+}
+
+// With -m -r lists the members of the archive input or, with -o, extracts
+//    every one of them into that directory. With -e only that member is
+//    extracted, to -o or the console. -n checks them without writing.
+void extractArchive()
+{
+	FILE* file = fopen(input, "rb");
+	fatalErrorIf(file == NULL, FILE_NON_EXISTENT);
+
+	BlockIndex index = { 0 };
+	Workspace workspace = { 0 };
+	uint64 count;
+	ArchiveMember* members = readMemberTable(file, &index, &count, &workspace);
+
+	if (!oFlag && !nFlag && memberName == 0)
+	{
+		uint64 total = 0;
+		printf("%14s  %s\n", "Size", "Member");
+		for (uint64 i = 0; i < count; ++i)
+		{
+			printf("%14llu  %s\n", members[i].size, members[i].name);
+			total += members[i].size;
+		}
+		printf("%14llu  %llu Members in %llu Blocks\n", total, count, index.count - 1);
+	}
+	else
+	{
+		HuffmanCode codeMap[256];
+		BlockDecoder decoder;
+		startBlockDecoder(&decoder, codeMap, &workspace);
+
+		uint64 extracted = 0;
+		for (uint64 i = 0; i < count; ++i)
+		{
+			ArchiveMember* member = members + i;
+			if (memberName && strcmp(member->name, memberName) != 0) continue;
+
+			FileWriter writer;
+			ByteStream out = { 0 };
+			ByteStream* pOut = &out;
+			if (nFlag)
+				pOut = 0;
+			else if (memberName == 0)
+			{
+				fatalErrorIf(!isSafeMemberName(member->name), INVALID_MEMBER_NAME);
+				size_t length = strlen(output) + strlen(member->name) + 2;
+				char* path = malloc(length);
+				fatalErrorIf(path == NULL, CALLOC_FAILED);
+				snprintf(path, length, "%s/%s", output, member->name);
+				fatalErrorIf(!createParentDirectories(path), WRITE_FILE_OPEN_FAILED);
+				fatalErrorIf(!openFileWriter(&writer, path, 0, writeBufferSize, xFlag, member->size), WRITE_FILE_OPEN_FAILED);
+				out.writer = &writer;
+				free(path);
+			}
+			else if (oFlag)
+			{
+				fatalErrorIf(!openFileWriter(&writer, output, 0, writeBufferSize, xFlag, member->size), WRITE_FILE_OPEN_FAILED);
+				out.writer = &writer;
+			}
+			else
+				out.console = true;
+
+			extractMember(file, &index, member, &decoder, pOut, &workspace);
+			if (out.writer)
+				fatalErrorIf(!closeFileWriter(out.writer), FILE_WRITE_FAILED);
+			++extracted;
+		}
+		fatalErrorIf(memberName && extracted == 0, MEMBER_NOT_FOUND);
+		if (oFlag || nFlag)
+			printf("%s %llu Members\n", nFlag ? "Checked" : "Extracted", extracted);
+	}
+
+	fclose(file);
+	freeWorkspace(&workspace);
+	free(index.entries);
+	for (uint64 i = 0; i < count; ++i)
+		free(members[i].path);
+	free(members);
+}
+
+// Requests to the daemon (-u) and its responses are a header and a payload,
+//    little endian like the container:
+//
+//    Request  : "HUFQ", operation (1), flags (1), 2 reserved bytes,
+//               payload size (8), payload
+//    Response : "HUFR", status (1), 3 reserved bytes, payload size (8),
+//               payload
+//
+//    The operation is DAEMON_COMPRESS or DAEMON_DECOMPRESS and the payload
+//    the data to compress or decompress, which is answered with the result.
+//    With DAEMON_FLAG_DESCRIPTORS the request header comes with two file
+//    descriptors (SCM_RIGHTS), the input and the output, so nothing is
+//    copied through the socket. The request has no payload, the input is
+//    read to its end and the response's payload size is the number of
+//    bytes written to the output, which is never sent. The status is 0 on
+//    success or the ErrorCode + 1 the request failed with. A connection can
+//    carry any number of requests one after another.
+#define DAEMON_REQUEST_MAGIC "HUFQ"
+#define DAEMON_RESPONSE_MAGIC "HUFR"
+#define DAEMON_HEADER_SIZE 16
+#define DAEMON_COMPRESS 1
+#define DAEMON_DECOMPRESS 2
+#define DAEMON_FLAG_DESCRIPTORS 0x01
+// Anything bigger should be passed as a descriptor.
+#define DAEMON_MAX_PAYLOAD ((uint64)1 << 30)
+// With --mem-limit workers are dropped until each has at least this much.
+#define DAEMON_MIN_WORKER_MEMORY ((uint64)8 << 20)
+#define DAEMON_WRITER_BUFFER_SIZE (1 << 20)
+
+typedef struct
+{
+	int listener;
+	// Built from -f <file> at start up, used for every request it has a
+	//    code for every byte of so they skip building a tree.
+	HuffmanCode trainedCodeMap[256];
+	bool trained;
+	// The most a request can send, or read from a pipe, which with
+	//    --mem-limit is what a worker's share leaves once its workspace and
+	//    write buffer are out of it. A payload is held alongside its output.
+	uint64 maxPayload;
+} Daemon;
+
+// Everything a request holds onto. A worker keeps one for as long as it
+//    runs so the buffers stay warm and, if a request fails part way, what it
+//    had open can still be closed.
+typedef struct
+{
+	Workspace workspace;
+	BlockIndex index;
+	uint8* payload;
+	uint64 payloadCapacity;
+	ByteStream memoryOut;
+	FileWriter writer;
+	bool writerOpen;
+	// Once the writer has been closed so has the output descriptor.
+	bool outputClosed;
+	const uint8* mapped;
+	uint64 mappedSize;
+	int descriptors[2];
+	uint8 descriptorCount;
+	bool payloadReceived;
+	uint64 outputSize;
+} DaemonRequest;
+
+// Uses the trained dictionary if it has a code for every byte in data,
+//    otherwise builds one from data the same way main does.
+void createDaemonCodeMap(Daemon* daemon, const uint8* data, uint64 size, HuffmanCode* codeMap)
+{
+	CountMap countMap = { 0 };
+	countBytes(&countMap, data, size);
+
+	bool covered = daemon->trained;
+	for (uint16 i = 0; covered && i < 256; ++i)
+		covered = countMap.map[i] == 0 || daemon->trainedCodeMap[i].depth > 0;
+	if (covered)
+	{
+		memcpy(codeMap, daemon->trainedCodeMap, sizeof(HuffmanCode) * 256);
+		return;
+	}
+
+	createHuffmanCodes(&countMap, codeMap);
+}
+
+// Reads the input and runs the request, any error longjmps out of here.
+void runDaemonRequest(Daemon* daemon, DaemonRequest* request, int connection, uint8 operation, uint8 flags, uint64 payloadSize)
+{
+	const uint8* data;
+	uint64 size = 0;
+	ByteStream* out = &request->memoryOut;
+	ByteStream descriptorOut = { 0 };
+
+	if (flags & DAEMON_FLAG_DESCRIPTORS)
+	{
+		// Files are mapped rather than read, pipes have to be read.
+		data = request->mapped = mapDescriptor(request->descriptors[0], &size);
+		request->mappedSize = size;
+		if (data == 0)
+		{
+			fatalErrorIf(!readDescriptor(request->descriptors[0], &request->payload, &request->payloadCapacity, &size, daemon->maxPayload), FILE_NON_EXISTENT);
+			data = request->payload;
+		}
+		request->payloadReceived = true;
+
+		request->writerOpen = attachFileWriter(&request->writer, request->descriptors[1], DAEMON_WRITER_BUFFER_SIZE);
+		fatalErrorIf(!request->writerOpen, CALLOC_FAILED);
+		descriptorOut.writer = &request->writer;
+		out = &descriptorOut;
+	}
+	else
+	{
+		data = reserveBuffer(&request->payload, &request->payloadCapacity, payloadSize);
+		fatalErrorIf(!receiveAll(connection, request->payload, payloadSize, 0, 0, 0), INVALID_DAEMON_REQUEST);
+		request->payloadReceived = true;
+		size = payloadSize;
+	}
+
+	// Statistics are per thread and every request starts with none.
+	memset(&stats, 0, sizeof(stats));
+	request->memoryOut.size = 0;
+	if (operation == DAEMON_COMPRESS)
+	{
+		HuffmanCode codeMap[256];
+		createDaemonCodeMap(daemon, data, size, codeMap);
+		request->index.count = 0;
+		request->index.totalSymbols = 0;
+		request->index.streamChecksum = 0;
+		writeStreamHeader(&request->index, out);
+		encodeBlocks(data, 0, size, codeMap, &request->index, out, 0, &request->workspace);
+	}
+	else
+	{
+		ByteStream in = { 0 };
+		in.memory = (uint8*)data;
+		in.size = size;
+		HuffmanCode codeMap[256] = { 0 };
+		readStreamHeader(&in);
+		decodeBlocks(&in, codeMap, out, 0, &request->workspace);
+		fatalErrorIf(in.position != in.size, CORRUPT_ENCODED_FILE);
+	}
+
+	if (request->writerOpen)
+	{
+		request->writerOpen = false;
+		request->outputClosed = true;
+		fatalErrorIf(!closeFileWriter(&request->writer), FILE_WRITE_FAILED);
+		request->outputSize = request->writer.position;
+	}
+	else
+		request->outputSize = request->memoryOut.size;
+}
+
+// Reads, runs and answers one request. Returns false when the connection
+//    should be closed, because the client hung up or sent something we
+//    can't find the end of.
+bool handleDaemonRequest(Daemon* daemon, int connection, DaemonRequest* request)
+{
+	uint8 header[DAEMON_HEADER_SIZE];
+	request->descriptorCount = 0;
+	request->payloadReceived = false;
+	request->outputClosed = false;
+	request->mapped = 0;
+	if (!receiveAll(connection, header, DAEMON_HEADER_SIZE, request->descriptors, 2, &request->descriptorCount))
+	{
+		for (uint8 i = 0; i < request->descriptorCount; ++i)
+			closeDescriptor(request->descriptors[i]);
+		return false;
+	}
+
+	uint8 operation = header[4];
+	uint8 flags = header[5];
+	uint64 payloadSize = readUint64(header + 8);
+	bool descriptors = (flags & DAEMON_FLAG_DESCRIPTORS) != 0;
+	bool valid = memcmp(header, DAEMON_REQUEST_MAGIC, 4) == 0 &&
+		(operation == DAEMON_COMPRESS || operation == DAEMON_DECOMPRESS) &&
+		(descriptors ? request->descriptorCount == 2 && payloadSize == 0 : request->descriptorCount == 0 && payloadSize <= daemon->maxPayload);
+
+	uint8 status = INVALID_DAEMON_REQUEST + 1;
+	if (valid)
+	{
+		// Errors come back here rather than exiting.
+		jmp_buf handler;
+		int error = setjmp(handler);
+		if (error == 0)
+		{
+			errorHandler = &handler;
+			runDaemonRequest(daemon, request, connection, operation, flags, payloadSize);
+			status = 0;
+		}
+		else
+			status = (uint8)error;
+		errorHandler = 0;
+	}
+
+	if (request->mapped)
+		unmapMemory(request->mapped, request->mappedSize);
+	if (request->writerOpen)
+	{
+		closeFileWriter(&request->writer);
+		request->writerOpen = false;
+		request->outputClosed = true;
+	}
+	if (request->descriptorCount > 0)
+		closeDescriptor(request->descriptors[0]);
+	if (request->descriptorCount == 2 && !request->outputClosed)
+		closeDescriptor(request->descriptors[1]);
+
+	uint64 outputSize = status == 0 ? request->outputSize : 0;
+	uint8 response[DAEMON_HEADER_SIZE] = { 0 };
+	memcpy(response, DAEMON_RESPONSE_MAGIC, 4);
+	response[4] = status;
+	writeUint64(response + 8, outputSize);
+	if (!sendAll(connection, response, DAEMON_HEADER_SIZE))
+		return false;
+	if (status == 0 && !descriptors && !sendAll(connection, request->memoryOut.memory, outputSize))
+		return false;
+
+	// If we never read the whole payload we don't know where the next request starts.
+	return valid && (request->payloadReceived || descriptors);
+}
+
+// Each worker waits for its own connections, the kernel hands each new one
+//    to one of the workers blocked in accept.
+void daemonWorker(void* argument)
+{
+	Daemon* daemon = argument;
+	DaemonRequest request = { 0 };
+	for (;;)
+	{
+		int connection = acceptConnection(daemon->listener);
+		if (connection < 0) continue;
+
+		while (handleDaemonRequest(daemon, connection, &request));
+		closeDescriptor(connection);
+	}
+}
+
+// Serves requests on the socket given to -u until the process is killed.
+//    With -f the file is used to train a dictionary up front.
+int runDaemon()
+{
+	Daemon daemon = { 0 };
+	if (fFlag)
+	{
+		CountMap countMap = createCountMap(input);
+		createHuffmanCodes(&countMap, daemon.trainedCodeMap);
+		daemon.trained = countMap.uniqueCount > 0;
+	}
+
+	daemon.listener = listenOnSocket(socketPath);
+	fatalErrorIf(daemon.listener < 0, SOCKET_LISTEN_FAILED);
+
+	uint32 threadCount = fitThreadsInMemoryLimit(getProcessorCount(), DAEMON_MIN_WORKER_MEMORY);
+	daemon.maxPayload = DAEMON_MAX_PAYLOAD;
+	if (memoryLimit > 0)
+	{
+		uint64 share = memoryLimit / threadCount;
+		uint64 reserved = getWorkspaceBytes() + DAEMON_WRITER_BUFFER_SIZE;
+		uint64 maxPayload = share > reserved ? (share - reserved) / 2 : 0;
+		if (maxPayload < daemon.maxPayload)
+			daemon.maxPayload = maxPayload;
+		printf("Accepting Payloads of up to %llu Bytes\n", daemon.maxPayload);
+	}
+	printf("Listening on %s with %u Workers...\n", socketPath, threadCount);
+	fflush(stdout);
+	runOnThreads(threadCount, daemonWorker, &daemon);
+	return 0;
+}
+
+// main controls the program flow by parsing arguments and
+//     deciding what functions should run from there.
+int main(int argc, char** argv)
+{
+// Useful for debugging in Visual Studio, if the configuration
+//    is set to debug _DEBUG is defined and the input can be
+//    modified here instead of on the command line.
 #ifdef _DEBUG
 	//argc = 4;
 	//char* args[] = { "", "-b", "-o", "Hello", "-n" };
@@ -896,6 +4075,72 @@ int main(int argc, char** argv)
 			case 'n':
 				nFlag = true;
 				break;
+			case 'a':
+				aFlag = true;
+				break;
+			case 'p':
+				pFlag = true;
+				break;
+			case 'l':
+				lFlag = true;
+				break;
+			case 'v':
+				vFlag = true;
+				break;
+			case 'w':
+				fatalErrorIf(++i >= argc, INVALID_BUFFER_SIZE);
+				fatalErrorIf(atoi(argv[i]) <= 0, INVALID_BUFFER_SIZE);
+				writeBufferSize = (uint64)atoi(argv[i]) << 20;
+				wFlag = true;
+				break;
+			case 'x':
+				xFlag = true;
+				break;
+			case 'm':
+				mFlag = true;
+				break;
+			case 'e':
+				mFlag = true;
+				fatalErrorIf(++i >= argc, MEMBER_NOT_FOUND);
+				memberName = argv[i];
+				break;
+			case 'u':
+				uFlag = true;
+				fatalErrorIf(++i >= argc, SOCKET_LISTEN_FAILED);
+				socketPath = argv[i];
+				break;
+			case 'g':
+				gFlag = true;
+				if (argv[i][2] != '\0')
+				{
+					// stdin and stdout are never it, whether any other is open
+					//    is found out when openProgressFile opens it.
+					char* end;
+					long descriptor = strtol(argv[i] + 2, &end, 10);
+					fatalErrorIf(argv[i][2] < '0' || argv[i][2] > '9' || *end != '\0' || descriptor < 2 || descriptor > INT_MAX, PROGRESS_DESCRIPTOR_INVALID);
+					progressDescriptor = (int)descriptor;
+				}
+				break;
+			case 'c':
+				cFlag = true;
+				fatalErrorIf(++i >= argc, INVALID_SAMPLE_STRIDE);
+				fatalErrorIf(atoll(argv[i]) < SAMPLE_CHUNK_SIZE, INVALID_SAMPLE_STRIDE);
+				sampleStride = atoll(argv[i]);
+				break;
+			case 'i':
+				iFlag = true;
+				break;
+			case 'k':
+				fatalErrorIf(++i >= argc, INVALID_RESTART_INTERVAL);
+				fatalErrorIf(atoi(argv[i]) < MIN_RESTART_INTERVAL, INVALID_RESTART_INTERVAL);
+				restartInterval = (uint32)atoi(argv[i]);
+				break;
+			case '-':
+				fatalErrorIf(strcmp(argv[i], "--mem-limit") != 0, UNIMPLEMENTED_ERROR);
+				fatalErrorIf(++i >= argc, INVALID_MEMORY_LIMIT);
+				fatalErrorIf(atoi(argv[i]) < MIN_MEMORY_LIMIT_MB, INVALID_MEMORY_LIMIT);
+				memoryLimit = (uint64)atoi(argv[i]) << 20;
+				break;
 			case 'o':
 				oFlag = true;
 				fatalErrorIf(++i >= argc, NO_OUTPUT_FILE);
@@ -921,25 +4166,55 @@ int main(int argc, char** argv)
 	printErrorMessageIf(nFlag && bFlag, "-b ignored because of -n", SEVERITY_WARNING);
 	printErrorMessageIf(nFlag && oFlag, "-o <filepath> ignored because of -n", SEVERITY_WARNING);
 	printErrorMessageIf(bFlag && oFlag, "-b flag only applies to console output, -o specified", SEVERITY_WARNING);
+	printErrorMessageIf(pFlag && !oFlag && !rFlag, "-p only applies to files written with -o", SEVERITY_WARNING);
 
 	fatalErrorIf(rFlag && !fFlag, DECODE_CLI_UNSUPPORTED);
-	fatalErrorIf(input == 0, NO_INPUT);
+	fatalErrorIf(aFlag && (!oFlag || rFlag), APPEND_REQUIRES_OUTPUT);
+	fatalErrorIf(input == 0 && !uFlag, NO_INPUT);
+	printErrorMessageIf(uFlag && input != 0 && !fFlag, "<input> ignored because of -u, use -f to train the daemon's dictionary", SEVERITY_WARNING);
+	printErrorMessageIf(vFlag && (oFlag || rFlag), "-o and -r ignored because of -v, nothing is written", SEVERITY_WARNING);
+	fatalErrorIf(cFlag && rFlag, DECODE_CLI_UNSUPPORTED);
+	fatalErrorIf(iFlag && !fFlag, INSPECT_REQUIRES_FILES);
+	fatalErrorIf(mFlag && (!fFlag || (!rFlag && !oFlag && !nFlag)), ARCHIVE_REQUIRES_FILES);
+	if (printErrorMessageIf(aFlag && mFlag, "-a ignored because of -m, archives are written whole", SEVERITY_WARNING))
+		aFlag = false;
 
 
 	initHFT();
+	initCRC32C();
+	applyMemoryLimit();
+
+	if (gFlag)
+		progressFile = openProgressFile();
+
+	// Verifying and the daemon are their own things and don't share any
+	//    output with the rest.
+	if (vFlag)
+		return verifyInput() > 0 ? 1 : 0;
+	if (cFlag)
+	{
+		estimateOutput();
+		return 0;
+	}
+	if (iFlag)
+		return inspectInput() > 0 ? 1 : 0;
+	if (uFlag)
+		return runDaemon();
+	if (mFlag)
+	{
+		rFlag ? extractArchive() : encodeArchive();
+		return 0;
+	}
 	double duration, start = hFTNow();
 
 	// Perform requested actions.
 	CountMap countMap = { 0 };
-	HuffmanTree tree;
 	HuffmanCode codeMap[256] = { 0 };
 
 	if (!rFlag)
 	{
 		countMap = createCountMap(input);
-		tree = createHuffmanTree(&countMap);
-
-		parseHuffmanTree(codeMap, &tree);
+		createHuffmanCodes(&countMap, codeMap);
 		computeAverageCodeLength(countMap, codeMap);
 	}
 	
@@ -956,7 +4231,10 @@ int main(int argc, char** argv)
 			printf(rFlag ? "Decoded Message: \n" : "Encoded Message: \n");
 	}
 
-	transformInput(codeMap, countMap.count);
+	if (rFlag)
+		decodeInput(codeMap);
+	else
+		encodeInput(codeMap, countMap.count);
 
 	// Get time taken
 	duration = hFTNow() - start;
@@ -970,7 +4248,9 @@ int main(int argc, char** argv)
 		firstSection ? firstSection = false :  printf("\n");
 
 		printf("Huffman Tree:\n");
+		HuffmanTree tree = createHuffmanTree(&countMap);
 		printHuffmanTree(codeMap, &tree);
+		destroyHuffmanTree(&tree);
 	}
 
 	if (dFlag)
@@ -998,7 +4278,7 @@ int main(int argc, char** argv)
 		if (rFlag)
 		{
 			printf("----  Input  ----\n");
-			uint64 totalBytes = (stats.bitsAfterEncoding + stats.dictionaryBitLength + 7) / 8;
+			uint64 totalBytes = stats.fileBytes;
 			printf("File Size Before Decoding : %llu Bytes\n", totalBytes);
 			
 			printf("Dictionary Size           : %llu Bytes", stats.dictionaryBitLength / 8);
@@ -1007,12 +4287,21 @@ int main(int argc, char** argv)
 			printf("Digest Size               : %llu Bytes", stats.bitsAfterEncoding / 8);
 			(stats.bitsAfterEncoding % 8 > 0) ? printf(" and %llu Bits\n", stats.bitsAfterEncoding % 8) : printf("\n");
 
+			printf("Container Overhead        : %llu Bytes in %llu Blocks\n", stats.containerBytes, stats.blockCount);
+			if (stats.fixedLengthBlocks > 0)
+				printf("Fixed-Length Blocks       : %llu\n", stats.fixedLengthBlocks);
+			if (stats.integerColumnBlocks > 0)
+				printf("Integer Column Blocks     : %llu\n", stats.integerColumnBlocks);
+			if (stats.restartPoints > 0)
+				printf("Restart Points            : %llu\n", stats.restartPoints);
+
 			double compressionRatio = (double)totalBytes / (double)(stats.bytesAfterDecoding);
 			printf("File Compression Ratio    : %.3f (%.1f%%)\n", compressionRatio, compressionRatio * 100.0);
 
 
 			printf("\n---- Output  ----\n");
 			printf("File Size                 : %llu Bytes\n", stats.bytesAfterDecoding);
+			printf("Checksum (CRC32C)         : %08X (Verified)\n", stats.streamChecksum);
 
 
 			printf("\n---- General ----\n");
@@ -1035,8 +4324,18 @@ int main(int argc, char** argv)
 			{
 				printf("Dictionary Size           : %llu Bytes", stats.encodedDictionaryBits / 8);
 				(stats.encodedDictionaryBits % 8 > 0) ? printf(" and %llu Bits\n", stats.encodedDictionaryBits % 8) : printf("\n");
-				uint64 totalBytes = (stats.bitsAfterEncoding + stats.encodedDictionaryBits + 7) / 8;
+				printf("Container Overhead        : %llu Bytes in %llu Blocks\n", stats.containerBytes, stats.blockCount);
+				if (stats.fixedLengthBlocks > 0)
+					printf("Fixed-Length Blocks       : %llu\n", stats.fixedLengthBlocks);
+				if (stats.integerColumnBlocks > 0)
+					printf("Integer Column Blocks     : %llu\n", stats.integerColumnBlocks);
+				if (stats.restartPoints > 0)
+					printf("Restart Points            : %llu, Every %u Symbols\n", stats.restartPoints, restartInterval);
+				if (stats.appendedToBlocks > 0)
+					printf("Appended To               : %llu Existing Blocks\n", stats.appendedToBlocks);
+				uint64 totalBytes = stats.fileBytes;
 				printf("Output File Size          : %llu Bytes\n", totalBytes);
+				printf("Checksum (CRC32C)         : %08X\n", stats.streamChecksum);
 				compressionRatio = (double)(totalBytes) / (double)stats.bytesBeforeEncoding;
 				printf("File Compression Ratio    : %.3f (%.1f%%)\n", compressionRatio, compressionRatio * 100.0);
 			}
@@ -1065,7 +4364,16 @@ int main(int argc, char** argv)
 			
 
 			printf("\n---- General ----\n");
-			printf("Average Code Length       : %.3f Bits\n", stats.averageCodeLength);
+			// Filtered blocks' codes are for the filter's varints, not the
+			//    input's bytes, so the entropy above isn't comparable.
+			if (stats.integerColumnBlocks > 0)
+			{
+				printf("Average Code Length       : %.3f Bits per Input Byte, Post-Filter\n", stats.averageCodeLength);
+				printf("Filtered Code Length      : %.3f Bits per Filtered Byte, %llu Bytes\n",
+					(double)stats.integerColumnBits / (double)stats.integerColumnSymbols, stats.integerColumnSymbols);
+			}
+			else
+				printf("Average Code Length       : %.3f Bits\n", stats.averageCodeLength);
 		}
 
 		// Print the time taken in whatever unit makes the most sense
@@ -1098,9 +4406,24 @@ int main(int argc, char** argv)
 			printf("%.2f Nano-Seconds", duration);
 		}
 		printf("\n");
-	}
 
 
-	if(!rFlag)
-		destroyHuffmanTree(&tree);
+		printf("\n---- Memory  ----\n");
+		printf("Peak Resident Set         : %.1f MB\n", (double)getPeakResidentBytes() / (1024.0 * 1024.0));
+		printf("Peak Block Buffers        : %.1f MB", (double)stats.peakBufferBytes / (1024.0 * 1024.0));
+		rFlag ? printf("\n") : printf(" in %u Byte Blocks\n", encodeBlockSize);
+		if (oFlag && !nFlag)
+			printf("Write Buffer              : %.1f MB\n", (double)writeBufferSize / (1024.0 * 1024.0));
+		AllocatorStats allocator;
+		if (getAllocatorStats(&allocator))
+		{
+			printf("Allocator In Use          : %.1f MB\n", (double)allocator.inUse / (1024.0 * 1024.0));
+			printf("Allocator Free            : %.1f MB\n", (double)allocator.free / (1024.0 * 1024.0));
+			printf("Allocator Heap / Mapped   : %.1f MB / %.1f MB\n", (double)allocator.arena / (1024.0 * 1024.0), (double)allocator.mapped / (1024.0 * 1024.0));
+		}
+		else
+			printf("Allocator Statistics      : Unavailable\n");
+		if (memoryLimit > 0)
+			printf("Memory Limit              : %llu MB\n", memoryLimit >> 20);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,253 @@
+#include "numericfilter.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FILTER_FLAG_CRLF 0x01
+#define FILTER_FLAG_TRAILING_NEWLINE 0x02
+#define FILTER_FLAG_PARTIAL_LINES 0x04
+// "-9223372036854775808" plus \r\n
+#define MAX_LINE_LENGTH 22
+
+uint8* writeVarint(uint8* p, uint64 value)
+{
+	while (value >= 0x80)
+	{
+		*p++ = (uint8)(value | 0x80);
+		value >>= 7;
+	}
+	*p++ = (uint8)value;
+	return p;
+}
+
+const uint8* readVarint(const uint8* p, const uint8* end, uint64* value)
+{
+	*value = 0;
+	for (uint8 shift = 0; p < end && shift < 64; shift += 7)
+	{
+		uint8 byte = *p++;
+		*value |= (uint64)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0)
+			return p;
+	}
+	return 0;
+}
+
+// Parses a single number, exactly as printf would have written it, up to
+//    end. Returns false if it's anything else.
+static bool _parseInteger(const uint8* p, const uint8* end, uint64* value)
+{
+	bool negative = *p == '-';
+	p += negative;
+
+	uint64 length = end - p;
+	if (length == 0 || length > 19) return false;
+	// No leading 0's and no -0
+	if (*p == '0' && (length > 1 || negative)) return false;
+
+	uint64 magnitude = 0;
+	for (; p < end; ++p)
+	{
+		if (*p < '0' || *p > '9') return false;
+		uint64 digit = *p - '0';
+		if (magnitude > (UINT64_C(18446744073709551615) - digit) / 10) return false;
+		magnitude = magnitude * 10 + digit;
+	}
+
+	// The range of an int64 isn't symmetrical
+	if (magnitude > (negative ? UINT64_C(9223372036854775808) : UINT64_C(9223372036854775807)))
+		return false;
+
+	*value = negative ? 0 - magnitude : magnitude;
+	return true;
+}
+
+// A line that's cut short at either end of the text, by a block boundary,
+//    is kept raw when it isn't a number on its own. Returns true if the
+//    length bytes at p are one, counting its line ending.
+static bool _isPartialLine(const uint8* p, uint64 length)
+{
+	uint64 value;
+	if (length == 0 || length > MAX_LINE_LENGTH) return false;
+	const uint8* end = p + length;
+	if (end[-1] == '\n' && --end > p && end[-1] == '\r') --end;
+	return end == p || !_parseInteger(p, end, &value);
+}
+
+uint64 filterIntegerColumn(const uint8* in, uint64 size, uint8* out, uint64 outCapacity)
+{
+	if (size == 0) return 0;
+	const uint8* end = in + size;
+
+	// The first line is raw if it doesn't parse, but only when there's more.
+	const uint8* eol = in;
+	while (eol < end && *eol != '\n') ++eol;
+	uint64 headSize = eol < end && _isPartialLine(in, eol + 1 - in) ? eol + 1 - in : 0;
+	const uint8* body = in + headSize;
+
+	// As is the last when it doesn't end in a line ending.
+	const uint8* tail = end;
+	while (tail > body && tail[-1] != '\n') --tail;
+	uint64 tailSize = tail > body && _isPartialLine(tail, end - tail) ? end - tail : 0;
+	end -= tailSize;
+	if (end == body) return 0;
+
+	// The line ending is the first whole line's.
+	uint8 flags = (headSize | tailSize) ? FILTER_FLAG_PARTIAL_LINES : 0;
+	eol = body;
+	while (eol < end && *eol != '\n') ++eol;
+	if (eol > body && eol < end && eol[-1] == '\r')
+		flags |= FILTER_FLAG_CRLF;
+	uint8 lineEndingSize = (flags & FILTER_FLAG_CRLF) ? 2 : 1;
+
+	if (end[-1] == '\n')
+	{
+		if ((flags & FILTER_FLAG_CRLF) && (end - body < 2 || end[-2] != '\r')) return 0;
+		flags |= FILTER_FLAG_TRAILING_NEWLINE;
+		end -= lineEndingSize;
+	}
+
+	// The count goes first, we write the deltas after the widest count we
+	//    could need and then move them back once we know it. Every line
+	//    needs at least 2 bytes so there are at most size / 2 + 1 values.
+	uint8 countBuffer[10];
+	uint64 maxCount = size / 2 + 1;
+	uint8 countSpace = (uint8)(writeVarint(countBuffer, maxCount) - countBuffer);
+	uint64 partialSpace = (flags & FILTER_FLAG_PARTIAL_LINES) ? 2 + headSize + tailSize : 0;
+	if (outCapacity < 1 + partialSpace + countSpace + 10) return 0;
+
+	uint8* counted = out + 1;
+	if (flags & FILTER_FLAG_PARTIAL_LINES)
+	{
+		counted = writeVarint(counted, headSize);
+		memcpy(counted, in, headSize);
+		counted = writeVarint(counted + headSize, tailSize);
+		memcpy(counted, tail, tailSize);
+		counted += tailSize;
+	}
+	uint8* deltas = counted + countSpace;
+	uint8* p = deltas;
+	uint8* outEnd = out + outCapacity;
+
+	uint64 count = 0;
+	uint64 previous = 0;
+	for (const uint8* line = body; line <= end;)
+	{
+		const uint8* lineEnd = line;
+		while (lineEnd < end && *lineEnd != '\n') ++lineEnd;
+
+		// Every line ending must be the same as the first, the last line's
+		//    was taken off already.
+		const uint8* numberEnd = lineEnd;
+		if (lineEnd < end && (flags & FILTER_FLAG_CRLF))
+		{
+			if (numberEnd == line || numberEnd[-1] != '\r') return 0;
+			--numberEnd;
+		}
+		if (numberEnd > line && numberEnd[-1] == '\r') return 0;
+
+		uint64 value;
+		if (!_parseInteger(line, numberEnd, &value)) return 0;
+		if (outEnd - p < 10) return 0;
+
+		// Zigzag puts small negative and positive deltas next to each other
+		//    so they both become short varints.
+		int64 delta = (int64)(value - previous);
+		p = writeVarint(p, ((uint64)delta << 1) ^ (uint64)(delta >> 63));
+		previous = value;
+		++count;
+
+		if (lineEnd >= end) break;
+		line = lineEnd + 1;
+	}
+
+	out[0] = flags;
+	uint8 countSize = (uint8)(writeVarint(counted, count) - counted);
+	uint8* start = counted + countSize;
+	for (uint8* q = deltas; q < p; ++q, ++start)
+		*start = *q;
+	return start - out;
+}
+
+const uint8* getFilteredDeltas(const uint8* in, uint64 size, uint64* count, uint64* headSize, uint64* tailSize)
+{
+	const uint8* end = in + size;
+	const uint8* p = in + 1;
+	*headSize = *tailSize = 0;
+	if (size < 2) return 0;
+
+	if (in[0] & FILTER_FLAG_PARTIAL_LINES)
+	{
+		p = readVarint(p, end, headSize);
+		if (p == 0 || *headSize > MAX_LINE_LENGTH || *headSize > (uint64)(end - p)) return 0;
+		p = readVarint(p + *headSize, end, tailSize);
+		if (p == 0 || *tailSize > MAX_LINE_LENGTH || *tailSize > (uint64)(end - p)) return 0;
+		p += *tailSize;
+	}
+	p = readVarint(p, end, count);
+	// Every value is at least one byte so any bigger count is corrupt
+	if (p == 0 || *count == 0 || *count > (uint64)(end - p)) return 0;
+	return p;
+}
+
+uint64 getUnfilteredCapacity(const uint8* in, uint64 size)
+{
+	uint64 count, headSize, tailSize;
+	if (getFilteredDeltas(in, size, &count, &headSize, &tailSize) == 0) return 0;
+	return count * MAX_LINE_LENGTH + headSize + tailSize;
+}
+
+uint64 unfilterIntegerColumn(const uint8* in, uint64 size, uint8* out, uint64 outCapacity)
+{
+	const uint8* end = in + size;
+	uint64 count, headSize, tailSize;
+	const uint8* p = getFilteredDeltas(in, size, &count, &headSize, &tailSize);
+	if (p == 0 || headSize + tailSize > outCapacity || count > (outCapacity - headSize - tailSize) / MAX_LINE_LENGTH) return 0;
+
+	// The raw lines are just before the count.
+	uint8 flags = in[0];
+	const uint8* head = in + 1 + ((flags & FILTER_FLAG_PARTIAL_LINES) ? 1 : 0);
+	const uint8* tail = head + headSize + ((flags & FILTER_FLAG_PARTIAL_LINES) ? 1 : 0);
+	uint8* q = out;
+	memcpy(q, head, headSize);
+	q += headSize;
+
+	uint64 previous = 0;
+	for (uint64 i = 0; i < count; ++i)
+	{
+		uint64 zigzag;
+		p = readVarint(p, end, &zigzag);
+		if (p == 0) return 0;
+
+		uint64 value = previous + ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+		previous = value;
+
+		// Write the number backwards into a scratch buffer then copy it.
+		uint8 digits[20];
+		uint8 digitCount = 0;
+		uint64 magnitude = (int64)value < 0 ? 0 - value : value;
+		do
+		{
+			digits[digitCount++] = '0' + magnitude % 10;
+			magnitude /= 10;
+		} while (magnitude > 0);
+
+		if ((int64)value < 0)
+			*q++ = '-';
+		while (digitCount > 0)
+			*q++ = digits[--digitCount];
+
+		if (i + 1 < count || (flags & FILTER_FLAG_TRAILING_NEWLINE))
+		{
+			if (flags & FILTER_FLAG_CRLF)
+				*q++ = '\r';
+			*q++ = '\n';
+		}
+	}
+	memcpy(q, tail, tailSize);
+	q += tailSize;
+
+	// Anything left over means the filtered data is corrupt.
+	if (p != end) return 0;
+	return q - out;
+}
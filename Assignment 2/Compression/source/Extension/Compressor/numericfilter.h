@@ -0,0 +1,43 @@
+#ifndef COMPRESSOR_NUMERICFILTER_H
+#define COMPRESSOR_NUMERICFILTER_H
+
+#include "common.h"
+
+// Integer column filter. Text made up of one 64 bit integer per line, like
+//    the NN.dat files the sorting homework generates, is turned into the
+//    zigzag encoded difference between each value and the one before it,
+//    written as a varint. Only text we can reproduce exactly is filtered,
+//    so numbers must be written the way printf("%lld") would, with the
+//    same line ending (\n or \r\n) throughout. A block boundary can cut a
+//    line in two, so a first or last line that isn't a number, of up to
+//    one line's length, is kept as it is.
+//
+//    Filtered layout: flags (1 byte), when they're kept the varint sizes
+//    of the raw first and last lines each followed by their bytes, varint
+//    value count, varint deltas.
+
+// Little endian base 128, 7 bits per byte with the top bit set on every
+//    byte but the last. writeVarint writes at most 10 bytes and returns
+//    the end of what it wrote, readVarint returns the end of what it read
+//    or 0 if the varint runs past end.
+uint8* writeVarint(uint8* p, uint64 value);
+const uint8* readVarint(const uint8* p, const uint8* end, uint64* value);
+
+// Filters size bytes of text into out. Returns the filtered size or 0 if
+//    the text isn't an integer column or the result would not fit in
+//    outCapacity bytes.
+uint64 filterIntegerColumn(const uint8* in, uint64 size, uint8* out, uint64 outCapacity);
+
+// Reads the layout before the deltas, the value count and the sizes of the
+//    raw first and last lines. Returns where the deltas start, 0 if in is
+//    corrupt.
+const uint8* getFilteredDeltas(const uint8* in, uint64 size, uint64* count, uint64* headSize, uint64* tailSize);
+
+// The most bytes of text unfiltering in could produce, 0 if in is corrupt.
+uint64 getUnfilteredCapacity(const uint8* in, uint64 size);
+
+// Reverses filterIntegerColumn. Returns the size of the text or 0 if in is
+//    corrupt or the text would not fit in outCapacity bytes.
+uint64 unfilterIntegerColumn(const uint8* in, uint64 size, uint8* out, uint64 outCapacity);
+
+#endif
@@ -0,0 +1,416 @@
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <io.h>
+#include <psapi.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+uint32 getProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32)count : 1;
+#endif
+}
+
+typedef struct
+{
+	ThreadFunction function;
+	void* argument;
+} ThreadStart;
+
+#ifdef _WIN32
+static DWORD WINAPI _threadMain(LPVOID start)
+{
+	((ThreadStart*)start)->function(((ThreadStart*)start)->argument);
+	return 0;
+}
+#else
+static void* _threadMain(void* start)
+{
+	((ThreadStart*)start)->function(((ThreadStart*)start)->argument);
+	return 0;
+}
+#endif
+
+void runOnThreads(uint32 threadCount, ThreadFunction function, void* argument)
+{
+	ThreadStart start = { function, argument };
+	if (threadCount <= 1)
+	{
+		function(argument);
+		return;
+	}
+
+	// The calling thread does its share too rather than waiting around.
+#ifdef _WIN32
+	HANDLE* threads = calloc(threadCount - 1, sizeof(HANDLE));
+	for (uint32 i = 0; threads && i < threadCount - 1; ++i)
+		threads[i] = CreateThread(NULL, 0, _threadMain, &start, 0, NULL);
+	function(argument);
+	for (uint32 i = 0; threads && i < threadCount - 1; ++i)
+	{
+		if (threads[i] == NULL) continue;
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+#else
+	pthread_t* threads = calloc(threadCount - 1, sizeof(pthread_t));
+	bool* started = calloc(threadCount - 1, sizeof(bool));
+	for (uint32 i = 0; threads && started && i < threadCount - 1; ++i)
+		started[i] = pthread_create(threads + i, NULL, _threadMain, &start) == 0;
+	function(argument);
+	for (uint32 i = 0; threads && started && i < threadCount - 1; ++i)
+		if (started[i])
+			pthread_join(threads[i], NULL);
+	free(started);
+#endif
+	free(threads);
+}
+
+uint64 atomicIncrement(volatile uint64* value)
+{
+#ifdef _WIN32
+	return InterlockedIncrement64((volatile LONG64*)value);
+#else
+	return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+#endif
+}
+
+FILE* openDescriptor(int descriptor)
+{
+#ifdef _WIN32
+	return _fdopen(descriptor, "w");
+#else
+	return fdopen(descriptor, "w");
+#endif
+}
+
+const uint8* mapDescriptor(int descriptor, uint64* size)
+{
+#ifdef _WIN32
+	return 0;
+#else
+	struct stat info;
+	if (fstat(descriptor, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0)
+		return 0;
+
+	void* memory = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (memory == MAP_FAILED)
+		return 0;
+	madvise(memory, info.st_size, MADV_SEQUENTIAL);
+	*size = info.st_size;
+	return memory;
+#endif
+}
+
+void unmapMemory(const uint8* memory, uint64 size)
+{
+#ifndef _WIN32
+	munmap((void*)memory, size);
+#endif
+}
+
+bool readDescriptor(int descriptor, uint8** buffer, uint64* capacity, uint64* size, uint64 maxSize)
+{
+	*size = 0;
+	for (;;)
+	{
+		if (*size == *capacity)
+		{
+			// One byte past maxSize is enough to know it's too big.
+			if (*size > maxSize) return false;
+			uint64 newCapacity = *capacity ? *capacity * 2 : 1 << 16;
+			if (newCapacity > maxSize + 1)
+				newCapacity = maxSize + 1;
+			uint8* grown = realloc(*buffer, newCapacity);
+			if (grown == NULL) return false;
+			*buffer = grown;
+			*capacity = newCapacity;
+		}
+
+		uint64 space = *capacity - *size;
+#ifdef _WIN32
+		long long n = _read(descriptor, *buffer + *size, space > (1u << 30) ? (1u << 30) : (unsigned int)space);
+#else
+		ssize_t n = read(descriptor, *buffer + *size, space);
+		if (n < 0 && errno == EINTR) continue;
+#endif
+		if (n < 0) return false;
+		if (n == 0) return *size <= maxSize;
+		*size += n;
+	}
+}
+
+void closeDescriptor(int descriptor)
+{
+#ifdef _WIN32
+	_close(descriptor);
+#else
+	close(descriptor);
+#endif
+}
+
+int listenOnSocket(const char* path)
+{
+#ifdef _WIN32
+	return -1;
+#else
+	struct sockaddr_un address = { 0 };
+	address.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address.sun_path)) return -1;
+	strcpy(address.sun_path, path);
+
+	// Clients hanging up, or closing a pipe they passed us, shouldn't kill
+	//    the process, the write fails and that request fails with it.
+	signal(SIGPIPE, SIG_IGN);
+
+	// If something still answers on the socket it's in use, otherwise it
+	//    was left behind and can go.
+	int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (probe < 0) return -1;
+	bool inUse = connect(probe, (struct sockaddr*)&address, sizeof(address)) == 0;
+	close(probe);
+	if (inUse) return -1;
+	unlink(path);
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) return -1;
+	if (bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0)
+	{
+		close(listener);
+		return -1;
+	}
+	return listener;
+#endif
+}
+
+int acceptConnection(int listener)
+{
+#ifdef _WIN32
+	return -1;
+#else
+	return accept(listener, NULL, NULL);
+#endif
+}
+
+bool receiveAll(int connection, void* buffer, uint64 size, int* descriptors, uint8 maxDescriptors, uint8* descriptorCount)
+{
+#ifdef _WIN32
+	return false;
+#else
+	uint8* p = buffer;
+	while (size > 0)
+	{
+		struct iovec vector = { p, size };
+		union
+		{
+			struct cmsghdr header;
+			char space[CMSG_SPACE(sizeof(int) * 4)];
+		} control;
+		struct msghdr message = { 0 };
+		message.msg_iov = &vector;
+		message.msg_iovlen = 1;
+		message.msg_control = control.space;
+		message.msg_controllen = sizeof(control.space);
+
+		ssize_t received = recvmsg(connection, &message, 0);
+		if (received < 0 && errno == EINTR) continue;
+		if (received <= 0) return false;
+
+		for (struct cmsghdr* c = CMSG_FIRSTHDR(&message); c; c = CMSG_NXTHDR(&message, c))
+		{
+			if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+
+			uint64 count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			for (uint64 i = 0; i < count; ++i)
+			{
+				int passed;
+				memcpy(&passed, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+				if (descriptors && *descriptorCount < maxDescriptors)
+					descriptors[(*descriptorCount)++] = passed;
+				else
+					close(passed);
+			}
+		}
+
+		p += received;
+		size -= received;
+	}
+	return true;
+#endif
+}
+
+bool sendAll(int connection, const void* buffer, uint64 size)
+{
+#ifdef _WIN32
+	return false;
+#else
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+	const uint8* p = buffer;
+	while (size > 0)
+	{
+		ssize_t sent = send(connection, p, size, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) continue;
+		if (sent <= 0) return false;
+		p += sent;
+		size -= sent;
+	}
+	return true;
+#endif
+}
+
+bool isDirectory(const char* path)
+{
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path);
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat info;
+	return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+#endif
+}
+
+bool createParentDirectories(const char* path)
+{
+	size_t length = strlen(path);
+	char* directory = malloc(length + 1);
+	if (directory == NULL) return false;
+	memcpy(directory, path, length + 1);
+
+	bool success = true;
+	for (size_t i = 1; i < length && success; ++i)
+	{
+		if (directory[i] != '/') continue;
+		directory[i] = '\0';
+#ifdef _WIN32
+		success = CreateDirectoryA(directory, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+		success = mkdir(directory, 0777) == 0 || errno == EEXIST;
+#endif
+		directory[i] = '/';
+	}
+	free(directory);
+	return success;
+}
+
+static void _addFile(char*** files, uint64* count, uint64* capacity, const char* directory, const char* name)
+{
+	if (*count == *capacity)
+	{
+		*capacity = *capacity ? *capacity * 2 : 64;
+		*files = realloc(*files, *capacity * sizeof(char*));
+		if (*files == NULL) exit(-1);
+	}
+
+	size_t length = strlen(directory) + strlen(name) + 2;
+	char* path = malloc(length);
+	if (path == NULL) exit(-1);
+	snprintf(path, length, "%s/%s", directory, name);
+	(*files)[(*count)++] = path;
+}
+
+void listFiles(const char* path, char*** files, uint64* count, uint64* capacity)
+{
+#ifdef _WIN32
+	char pattern[MAX_PATH];
+	snprintf(pattern, MAX_PATH, "%s/*", path);
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA(pattern, &entry);
+	if (find == INVALID_HANDLE_VALUE) return;
+	do
+	{
+		if (strcmp(entry.cFileName, ".") == 0 || strcmp(entry.cFileName, "..") == 0)
+			continue;
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			char child[MAX_PATH];
+			snprintf(child, MAX_PATH, "%s/%s", path, entry.cFileName);
+			listFiles(child, files, count, capacity);
+		}
+		else
+			_addFile(files, count, capacity, path, entry.cFileName);
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR* directory = opendir(path);
+	if (directory == NULL) return;
+	for (struct dirent* entry = readdir(directory); entry; entry = readdir(directory))
+	{
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+			continue;
+
+		size_t length = strlen(path) + strlen(entry->d_name) + 2;
+		char* child = malloc(length);
+		if (child == NULL) exit(-1);
+		snprintf(child, length, "%s/%s", path, entry->d_name);
+
+		struct stat info;
+		if (stat(child, &info) == 0)
+		{
+			if (S_ISDIR(info.st_mode))
+				listFiles(child, files, count, capacity);
+			else if (S_ISREG(info.st_mode))
+				_addFile(files, count, capacity, path, entry->d_name);
+		}
+		free(child);
+	}
+	closedir(directory);
+#endif
+}
+
+uint64 getPeakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return (uint64)usage.ru_maxrss;
+#else
+	// Linux reports kilobytes.
+	return (uint64)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+bool getAllocatorStats(AllocatorStats* stats)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 info = mallinfo2();
+	stats->inUse = info.uordblks + info.hblkhd;
+	stats->mapped = info.hblkhd;
+	stats->free = info.fordblks;
+	stats->arena = info.arena;
+	return true;
+#else
+	memset(stats, 0, sizeof(AllocatorStats));
+	return false;
+#endif
+}
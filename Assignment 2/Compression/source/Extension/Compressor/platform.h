@@ -0,0 +1,84 @@
+#ifndef COMPRESSOR_PLATFORM_H
+#define COMPRESSOR_PLATFORM_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "common.h"
+
+// The few things we need that Windows and everything else do differently.
+
+// Each thread gets its own copy of variables declared with this.
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+typedef void (*ThreadFunction)(void* argument);
+
+uint32 getProcessorCount();
+
+// Runs function(argument) on threadCount threads and waits for all of them.
+void runOnThreads(uint32 threadCount, ThreadFunction function, void* argument);
+
+// Adds 1 to value and returns the result, safe to call from any thread.
+uint64 atomicIncrement(volatile uint64* value);
+
+// Opens an already open file descriptor, like one a parent process passed
+//    us, for writing. Returns 0 if it can't be.
+FILE* openDescriptor(int descriptor);
+
+// Maps a file descriptor into memory read only. Returns 0 if it can't be
+//    mapped, pipes and sockets for example, or is empty.
+const uint8* mapDescriptor(int descriptor, uint64* size);
+void unmapMemory(const uint8* memory, uint64 size);
+
+// Reads a descriptor until the end into *buffer, growing it as needed.
+//    Fails if there is more than maxSize to read. *buffer stays the
+//    caller's to free even if this fails.
+bool readDescriptor(int descriptor, uint8** buffer, uint64* capacity, uint64* size, uint64 maxSize);
+
+void closeDescriptor(int descriptor);
+
+// UNIX domain sockets, these all fail on Windows.
+
+// Listens on a socket at path, replacing a stale one left by a process
+//    that has gone. Returns the listening descriptor or -1.
+int listenOnSocket(const char* path);
+int acceptConnection(int listener);
+
+// Receives exactly size bytes. Descriptors passed along with them, up to
+//    maxDescriptors, are stored in descriptors, the rest are closed.
+//    Returns false if the connection closed or failed first.
+bool receiveAll(int connection, void* buffer, uint64 size, int* descriptors, uint8 maxDescriptors, uint8* descriptorCount);
+bool sendAll(int connection, const void* buffer, uint64 size);
+
+bool isDirectory(const char* path);
+
+// Creates every directory in path up to its last /, like mkdir -p on its
+//    parent. Returns false if one of them couldn't be created.
+bool createParentDirectories(const char* path);
+
+// Recursively lists every regular file under path, appending the paths,
+//    which must be freed along with the array, to files.
+void listFiles(const char* path, char*** files, uint64* count, uint64* capacity);
+
+// The most memory the process has had resident at once, 0 if the OS won't say.
+uint64 getPeakResidentBytes();
+
+// What the C library's allocator holds. inUse is what has been allocated
+//    and not freed, mapped the part of that in blocks of their own, free
+//    what it holds on to for later and arena what it has taken from the OS
+//    for everything but the blocks of their own.
+typedef struct
+{
+	uint64 inUse;
+	uint64 mapped;
+	uint64 free;
+	uint64 arena;
+} AllocatorStats;
+
+// Returns false if the allocator can't tell us, only glibc can for now.
+bool getAllocatorStats(AllocatorStats* stats);
+
+#endif
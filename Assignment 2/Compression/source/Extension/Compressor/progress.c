@@ -0,0 +1,51 @@
+#include "progress.h"
+#include "timing.h"
+
+void startProgress(Progress* progress, FILE* file, bool overwrite, uint64 total)
+{
+	progress->file = file;
+	progress->overwrite = overwrite;
+	progress->total = total;
+	progress->start = hFTNow();
+	progress->last = progress->start;
+	progress->lastProcessed = 0;
+	progress->ioTime = 0;
+}
+
+static void _printProgress(Progress* progress, double now, uint64 processed, double ratio)
+{
+	const double megabyte = 1024.0 * 1024.0;
+	double elapsed = now - progress->start;
+	double interval = now - progress->last;
+	double average = elapsed > 0 ? processed / megabyte / elapsed : 0;
+	double current = interval > 0 ? (processed - progress->lastProcessed) / megabyte / interval : average;
+	double io = elapsed > 0 ? progress->ioTime / elapsed * 100.0 : 0;
+	double percent = progress->total > 0 ? (double)processed / (double)progress->total * 100.0 : 100.0;
+
+	// The average rate is a steadier guess at the time left than the current one.
+	uint64 eta = 0;
+	if (average > 0 && processed < progress->total)
+		eta = (uint64)((progress->total - processed) / megabyte / average);
+
+	fprintf(progress->file, "%5.1f%%  %.1f of %.1f MB  now %.1f MB/s  avg %.1f MB/s  ratio %.3f  io %2.0f%%  ETA %llu:%02llu:%02llu%s",
+		percent, processed / megabyte, progress->total / megabyte, current, average, ratio, io,
+		eta / 3600, eta / 60 % 60, eta % 60, progress->overwrite ? "   \r" : "\n");
+	fflush(progress->file);
+
+	progress->last = now;
+	progress->lastProcessed = processed;
+}
+
+void updateProgress(Progress* progress, uint64 processed, double ratio)
+{
+	double now = hFTNow();
+	if (now - progress->last >= PROGRESS_INTERVAL)
+		_printProgress(progress, now, processed, ratio);
+}
+
+void finishProgress(Progress* progress, uint64 processed, double ratio)
+{
+	_printProgress(progress, hFTNow(), processed, ratio);
+	if (progress->overwrite)
+		fprintf(progress->file, "\n");
+}
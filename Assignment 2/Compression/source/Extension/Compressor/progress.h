@@ -0,0 +1,36 @@
+#ifndef COMPRESSOR_PROGRESS_H
+#define COMPRESSOR_PROGRESS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "common.h"
+
+// Seconds between progress lines, updating more often than this costs
+//    nothing but a call to hFTNow.
+#define PROGRESS_INTERVAL 0.5
+
+typedef struct
+{
+	FILE* file;
+	// Consoles get one line rewritten in place, anything else a line per update.
+	bool overwrite;
+	uint64 total;
+	double start;
+	double last;
+	uint64 lastProcessed;
+	// Time spent waiting on reads and writes, the rest is spent encoding
+	//    or decoding, so it shows whether the disk or the processor is
+	//    the bottleneck.
+	double ioTime;
+} Progress;
+
+void startProgress(Progress* progress, FILE* file, bool overwrite, uint64 total);
+
+// processed is how many of the total bytes are done and ratio the output
+//    size over the input size so far.
+void updateProgress(Progress* progress, uint64 processed, double ratio);
+
+// Prints the final line regardless of when the last one was.
+void finishProgress(Progress* progress, uint64 processed, double ratio);
+
+#endif
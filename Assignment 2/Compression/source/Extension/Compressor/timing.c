@@ -14,7 +14,7 @@ void initHFT()
 	QueryPerformanceFrequency(&t);
 	timerFQ = t.QuadPart;
 #else
-	timerFQ = CLOCKS_PER_SEC;
+	timerFQ = 1e+09;
 #endif
 }
 
@@ -28,7 +28,11 @@ double hFTNow()
 	QueryPerformanceCounter(&t);
 	time = t.QuadPart * resolution;
 #else
-	time =  clock() * resolution;
+	// clock() is the processor time of every thread combined, which is
+	//    no use for timing one thread while others are running.
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	time = ((double)t.tv_sec * 1e+09 + t.tv_nsec) * resolution;
 #endif
 	return time / timerFQ;
 }
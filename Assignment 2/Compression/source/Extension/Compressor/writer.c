@@ -0,0 +1,233 @@
+// For O_DIRECT and fallocate, unless the build already defines it.
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include "writer.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <malloc.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/uio.h>
+#endif
+
+static void* _allocateAligned(uint64 size)
+{
+#ifdef _WIN32
+	return _aligned_malloc(size, WRITER_ALIGNMENT);
+#else
+	void* p = 0;
+	return posix_memalign(&p, WRITER_ALIGNMENT, size) == 0 ? p : 0;
+#endif
+}
+
+static void _freeAligned(void* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+// Writes every byte of the first count pieces, picking up where a partial
+//    write left off.
+static bool _writePieces(FileWriter* writer, const uint8** data, uint64* size, uint8 count)
+{
+	for (uint8 first = 0; first < count;)
+	{
+		if (size[first] == 0)
+		{
+			++first;
+			continue;
+		}
+
+#ifdef _WIN32
+		unsigned int chunk = size[first] > (1u << 30) ? (1u << 30) : (unsigned int)size[first];
+		long long written = _write(writer->descriptor, data[first], chunk);
+		if (written <= 0) return false;
+#else
+		struct iovec vectors[2];
+		uint8 vectorCount = 0;
+		for (uint8 i = first; i < count && vectorCount < 2; ++i)
+		{
+			vectors[vectorCount].iov_base = (void*)data[i];
+			vectors[vectorCount].iov_len = size[i];
+			++vectorCount;
+		}
+		ssize_t written = writev(writer->descriptor, vectors, vectorCount);
+		if (written < 0 && errno == EINTR) continue;
+		if (written <= 0) return false;
+#endif
+
+		writer->position += written;
+		for (uint8 i = first; i < count && written > 0; ++i)
+		{
+			uint64 n = (uint64)written < size[i] ? (uint64)written : size[i];
+			data[i] += n;
+			size[i] -= n;
+			written -= n;
+		}
+	}
+	return true;
+}
+
+bool openFileWriter(FileWriter* writer, const char* path, uint64 offset, uint64 bufferSize, bool direct, uint64 expectedSize)
+{
+	memset(writer, 0, sizeof(FileWriter));
+
+	// Direct writes need the buffer to be a whole number of pages.
+	bufferSize = (bufferSize + WRITER_ALIGNMENT - 1) / WRITER_ALIGNMENT * WRITER_ALIGNMENT;
+	if (bufferSize == 0)
+		bufferSize = WRITER_ALIGNMENT;
+
+#ifdef _WIN32
+	writer->descriptor = _open(path, _O_WRONLY | _O_CREAT | _O_BINARY | (offset == 0 ? _O_TRUNC : 0), 0666);
+	if (writer->descriptor < 0) return false;
+	if (_lseeki64(writer->descriptor, offset, SEEK_SET) < 0)
+	{
+		_close(writer->descriptor);
+		return false;
+	}
+#else
+	int flags = O_WRONLY | O_CREAT | (offset == 0 ? O_TRUNC : 0);
+#ifdef O_DIRECT
+	if (direct && offset % WRITER_ALIGNMENT == 0)
+	{
+		flags |= O_DIRECT;
+		writer->direct = true;
+	}
+#endif
+	writer->descriptor = open(path, flags, 0666);
+	// Not every file system supports direct writes, use the page cache if not.
+	if (writer->descriptor < 0 && writer->direct)
+	{
+		writer->direct = false;
+		writer->descriptor = open(path, flags & ~O_DIRECT, 0666);
+	}
+	if (writer->descriptor < 0) return false;
+	if (lseek(writer->descriptor, offset, SEEK_SET) < 0)
+	{
+		close(writer->descriptor);
+		return false;
+	}
+
+#ifdef __linux__
+	// Reserving the space stops the file being spread across the disk as it
+	//    grows, anything we don't use is trimmed when we close. Unlike
+	//    posix_fallocate this fails rather than writing zeros when the
+	//    file system can't do it.
+	if (expectedSize > offset)
+		writer->preallocated = fallocate(writer->descriptor, 0, offset, expectedSize - offset) == 0;
+#endif
+#endif
+
+	writer->position = offset;
+	writer->capacity = bufferSize;
+	writer->buffer = _allocateAligned(bufferSize);
+	if (writer->buffer == NULL)
+	{
+		closeFileWriter(writer);
+		return false;
+	}
+	return true;
+}
+
+bool attachFileWriter(FileWriter* writer, int descriptor, uint64 bufferSize)
+{
+	memset(writer, 0, sizeof(FileWriter));
+	writer->descriptor = descriptor;
+	writer->attached = true;
+	writer->capacity = bufferSize > 0 ? bufferSize : WRITER_ALIGNMENT;
+	writer->buffer = _allocateAligned(writer->capacity);
+	return writer->buffer != NULL;
+}
+
+bool writeFileWriter(FileWriter* writer, const void* data, uint64 size)
+{
+	const uint8* p = data;
+
+	// Direct writes have to come from the aligned buffer in whole pages so
+	//    everything is copied through it.
+	if (writer->direct)
+	{
+		while (size > 0)
+		{
+			uint64 n = writer->capacity - writer->used;
+			n = n < size ? n : size;
+			memcpy(writer->buffer + writer->used, p, n);
+			writer->used += n;
+			p += n;
+			size -= n;
+
+			if (writer->used == writer->capacity)
+			{
+				const uint8* pieces[1] = { writer->buffer };
+				uint64 sizes[1] = { writer->used };
+				if (!_writePieces(writer, pieces, sizes, 1)) return false;
+				writer->used = 0;
+			}
+		}
+		return true;
+	}
+
+	if (writer->used + size < writer->capacity)
+	{
+		memcpy(writer->buffer + writer->used, p, size);
+		writer->used += size;
+		return true;
+	}
+
+	const uint8* pieces[2] = { writer->buffer, p };
+	uint64 sizes[2] = { writer->used, size };
+	writer->used = 0;
+	return _writePieces(writer, pieces, sizes, 2);
+}
+
+bool closeFileWriter(FileWriter* writer)
+{
+	bool success = true;
+	if (writer->used > 0 && writer->buffer)
+	{
+		const uint8* pieces[2] = { writer->buffer, 0 };
+		uint64 sizes[2] = { writer->used, 0 };
+
+#if !defined(_WIN32) && defined(O_DIRECT)
+		// The last partial page can't be written directly so we write the
+		//    whole pages then turn direct writes off for the rest.
+		if (writer->direct)
+		{
+			uint64 aligned = writer->used / WRITER_ALIGNMENT * WRITER_ALIGNMENT;
+			sizes[0] = aligned;
+			pieces[1] = writer->buffer + aligned;
+			sizes[1] = writer->used - aligned;
+			success = _writePieces(writer, pieces, sizes, 1);
+			success = success && fcntl(writer->descriptor, F_SETFL, fcntl(writer->descriptor, F_GETFL) & ~O_DIRECT) == 0;
+			success = success && _writePieces(writer, pieces + 1, sizes + 1, 1);
+		}
+		else
+#endif
+		success = _writePieces(writer, pieces, sizes, 1);
+		writer->used = 0;
+	}
+
+#ifdef _WIN32
+	if (!writer->attached)
+		success = success && _chsize_s(writer->descriptor, writer->position) == 0;
+	success = _close(writer->descriptor) == 0 && success;
+#else
+	if (writer->preallocated)
+		success = success && ftruncate(writer->descriptor, writer->position) == 0;
+	success = close(writer->descriptor) == 0 && success;
+#endif
+
+	_freeAligned(writer->buffer);
+	writer->buffer = 0;
+	return success;
+}
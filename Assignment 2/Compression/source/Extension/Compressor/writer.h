@@ -0,0 +1,48 @@
+#ifndef COMPRESSOR_WRITER_H
+#define COMPRESSOR_WRITER_H
+
+#include <stdbool.h>
+#include "common.h"
+
+// Direct writes must start at, and be a multiple of, this many bytes and
+//    come from memory aligned to it too.
+#define WRITER_ALIGNMENT 4096
+#define DEFAULT_WRITER_BUFFER_MB 4
+
+// Output file writer for large outputs. Everything goes through a page
+//    aligned buffer, MBs rather than the KBs stdio uses, and data that
+//    doesn't fit in what's left of it is written along with the buffer in
+//    a single writev rather than being copied. With direct the page cache
+//    is bypassed (O_DIRECT) so a multi GB output we won't read again
+//    doesn't push everything else out of memory.
+typedef struct
+{
+	int descriptor;
+	uint8* buffer;
+	uint64 capacity;
+	uint64 used;
+	// Where the end of the data written so far is in the file.
+	uint64 position;
+	bool direct;
+	bool preallocated;
+	bool attached;
+} FileWriter;
+
+// Opens path and starts writing at offset, truncating the file when offset
+//    is 0. If expectedSize isn't 0 that much space is reserved up front. direct
+//    is ignored where O_DIRECT isn't available or offset isn't aligned.
+//    Returns false if the file couldn't be opened.
+bool openFileWriter(FileWriter* writer, const char* path, uint64 offset, uint64 bufferSize, bool direct, uint64 expectedSize);
+
+// Writes to a descriptor that is already open, from wherever it is now.
+//    Nothing is reserved and the file is never trimmed, position counts the
+//    bytes written.
+bool attachFileWriter(FileWriter* writer, int descriptor, uint64 bufferSize);
+
+bool writeFileWriter(FileWriter* writer, const void* data, uint64 size);
+
+// Writes whatever is left in the buffer, trims any space reserved but not
+//    used and closes the file.
+bool closeFileWriter(FileWriter* writer);
+
+#endif
@@ -0,0 +1,357 @@
+#pragma once
+#include "common.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// x1, y1, x2, y2
+typedef double (*DistanceFunction2D)(double, double, double, double);
+//x1, y1, z1, x2, y2, z2
+typedef double (*DistanceFunction3D)(double, double, double, double, double, double);
+
+// Nearest Integer
+inline double nint(double value)
+{
+	return ((int64)value + 0.5);
+}
+
+// Distance functions follow the TSPLIB format specification which I
+//    can't link because of Unicode characters but will include in
+//    the documentation. We support the majority of functions.
+// TODO: Add EXPLICIT, CEIL_2D
+inline double euclideanDistance2D(double x1, double y1, double x2, double y2)
+{
+	double dx = x1 - x2;
+	double dy = y1 - y2;
+	return sqrt(dx * dx + dy * dy);
+}
+
+inline double euclideanDistance3D(double x1, double y1, double z1, double x2, double y2, double z2)
+{
+	double dx = x1 - x2;
+	double dy = y1 - y2;
+	double dz = z1 - z2;
+	return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+inline double manhattenDistance2D(double x1, double y1, double x2, double y2)
+{
+	double dx = abs(x1 - x2);
+	double dy = abs(y1 - y2);
+	return nint(dx + dy);
+}
+
+inline double manhattenDistance3D(double x1, double y1, double z1, double x2, double y2, double z2)
+{
+	double dx = abs(x1 - x2);
+	double dy = abs(y1 - y2);
+	double dz = abs(z1 - z2);
+	return nint(dx + dy + dz);
+}
+
+inline double maximumDistance2D(double x1, double y1, double x2, double y2)
+{
+	double dx = nint(abs(x1 - x2));
+	double dy = nint(abs(y1 - y2));
+	return (dx > dy) ? dx : dy;
+}
+
+inline double maximumDistance3D(double x1, double y1, double z1, double x2, double y2, double z2)
+{
+	double dx = nint(abs(x1 - x2));
+	double dy = nint(abs(y1 - y2));
+	double dz = nint(abs(z1 - z2));
+	return (dx > dy) ?
+		(dx > dz ? dx : dz) :
+		(dy > dz ? dy : dz);
+}
+
+
+inline double geographicalDistance(double latitude1, double longitude1, double latitude2, double longitude2)
+{
+	// The TSPLIB docs use a different value for pi from c++ which we will have to use
+	//    to be able to verify our solutions against theirs.
+	const double PI = 3.141592;
+
+	// Convert the latitudes and longitudes from degrees.minutes to radians 
+	double coords[4] = { latitude1, longitude1, latitude2, longitude2 };
+	double radianCoords[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		double deg = nint(coords[i]);
+		double min = coords[i] - deg;
+		radianCoords[i] = PI * (deg + 5.0 * min / 3.0) / 180.0;
+	}
+
+	// This is the radius of the earth as an idealized sphere in km
+	double ERE = 6378.388;
+
+	// Cos of the difference in longitude
+	double q1 = cos(radianCoords[1] - radianCoords[3]);
+	// Cos of the difference in latitude
+	double q2 = cos(radianCoords[0] - radianCoords[2]);
+	// Cos of the sum of latitudes
+	double q3 = cos(radianCoords[0] + radianCoords[2]);
+
+	//                                            _  (")  _
+	// Then somehow convert that to a distance...  \/| |\/
+	return ((int)ERE * acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) + 1.0);
+}
+
+inline double pseudoEuclidianDistance2D(double x1, double y1, double x2, double y2)
+{
+	double dx = x1 - x2;
+	double dy = y1 - y2;
+	double distance = sqrt((dx * dx + dy * dy) / 10.0);
+	// This appears to just be ceil but in case I am missing something
+	//    I will implement it as described...
+	double rDist = nint(distance);
+	return distance > rDist ? rDist + 1 : rDist;
+}
+
+// Non-owning views of a TSPDistances' storage, one type for each layout,
+//    element type and metric. The solvers are templated on them so every
+//    distance lookup is inlined rather than going through the switches in
+//    TSPDistances::operator(). Each is only valid as long as the
+//    TSPDistances it came from.
+template<typename T> struct TSPFullView
+{
+	const T* data;
+	uint64 width;
+	double operator()(uint64 i, uint64 j) const { return data[i * width + j]; }
+	uint64 getWidth() const { return width; }
+};
+
+template<typename T> struct TSPTriangularView
+{
+	const T* data;
+	uint64 width;
+	double operator()(uint64 i, uint64 j) const
+	{
+		if (i == j)
+			return 0;
+		if (i > j)
+			std::swap(i, j);
+		return data[j * (j - 1) / 2 + i];
+	}
+	uint64 getWidth() const { return width; }
+};
+
+template<DistanceFunction2D Metric> struct TSPCoordinate2DView
+{
+	const double* coords;
+	uint64 width;
+	double operator()(uint64 i, uint64 j) const
+	{
+		return i == j ? 0 : Metric(coords[i * 2], coords[i * 2 + 1], coords[j * 2], coords[j * 2 + 1]);
+	}
+	uint64 getWidth() const { return width; }
+};
+
+template<DistanceFunction3D Metric> struct TSPCoordinate3DView
+{
+	const double* coords;
+	uint64 width;
+	double operator()(uint64 i, uint64 j) const
+	{
+		return i == j ? 0 : Metric(coords[i * 3], coords[i * 3 + 1], coords[i * 3 + 2], coords[j * 3], coords[j * 3 + 1], coords[j * 3 + 2]);
+	}
+	uint64 getWidth() const { return width; }
+};
+
+// Every view visit can pass on, for instantiating whatever takes them.
+//    TSPDistances itself is the fallback for a metric that has no view.
+#define TSP_DISTANCE_VIEWS(X) \
+	X(TSPFullView<double>) X(TSPFullView<float>) X(TSPFullView<int32>) \
+	X(TSPTriangularView<double>) X(TSPTriangularView<float>) X(TSPTriangularView<int32>) \
+	X(TSPCoordinate2DView<euclideanDistance2D>) X(TSPCoordinate2DView<manhattenDistance2D>) \
+	X(TSPCoordinate2DView<maximumDistance2D>) X(TSPCoordinate2DView<geographicalDistance>) \
+	X(TSPCoordinate2DView<pseudoEuclidianDistance2D>) X(TSPCoordinate3DView<euclideanDistance3D>) \
+	X(TSPCoordinate3DView<manhattenDistance3D>) X(TSPCoordinate3DView<maximumDistance3D>) \
+	X(TSPDistances)
+
+// How the distances are laid out in memory, chosen when the matrix is loaded.
+enum TSPStorageLayout : uint8
+{
+	// Every distance row by row, width * width elements.
+	TSP_LAYOUT_FULL,
+	// Only the distances above the diagonal, width * (width - 1) / 2
+	//    elements. Every metric we load is symmetric so the rest are
+	//    duplicates and the diagonal is always 0.
+	TSP_LAYOUT_TRIANGULAR,
+	// No distances at all, only the coordinates they're computed from
+	//    when they're asked for. Only for TSPMatrix2D and TSPMatrix3D.
+	TSP_LAYOUT_COORDINATES
+};
+
+// What each distance is stored as. Most TSPLIB metrics are rounded to
+//    integers anyway, int32 rounds every distance to the nearest one.
+enum TSPElementType : uint8
+{
+	TSP_ELEMENT_DOUBLE,
+	TSP_ELEMENT_FLOAT,
+	TSP_ELEMENT_INT32
+};
+
+// The distances between every pair of nodes in whichever layout and element
+//    type were asked for, this is what the solvers read distances through.
+class TSPDistances
+{
+	uint64 width;
+	TSPStorageLayout layout;
+	TSPElementType elementType;
+	// Only the one for elementType is ever used.
+	std::vector<double> doubles;
+	std::vector<float> floats;
+	std::vector<int32> ints;
+	// Only for TSP_LAYOUT_COORDINATES, x, y (and z) of each node and the
+	//    metric which is whichever of the two isn't 0.
+	std::vector<double> coords;
+	DistanceFunction2D distanceFunction2D = 0;
+	DistanceFunction3D distanceFunction3D = 0;
+
+	double _computeDistance(uint64 i, uint64 j) const
+	{
+		if (distanceFunction2D)
+			return distanceFunction2D(coords[i * 2], coords[i * 2 + 1], coords[j * 2], coords[j * 2 + 1]);
+		return distanceFunction3D(coords[i * 3], coords[i * 3 + 1], coords[i * 3 + 2], coords[j * 3], coords[j * 3 + 1], coords[j * 3 + 2]);
+	}
+
+	// The triangle is stored column by column, so column j is the j
+	//    distances from the nodes before it and it starts at j(j-1)/2.
+	uint64 _index(uint64 i, uint64 j) const
+	{
+		if (layout == TSP_LAYOUT_FULL)
+			return i * width + j;
+		if (i > j)
+			std::swap(i, j);
+		return j * (j - 1) / 2 + i;
+	}
+
+	static void _store(double& element, double distance) { element = distance; }
+	static void _store(float& element, double distance) { element = (float)distance; }
+	static void _store(int32& element, double distance) { element = (int32)std::lround(distance); }
+
+	// In the triangle each j is part of column j, which is contiguous. The
+	//    full matrix has them in rows j and again in rows i, which are
+	//    written a row at a time too rather than down the columns.
+	template<typename T> void _setTile(T* data, uint64 j0, uint64 j1, uint64 i0, uint64 i1, const double* tile, uint64 stride)
+	{
+		for (uint64 j = j0; j < j1; ++j)
+		{
+			T* row = (layout == TSP_LAYOUT_TRIANGULAR) ? data + j * (j - 1) / 2 : data + j * width;
+			for (uint64 i = i0; i < std::min(i1, j); ++i)
+				_store(row[i], tile[(j - j0) * stride + i - i0]);
+		}
+		if (layout == TSP_LAYOUT_TRIANGULAR)
+			return;
+		for (uint64 i = i0; i < i1; ++i)
+			for (uint64 j = std::max(j0, i + 1); j < j1; ++j)
+				data[i * width + j] = data[j * width + i];
+	}
+
+public:
+	// Distances computed from coords when they're asked for, stride is
+	//    2 or 3 and only that dimension's distance function is used.
+	TSPDistances(std::vector<double> coords, uint8 stride, DistanceFunction2D distanceFunction2D, DistanceFunction3D distanceFunction3D)
+		: width(coords.size() / stride), layout(TSP_LAYOUT_COORDINATES), elementType(TSP_ELEMENT_DOUBLE), coords(std::move(coords)),
+		distanceFunction2D(stride == 2 ? distanceFunction2D : 0), distanceFunction3D(stride == 3 ? distanceFunction3D : 0)
+	{
+	}
+
+	TSPDistances(uint64 width = 0, TSPStorageLayout layout = TSP_LAYOUT_FULL, TSPElementType elementType = TSP_ELEMENT_DOUBLE)
+		: width(width), layout(layout), elementType(elementType)
+	{
+		uint64 count = layout == TSP_LAYOUT_FULL ? width * width : width * (width - (width > 0)) / 2;
+		// We may catch the possible exception thrown here somewhere
+		//    else or we may just let the program terminate...
+		if (elementType == TSP_ELEMENT_DOUBLE)
+			doubles = std::vector<double>(count);
+		else if (elementType == TSP_ELEMENT_FLOAT)
+			floats = std::vector<float>(count);
+		else
+			ints = std::vector<int32>(count);
+	}
+
+	double operator()(uint64 i, uint64 j) const
+	{
+		if (i == j && layout != TSP_LAYOUT_FULL)
+			return 0;
+		if (layout == TSP_LAYOUT_COORDINATES)
+			return _computeDistance(i, j);
+		uint64 n = _index(i, j);
+		if (elementType == TSP_ELEMENT_DOUBLE)
+			return doubles[n];
+		if (elementType == TSP_ELEMENT_FLOAT)
+			return floats[n];
+		return ints[n];
+	}
+
+	// Sets the distance from i to j only, in the triangle that's both ways.
+	void setDirected(uint64 i, uint64 j, double distance)
+	{
+		uint64 n = _index(i, j);
+		if (elementType == TSP_ELEMENT_DOUBLE)
+			_store(doubles[n], distance);
+		else if (elementType == TSP_ELEMENT_FLOAT)
+			_store(floats[n], distance);
+		else
+			_store(ints[n], distance);
+	}
+
+	// Sets the distances, both ways, between each node j from j0 to j1 - 1
+	//    and the nodes from i0 to i1 - 1 that come before it. The ones for
+	//    j are in the row of tile starting at (j - j0) * stride. Tiles with
+	//    different js can be set from different threads at once.
+	void setTile(uint64 j0, uint64 j1, uint64 i0, uint64 i1, const double* tile, uint64 stride)
+	{
+		if (elementType == TSP_ELEMENT_DOUBLE)
+			_setTile(doubles.data(), j0, j1, i0, i1, tile, stride);
+		else if (elementType == TSP_ELEMENT_FLOAT)
+			_setTile(floats.data(), j0, j1, i0, i1, tile, stride);
+		else
+			_setTile(ints.data(), j0, j1, i0, i1, tile, stride);
+	}
+
+	// Sets the distance both ways, i and j must be different.
+	void set(uint64 i, uint64 j, double distance)
+	{
+		setDirected(i, j, distance);
+		if (layout == TSP_LAYOUT_FULL)
+			setDirected(j, i, distance);
+	}
+
+	// Calls function with the view of these distances that matches their
+	//    layout, element type and metric and returns what it returns.
+	template<typename Function> auto visit(Function function) const
+	{
+		if (layout == TSP_LAYOUT_COORDINATES)
+		{
+			const double* c = coords.data();
+			if (distanceFunction2D == euclideanDistance2D) return function(TSPCoordinate2DView<euclideanDistance2D>{ c, width });
+			if (distanceFunction2D == manhattenDistance2D) return function(TSPCoordinate2DView<manhattenDistance2D>{ c, width });
+			if (distanceFunction2D == maximumDistance2D) return function(TSPCoordinate2DView<maximumDistance2D>{ c, width });
+			if (distanceFunction2D == geographicalDistance) return function(TSPCoordinate2DView<geographicalDistance>{ c, width });
+			if (distanceFunction2D == pseudoEuclidianDistance2D) return function(TSPCoordinate2DView<pseudoEuclidianDistance2D>{ c, width });
+			if (distanceFunction3D == euclideanDistance3D) return function(TSPCoordinate3DView<euclideanDistance3D>{ c, width });
+			if (distanceFunction3D == manhattenDistance3D) return function(TSPCoordinate3DView<manhattenDistance3D>{ c, width });
+			if (distanceFunction3D == maximumDistance3D) return function(TSPCoordinate3DView<maximumDistance3D>{ c, width });
+			return function(*this);
+		}
+
+		bool full = layout == TSP_LAYOUT_FULL;
+		if (elementType == TSP_ELEMENT_DOUBLE)
+			return full ? function(TSPFullView<double>{ doubles.data(), width }) : function(TSPTriangularView<double>{ doubles.data(), width });
+		if (elementType == TSP_ELEMENT_FLOAT)
+			return full ? function(TSPFullView<float>{ floats.data(), width }) : function(TSPTriangularView<float>{ floats.data(), width });
+		return full ? function(TSPFullView<int32>{ ints.data(), width }) : function(TSPTriangularView<int32>{ ints.data(), width });
+	}
+
+	uint64 getWidth() const { return width; };
+	TSPStorageLayout getLayout() const { return layout; };
+	TSPElementType getElementType() const { return elementType; };
+	uint64 getSizeInBytes() const
+	{
+		return (doubles.size() + coords.size()) * sizeof(double) + floats.size() * sizeof(float) + ints.size() * sizeof(int32);
+	};
+};
@@ -6,6 +6,121 @@
 #include <string>
 #include <unordered_map>
 #include <algorithm>
+#include <thread>
+#include <atomic>
+#include <charconv>
+#include <string_view>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// SIMD for building the matrix. Built with AVX (/arch:AVX or -mavx) 4
+//    distances are computed at a time, otherwise on x64 SSE2, which every
+//    x64 processor has, does 2 and anywhere else it's 1 at a time. Every
+//    operation here is exact so the distances are the same as the scalar
+//    distance functions' whichever it is.
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_WIDTH 4
+typedef __m256d SimdDouble;
+inline SimdDouble simdSet(double value) { return _mm256_set1_pd(value); }
+inline SimdDouble simdLoad(const double* p) { return _mm256_loadu_pd(p); }
+inline void simdStore(double* p, SimdDouble v) { _mm256_storeu_pd(p, v); }
+inline SimdDouble simdAdd(SimdDouble a, SimdDouble b) { return _mm256_add_pd(a, b); }
+inline SimdDouble simdSub(SimdDouble a, SimdDouble b) { return _mm256_sub_pd(a, b); }
+inline SimdDouble simdMul(SimdDouble a, SimdDouble b) { return _mm256_mul_pd(a, b); }
+inline SimdDouble simdDiv(SimdDouble a, SimdDouble b) { return _mm256_div_pd(a, b); }
+inline SimdDouble simdSqrt(SimdDouble v) { return _mm256_sqrt_pd(v); }
+inline SimdDouble simdMax(SimdDouble a, SimdDouble b) { return _mm256_max_pd(a, b); }
+inline SimdDouble simdAbs(SimdDouble v) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), v); }
+inline SimdDouble simdTrunc(SimdDouble v) { return _mm256_round_pd(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC); }
+// a > b ? ifGreater : otherwise
+inline SimdDouble simdSelectGreater(SimdDouble a, SimdDouble b, SimdDouble ifGreater, SimdDouble otherwise)
+{
+	return _mm256_blendv_pd(otherwise, ifGreater, _mm256_cmp_pd(a, b, _CMP_GT_OQ));
+}
+#elif defined(_M_X64) || defined(__x86_64__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 2
+typedef __m128d SimdDouble;
+inline SimdDouble simdSet(double value) { return _mm_set1_pd(value); }
+inline SimdDouble simdLoad(const double* p) { return _mm_loadu_pd(p); }
+inline void simdStore(double* p, SimdDouble v) { _mm_storeu_pd(p, v); }
+inline SimdDouble simdAdd(SimdDouble a, SimdDouble b) { return _mm_add_pd(a, b); }
+inline SimdDouble simdSub(SimdDouble a, SimdDouble b) { return _mm_sub_pd(a, b); }
+inline SimdDouble simdMul(SimdDouble a, SimdDouble b) { return _mm_mul_pd(a, b); }
+inline SimdDouble simdDiv(SimdDouble a, SimdDouble b) { return _mm_div_pd(a, b); }
+inline SimdDouble simdSqrt(SimdDouble v) { return _mm_sqrt_pd(v); }
+inline SimdDouble simdMax(SimdDouble a, SimdDouble b) { return _mm_max_pd(a, b); }
+inline SimdDouble simdAbs(SimdDouble v) { return _mm_andnot_pd(_mm_set1_pd(-0.0), v); }
+// SSE2 has no truncate. Adding and taking away 2^52 rounds |v| to the
+//    nearest integer, which is 1 too many if it rounded up, anything
+//    that large is already an integer.
+inline SimdDouble simdTrunc(SimdDouble v)
+{
+	const SimdDouble sign = _mm_set1_pd(-0.0), large = _mm_set1_pd(4503599627370496.0);
+	SimdDouble magnitude = _mm_andnot_pd(sign, v);
+	SimdDouble rounded = _mm_sub_pd(_mm_add_pd(magnitude, large), large);
+	rounded = _mm_sub_pd(rounded, _mm_and_pd(_mm_cmpgt_pd(rounded, magnitude), _mm_set1_pd(1.0)));
+	rounded = _mm_or_pd(rounded, _mm_and_pd(sign, v));
+	SimdDouble isLarge = _mm_cmpge_pd(magnitude, large);
+	return _mm_or_pd(_mm_and_pd(isLarge, v), _mm_andnot_pd(isLarge, rounded));
+}
+inline SimdDouble simdSelectGreater(SimdDouble a, SimdDouble b, SimdDouble ifGreater, SimdDouble otherwise)
+{
+	SimdDouble greater = _mm_cmpgt_pd(a, b);
+	return _mm_or_pd(_mm_and_pd(greater, ifGreater), _mm_andnot_pd(greater, otherwise));
+}
+#else
+#define SIMD_WIDTH 1
+typedef double SimdDouble;
+inline double simdSet(double value) { return value; }
+inline double simdLoad(const double* p) { return *p; }
+inline void simdStore(double* p, double v) { *p = v; }
+#endif
+
+// The same operations one at a time, for whatever is left over at the end
+//    of a row, so the metrics below only need writing once.
+inline double simdAdd(double a, double b) { return a + b; }
+inline double simdSub(double a, double b) { return a - b; }
+inline double simdMul(double a, double b) { return a * b; }
+inline double simdDiv(double a, double b) { return a / b; }
+inline double simdSqrt(double v) { return sqrt(v); }
+inline double simdMax(double a, double b) { return (a > b) ? a : b; }
+inline double simdAbs(double v) { return fabs(v); }
+inline double simdTrunc(double v) { return (double)(int64)v; }
+inline double simdSelectGreater(double a, double b, double ifGreater, double otherwise) { return a > b ? ifGreater : otherwise; }
+template<typename V> V simdConstant(double value, V) { return simdSet(value); }
+inline double simdConstant(double value, double) { return value; }
+template<typename V> V simdNint(V v) { return simdAdd(simdTrunc(v), simdConstant(0.5, v)); }
+
+// The distance functions with SIMD versions, dx, dy and dz are the first
+//    node's coordinates take the second's like the scalar functions do.
+auto euclideanMetric2D = [](auto dx, auto dy, auto) { return simdSqrt(simdAdd(simdMul(dx, dx), simdMul(dy, dy))); };
+auto euclideanMetric3D = [](auto dx, auto dy, auto dz) { return simdSqrt(simdAdd(simdAdd(simdMul(dx, dx), simdMul(dy, dy)), simdMul(dz, dz))); };
+auto manhattenMetric2D = [](auto dx, auto dy, auto) { return simdNint(simdAdd(simdAbs(dx), simdAbs(dy))); };
+auto manhattenMetric3D = [](auto dx, auto dy, auto dz) { return simdNint(simdAdd(simdAdd(simdAbs(dx), simdAbs(dy)), simdAbs(dz))); };
+auto maximumMetric2D = [](auto dx, auto dy, auto) { return simdMax(simdNint(simdAbs(dx)), simdNint(simdAbs(dy))); };
+auto maximumMetric3D = [](auto dx, auto dy, auto dz) { return simdMax(simdMax(simdNint(simdAbs(dx)), simdNint(simdAbs(dy))), simdNint(simdAbs(dz))); };
+auto pseudoEuclidianMetric2D = [](auto dx, auto dy, auto)
+{
+	auto distance = simdSqrt(simdDiv(simdAdd(simdMul(dx, dx), simdMul(dy, dy)), simdConstant(10.0, dx)));
+	auto rDist = simdNint(distance);
+	return simdSelectGreater(distance, rDist, simdAdd(rDist, simdConstant(1.0, dx)), rDist);
+};
+
+// Distances are computed a MATRIX_TILE_SIZE square tile at a time, small
+//    enough that mirroring it in a full matrix stays in cache.
+#define MATRIX_TILE_SIZE 128
 
 // The labels here and below are horribly inconsistant in the TSPLIB
 //    spec with the data having different values sometimes so I have
@@ -51,294 +166,308 @@ const std::unordered_map<std::string, DistanceFunction3D> TSPLIB_FUN_MAP3D =
 	{"MAX_3D", maximumDistance3D}
 };
 
-// Nearest Integer
-double nint(double value)
+// The whole of a TSPLIB file, mapped rather than read through a stream so
+//    the parser can run straight over the bytes. A filepath of "-" reads
+//    all of stdin instead, which can't be mapped.
+class TSPInput
 {
-	return ((int64)value + 0.5);
-}
+	const char* data = 0;
+	uint64 size = 0;
+	std::vector<char> buffer;
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = 0;
+#else
+	int file = -1;
+#endif
+
+	void _close()
+	{
+#ifdef _WIN32
+		if (data && buffer.empty()) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		file = INVALID_HANDLE_VALUE;
+		mapping = 0;
+#else
+		if (data && buffer.empty()) munmap((void*)data, size);
+		if (file != -1) close(file);
+		file = -1;
+#endif
+		data = 0;
+	}
 
-// Distance functions follow the TSPLIB format specification which I
-//    can't link because of Unicode characters but will include in
-//    the documentation. We support the majority of functions.
-// TODO: Add EXPLICIT, CEIL_2D
-double euclideanDistance2D(double x1, double y1, double x2, double y2)
-{
-	double dx = x1 - x2;
-	double dy = y1 - y2;
-	return sqrt(dx * dx + dy * dy);
-}
+public:
+	TSPInput(const char* filepath)
+	{
+		if (strcmp(filepath, "-") == 0)
+		{
+			char chunk[1 << 16];
+			for (size_t read = fread(chunk, 1, sizeof(chunk), stdin); read > 0; read = fread(chunk, 1, sizeof(chunk), stdin))
+				buffer.insert(buffer.end(), chunk, chunk + read);
+			if (ferror(stdin))
+				throw std::runtime_error("Could not read stdin");
+			data = buffer.data();
+			size = buffer.size();
+			return;
+		}
 
-double euclideanDistance3D(double x1, double y1, double z1, double x2, double y2, double z2)
-{
-	double dx = x1 - x2;
-	double dy = y1 - y2;
-	double dz = z1 - z2;
-	return sqrt(dx * dx + dy * dy + dz * dz);
-}
+#ifdef _WIN32
+		file = CreateFileA(filepath, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+		if (file == INVALID_HANDLE_VALUE)
+			throw std::runtime_error(std::string("Could not open file: ").append(filepath));
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize))
+		{
+			_close();
+			throw std::runtime_error(std::string("Could not open file: ").append(filepath));
+		}
+		size = fileSize.QuadPart;
+		// Empty files can't be mapped, there's nothing to parse anyway.
+		if (size == 0) return;
+		mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		if (mapping) data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		file = open(filepath, O_RDONLY);
+		if (file == -1)
+			throw std::runtime_error(std::string("Could not open file: ").append(filepath));
+		struct stat info;
+		if (fstat(file, &info) != 0)
+		{
+			_close();
+			throw std::runtime_error(std::string("Could not open file: ").append(filepath));
+		}
+		size = info.st_size;
+		if (size == 0) return;
+		void* mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapped != MAP_FAILED)
+		{
+			madvise(mapped, size, MADV_SEQUENTIAL);
+			data = (const char*)mapped;
+		}
+#endif
+		if (!data)
+		{
+			_close();
+			throw std::runtime_error(std::string("Could not map file: ").append(filepath));
+		}
+	}
+	~TSPInput() { _close(); }
+	TSPInput(const TSPInput&) = delete;
+	TSPInput& operator=(const TSPInput&) = delete;
+
+	const char* begin() const { return data; }
+	const char* end() const { return data + size; }
+};
 
-double manhattenDistance2D(double x1, double y1, double x2, double y2)
+// The scanning functions below all move p along the input and stop at end,
+//    none of them go past the end of the line they're on unless they say
+//    so. '\r' is a blank so Windows line endings need nothing special.
+inline bool isBlank(char c)
 {
-	double dx = abs(x1 - x2);
-	double dy = abs(y1 - y2);
-	return nint(dx + dy);
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
 }
 
-double manhattenDistance3D(double x1, double y1, double z1, double x2, double y2, double z2)
+inline void skipBlanks(const char*& p, const char* end)
 {
-	double dx = abs(x1 - x2);
-	double dy = abs(y1 - y2);
-	double dz = abs(z1 - z2);
-	return nint(dx + dy + dz);
+	while (p < end && isBlank(*p)) ++p;
 }
 
-double maximumDistance2D(double x1, double y1, double x2, double y2)
+// Moves p to the start of the next line.
+inline void skipLine(const char*& p, const char* end)
 {
-	double dx = nint(abs(x1 - x2));
-	double dy = nint(abs(y1 - y2));
-	return (dx > dy) ? dx : dy;
+	if (p >= end) return;
+	const char* newline = (const char*)memchr(p, '\n', size_t(end - p));
+	p = newline ? newline + 1 : end;
 }
 
-double maximumDistance3D(double x1, double y1, double z1, double x2, double y2, double z2)
+// The next run of characters up to a blank, the end of the line or, when
+//    isKey, a ':'.
+inline std::string_view nextToken(const char*& p, const char* end, bool isKey = false)
 {
-	double dx = nint(abs(x1 - x2));
-	double dy = nint(abs(y1 - y2));
-	double dz = nint(abs(z1 - z2));
-	return (dx > dy) ?
-		(dx > dz ? dx : dz) :
-		(dy > dz ? dy : dz);
+	skipBlanks(p, end);
+	const char* start = p;
+	while (p < end && *p != '\n' && !isBlank(*p) && !(isKey && *p == ':')) ++p;
+	return std::string_view(start, p - start);
 }
 
-
-double geographicalDistance(double latitude1, double longitude1, double latitude2, double longitude2)
+// The rest of the line without the blanks either side.
+inline std::string_view restOfLine(const char*& p, const char* end)
 {
-	// The TSPLIB docs use a different value for pi from c++ which we will have to use
-	//    to be able to verify our solutions against theirs.
-	static double PI = 3.141592;
-
-	// Convert the latitudes and longitudes from degrees.minutes to radians 
-	double coords[4] = { latitude1, longitude1, latitude2, longitude2 };
-	double radianCoords[4];
-	for (int i = 0; i < 4; ++i)
-	{
-		double deg = nint(coords[i]);
-		double min = coords[i] - deg;
-		radianCoords[i] = PI * (deg + 5.0 * min / 3.0) / 180.0;
-	}
-
-	// This is the radius of the earth as an idealized sphere in km
-	double ERE = 6378.388;
-
-	// Cos of the difference in longitude
-	double q1 = cos(radianCoords[1] - radianCoords[3]);
-	// Cos of the difference in latitude
-	double q2 = cos(radianCoords[0] - radianCoords[2]);
-	// Cos of the sum of latitudes
-	double q3 = cos(radianCoords[0] + radianCoords[2]);
-
-	//                                            _  (")  _
-	// Then somehow convert that to a distance...  \/| |\/
-	return ((int)ERE * acos(0.5 * ((1.0 + q1) * q2 - (1.0 - q1) * q3)) + 1.0);
+	skipBlanks(p, end);
+	const char* start = p;
+	skipLine(p, end);
+	const char* last = p;
+	while (last > start && (last[-1] == '\n' || isBlank(last[-1]))) --last;
+	return std::string_view(start, last - start);
 }
 
-double pseudoEuclidianDistance2D(double x1, double y1, double x2, double y2)
+// Parses the next number on the line into value, false if there isn't one.
+template<typename T> bool parseNumber(const char*& p, const char* end, T& value)
 {
-	double dx = x1 - x2;
-	double dy = y1 - y2;
-	double distance = sqrt((dx * dx + dy * dy) / 10.0);
-	// This appears to just be ceil but in case I am missing something
-	//    I will implement it as described...
-	double rDist = nint(distance);
-	return distance > rDist ? rDist + 1 : rDist;
+	skipBlanks(p, end);
+	if (p < end && *p == '+') ++p;
+	auto result = std::from_chars(p, end, value);
+	if (result.ec != std::errc()) return false;
+	p = result.ptr;
+	return true;
 }
 
-TSPMatrix createTSPMatrix(const char* filepath)
+TSPMatrix createTSPMatrix(const char* filepath, TSPStorageLayout layout, TSPElementType elementType)
 {
-	std::string line;
-	std::ifstream file(filepath, std::ios::in);
-	if (!file.is_open())
-		throw std::runtime_error(std::string("Could not open file: ").append(filepath));
-
-
-	// Parse Specification
+	TSPInput input(filepath);
+	if (strcmp(filepath, "-") == 0)
+		filepath = "stdin";
+	const char* p = input.begin();
+	const char* end = input.end();
+
+	// Parse Specification, a "KEY : value" line at a time until the first
+	//    line that isn't one.
 	uint64 expectedNodeCount = 0;
 	DistanceFunction2D distanceFunction2D = 0;
 	DistanceFunction3D distanceFunction3D = 0;
 	bool firstComment = true;
 	bool explicitDistances = false;
-	for (std::getline(file, line); file.good(); std::getline(file, line))
+	while (p < end)
 	{
-		bool valid = false;
-		for (uint8 i = 0; i < TSPLIB_SPEC.size(); ++i)
+		const char* lineStart = p;
+		std::string_view key = nextToken(p, end, true);
+		if (key.empty())
 		{
-			size_t pos = line.find(TSPLIB_SPEC[i]);
-			if (pos == std::string::npos) continue;
-			valid = true;
-			pos = line.find(':', pos);
-			if (pos > line.length() - 1) throw std::runtime_error(std::string("Invalid TSPLIB specification: ").append(filepath));
-			std::string value = line.substr(pos + 1);
-			if (i == 0)
-			{
-				pos = value.find_first_not_of(" \t\r\v\f\n");
-				if (pos > line.length() - 1) throw std::runtime_error(std::string("Invalid TSPLIB specification: ").append(filepath));
-				std::cout << " TSP Problem Name: " << value.substr(pos) << std::endl;
-			}
-			else if (i == 7)
-			{
-				pos = line.find("TSP", pos + 1);
-				if (pos > line.length() - 1) throw std::runtime_error(std::string("Problems other than TSP are unsupported: ").append(filepath));
-			}
-			else if (i == 2)
-			{
-				pos = value.find_first_not_of(" \t\r\v\f\n");
-				if (pos > line.length() - 1) throw std::runtime_error(std::string("Invalid TSPLIB specification: ").append(filepath));
-				if (firstComment)
-				{
-					firstComment = false;
-					std::cout << " Comments:" << std::endl;
-				}
-				std::cout << " " << value.substr(pos) << std::endl;
-			}
-			else if (i == 3)
+			skipLine(p, end);
+			continue;
+		}
+		uint8 i = 0;
+		for (; i < TSPLIB_SPEC.size(); ++i)
+			if (key == TSPLIB_SPEC[i]) break;
+		if (i == TSPLIB_SPEC.size())
+		{
+			p = lineStart;
+			break;
+		}
+
+		skipBlanks(p, end);
+		if (p == end || *p != ':') throw std::runtime_error(std::string("Invalid TSPLIB specification: ").append(filepath));
+		++p;
+		std::string_view value = restOfLine(p, end);
+		if (value.empty() && i != 2) throw std::runtime_error(std::string("Invalid TSPLIB specification: ").append(filepath));
+
+		if (i == 0)
+		{
+			std::cout << " TSP Problem Name: " << value << std::endl;
+		}
+		else if (i == 7)
+		{
+			if (value.find("TSP") == std::string_view::npos) throw std::runtime_error(std::string("Problems other than TSP are unsupported: ").append(filepath));
+		}
+		else if (i == 2)
+		{
+			if (firstComment)
 			{
-				expectedNodeCount = std::stoull(value);
+				firstComment = false;
+				std::cout << " Comments:" << std::endl;
 			}
-			else if (i == 1)
+			std::cout << " " << value << std::endl;
+		}
+		else if (i == 3)
+		{
+			const char* number = value.data();
+			if (!parseNumber(number, value.data() + value.size(), expectedNodeCount))
+				throw std::runtime_error(std::string("Invalid TSPLIB specification: ").append(filepath));
+		}
+		else if (i == 1)
+		{
+			// Only done once per file so the std::string for the lookup is fine.
+			std::string type(value);
+			auto it = TSPLIB_FUN_MAP2D.find(type);
+			if (it == TSPLIB_FUN_MAP2D.end())
 			{
-				pos = value.find_first_not_of(" \t\r\v\f\n");
-				if (pos >= line.length() - 1) throw std::runtime_error(std::string("Invalid TSPLIB specification: ").append(filepath));
-			
-				auto it = TSPLIB_FUN_MAP2D.find(value.substr(pos));
-				if (it == TSPLIB_FUN_MAP2D.end())
-				{
-					auto it = TSPLIB_FUN_MAP3D.find(value.substr(pos));
-					if (it == TSPLIB_FUN_MAP3D.end())
-						if (value.substr(pos).find("EXPLICIT") != std::string::npos)
-							explicitDistances = true;
-						else
-							throw std::runtime_error(std::string("Unknown TSPLIB specification: ")
-								.append(filepath).append("\nUnknown EDGE_WEIGHT_TYPE: ").append(value.substr(pos)));
+				auto it = TSPLIB_FUN_MAP3D.find(type);
+				if (it == TSPLIB_FUN_MAP3D.end())
+					if (type.find("EXPLICIT") != std::string::npos)
+						explicitDistances = true;
 					else
-						distanceFunction3D = it->second;
-				}
+						throw std::runtime_error(std::string("Unknown TSPLIB specification: ")
+							.append(filepath).append("\nUnknown EDGE_WEIGHT_TYPE: ").append(type));
 				else
-					distanceFunction2D = it->second;
+					distanceFunction3D = it->second;
 			}
 			else
-			{
-				std::cout << " Ignoring TSP Specification Key: " << TSPLIB_SPEC[i] << std::endl;
-			}
-			break;
+				distanceFunction2D = it->second;
 		}
-
-		if (valid) continue;
-
-		if (distanceFunction2D == 0 && distanceFunction3D == 0 && !explicitDistances)
-			throw std::runtime_error(std::string("EDGE_WEIGHT_TYPE not specified in: ").append(filepath));
-
-		// Skip unused data sections until first NODE_COORD_SECTION or EDGE_WEIGHT_SECTION
-		uint8 index = explicitDistances ? 1 : 0;
-		for (; file.good(); std::getline(file, line))
+		else
 		{
-			size_t pos = line.find(TSPLIB_DATA[index]);
-			if (pos == std::string::npos) continue;
-			break;
+			std::cout << " Ignoring TSP Specification Key: " << TSPLIB_SPEC[i] << std::endl;
 		}
-		if (!file.good() || file.eof()) throw std::runtime_error(std::string("Node data missing from: ").append(filepath));
-
-		// If we get here we have processed the specification and the next line
-		//    is the start of the node data section
-		break;
 	}
 
-	// Parse the node data section
-	bool eofFound = false;
+	if (distanceFunction2D == 0 && distanceFunction3D == 0 && !explicitDistances)
+		throw std::runtime_error(std::string("EDGE_WEIGHT_TYPE not specified in: ").append(filepath));
+
+	// Skip unused data sections until first NODE_COORD_SECTION or EDGE_WEIGHT_SECTION
+	const std::string& section = TSPLIB_DATA[explicitDistances ? 1 : 0];
+	while (p < end && nextToken(p, end, true) != section)
+		skipLine(p, end);
+	if (p == end) throw std::runtime_error(std::string("Node data missing from: ").append(filepath));
+	skipLine(p, end);
+
+	// Parse the node data section, which ends at EOF, the next section or
+	//    the end of the input.
 	bool oOOIFlag = false; //Out Of Order Indices Flag
 	uint64 nodeCount = 0;
 	uint64 stride = explicitDistances ? expectedNodeCount : (distanceFunction3D == 0 ? 2 : 3);
-	uint64 expectedDistanceCount = explicitDistances ? 0 : expectedNodeCount * stride;
-	std::vector<double> coords(expectedDistanceCount);
+	std::vector<double> coords;
+	coords.reserve(expectedNodeCount * stride);
 
-	for (std::getline(file, line); file.good() && !file.eof() && !eofFound; std::getline(file, line))
+	if (explicitDistances)
 	{
-		if (line.find("EOF") != std::string::npos)
+		// Distances are whitespace separated, how they're split over lines
+		//    doesn't matter.
+		for (skipBlanks(p, end); p < end; skipBlanks(p, end))
 		{
-			eofFound = true;
-			break;
-		}
-
-		size_t pos = line.find_first_not_of(" \t\r\v\f\n");
-		if (pos == std::string::npos) continue; // <- Skip blank lines
-
-		if (explicitDistances)
-	{
-			if (line[pos] < 48 || line[pos] > 57)
+			if (*p == '\n')
 			{
-				eofFound = true;
-				break;
-			}
-			for (uint64 i = 0;pos < line.length(); ++i)
-			{
-				if (pos >= line.length()) break;
-				coords.push_back(stod(line.substr(pos)));
-				pos = line.find_first_of(" \t\r\v\f\n", pos);
-				if (pos != std::string::npos)
-					pos = line.find_first_not_of(" \t\r\v\f\n", pos);
+				++p;
+				continue;
 			}
+			if ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'))
+				break;
+			double distance;
+			if (!parseNumber(p, end, distance))
+				throw std::runtime_error(std::string("Invalid TSPLIB data, bad distance in file: ").append(filepath));
+			coords.push_back(distance);
 		}
-		else
+		nodeCount = stride;
+	}
+	else
+	{
+		const char* ordinals[] = { "1st", "2nd", "3rd" };
+		for (skipBlanks(p, end); p < end; skipLine(p, end), skipBlanks(p, end))
 		{
-			// Get index
-			uint64 index = std::stoull(line) - 1;
-
-			double x, y, z;
-			// Get x (first coord)
-			pos = line.find_first_of(" \t\r\v\f\n", pos);
-			if (pos != std::string::npos)
-				pos = line.find_first_not_of(" \t\r\v\f\n", pos);
+			if (*p == '\n') continue; // <- Skip blank lines
+			if (*p < '0' || *p > '9') break;
 
-			if (pos > line.length() - 1) throw std::runtime_error(std::string("Invalid TSPLIB data, missing 1st coordinate in file: ")
-				.append(filepath).append(" with index: ").append(std::to_string(index)));
-			x = stod(line.substr(pos));
-
-			// Get y (second coord)
-			pos = line.find_first_of(" \t\r\v\f\n", pos);
-			if (pos != std::string::npos)
-				pos = line.find_first_not_of(" \t\r\v\f\n", pos);
-
-			if (pos > line.length() - 1) throw std::runtime_error(std::string("Invalid TSPLIB data, missing 2nd coordinate in file: ")
-				.append(filepath).append(" with index: ").append(std::to_string(index)));
-			y = stod(line.substr(pos));
-
-			if (distanceFunction3D != 0)
-			{
-				// Get z (third coord)
-				pos = line.find_first_of(" \t\r\v\f\n", pos);
-				if (pos != std::string::npos)
-					pos = line.find_first_not_of(" \t\r\v\f\n", pos);
-
-				if (pos > line.length() - 1) throw std::runtime_error(std::string("Invalid TSPLIB data, missing 3rd coordinate in file: ")
-					.append(filepath).append(" with index: ").append(std::to_string(index)));
-				z = stod(line.substr(pos));
-			}
+			uint64 index;
+			if (!parseNumber(p, end, index) || index == 0)
+				throw std::runtime_error(std::string("Invalid TSPLIB data, bad node index in file: ").append(filepath));
+			--index;
 
 			if (!oOOIFlag && index != nodeCount)
 				oOOIFlag = true;
 
-			if (index * stride + 1 > coords.size())
+			if ((index + 1) * stride > coords.size())
 				coords.resize((index + 1) * stride);
 
-			coords[index * stride] = x;
-			coords[index * stride + 1] = y;
+			for (uint8 axis = 0; axis < stride; ++axis)
+			{
+				if (!parseNumber(p, end, coords[index * stride + axis]))
+					throw std::runtime_error(std::string("Invalid TSPLIB data, missing ").append(ordinals[axis]).append(" coordinate in file: ")
+						.append(filepath).append(" with index: ").append(std::to_string(index)));
+			}
+			++nodeCount;
 		}
-		++nodeCount;
-
 	}
 
-
-
-	if (!(eofFound || file.eof()))
-		throw std::runtime_error(std::string("There was an file stream error loading the file: ").append(filepath));
-
 	if (nodeCount < 1)
 		throw std::runtime_error(std::string("0 nodes were loaded from the file: ").append(filepath));
 
@@ -362,88 +491,205 @@ TSPMatrix createTSPMatrix(const char* filepath)
 	std::cout << " Successfully loaded: " << filepath << std::endl << std::endl;
 
 	if (explicitDistances)
-		return TSPMatrix(coords, stride);
+	{
+		if (layout == TSP_LAYOUT_COORDINATES)
+		{
+			std::cerr << " Warning: Explicit distances have no coordinates, storing the full matrix: " << filepath << std::endl;
+			layout = TSP_LAYOUT_FULL;
+		}
+		return TSPMatrix(coords, stride, layout, elementType);
+	}
 	if (stride == 2)
-		return TSPMatrix2D(coords, distanceFunction2D);
+		return TSPMatrix2D(coords, distanceFunction2D, layout, elementType);
 	else
-		return TSPMatrix3D(coords, distanceFunction3D);
+		return TSPMatrix3D(coords, distanceFunction3D, layout, elementType);
 }
 
 
-void TSPMatrix::_initializeMatrix(std::vector<double> coords, uint8 stride, std::function<void(uint64, double*, double*)> fun)
+// Computes the distances from node j to nodes i0 to i1 - 1 into row, axes
+//    are the x, y and z coordinates of every node each in their own array.
+template<uint8 Dimensions, typename Metric>
+void computeSimdRow(const double* const* axes, uint64 j, uint64 i0, uint64 i1, double* row, Metric metric)
 {
-	matrixWidth = coords.size() / stride;
-	// We may catch the possible exception thrown here somewhere
-	//    else or we may just let the program terminate...
-	matrix = std::vector<double>(matrixWidth * matrixWidth);
-
-	for (uint64 i = 0; i < matrixWidth; ++i)
+	SimdDouble x = simdSet(axes[0][j]), y = simdSet(axes[1][j]), z = simdSet(axes[2][j]);
+	uint64 i = i0;
+	for (; i + SIMD_WIDTH <= i1; i += SIMD_WIDTH)
 	{
-		for (uint64 j = 0; j < matrixWidth; ++j)
+		SimdDouble dx = simdSub(simdLoad(axes[0] + i), x);
+		SimdDouble dy = simdSub(simdLoad(axes[1] + i), y);
+		SimdDouble dz = Dimensions == 3 ? simdSub(simdLoad(axes[2] + i), z) : dx;
+		simdStore(row + (i - i0), metric(dx, dy, dz));
+	}
+	for (; i < i1; ++i)
+		row[i - i0] = metric(axes[0][i] - axes[0][j], axes[1][i] - axes[1][j], axes[2][i] - axes[2][j]);
+}
+
+// Fills in every distance below the diagonal, and so above it, on as many
+//    threads as there are processors. Each thread takes the next row of
+//    tiles, longest first so the short ones at the end even the threads
+//    out, and computeRow(j, i0, i1, row) computes each row of a tile.
+template<typename RowFunction> void buildDistances(TSPDistances& distances, RowFunction computeRow)
+{
+	uint64 width = distances.getWidth();
+	uint64 tileRows = (width + MATRIX_TILE_SIZE - 1) / MATRIX_TILE_SIZE;
+	std::atomic<uint64> next(0);
+	auto worker = [&]()
 		{
-			uint64 n = j + i * matrixWidth;
-			if (i == j)
-				matrix[n] = 0;
-			else
-				fun(n, &coords[i * stride], &coords[j * stride]);
-		}
+			std::vector<double> tile(MATRIX_TILE_SIZE * MATRIX_TILE_SIZE);
+			for (uint64 t = next++; t < tileRows; t = next++)
+			{
+				uint64 j0 = (tileRows - 1 - t) * MATRIX_TILE_SIZE;
+				uint64 j1 = std::min(j0 + MATRIX_TILE_SIZE, width);
+				for (uint64 i0 = 0; i0 < j1; i0 += MATRIX_TILE_SIZE)
+				{
+					uint64 i1 = std::min(i0 + MATRIX_TILE_SIZE, j1);
+					for (uint64 j = std::max(j0, i0 + 1); j < j1; ++j)
+						computeRow(j, i0, std::min(i1, j), &tile[(j - j0) * MATRIX_TILE_SIZE]);
+					distances.setTile(j0, j1, i0, i1, tile.data(), MATRIX_TILE_SIZE);
+				}
+			}
+		};
+
+	uint64 threadCount = std::min<uint64>(std::max(std::thread::hardware_concurrency(), 1u), std::max<uint64>(tileRows, 1));
+	std::vector<std::thread> threads;
+	for (uint64 i = 1; i < threadCount; ++i)
+		threads.emplace_back(worker);
+	worker();
+	for (auto& thread : threads)
+		thread.join();
+}
+
+void TSPMatrix::_initializeMatrix(const std::vector<double>& coords, uint8 stride, DistanceFunction2D distanceFunction2D,
+	DistanceFunction3D distanceFunction3D, TSPStorageLayout layout, TSPElementType elementType)
+{
+	uint64 width = coords.size() / stride;
+	distances = TSPDistances(width, layout, elementType);
+
+	// Coordinates are split into an array per axis so the SIMD metrics
+	//    can load several nodes' at once, 2D uses y again as z.
+	std::vector<double> soa(width * stride);
+	for (uint64 i = 0; i < width; ++i)
+		for (uint8 axis = 0; axis < stride; ++axis)
+			soa[axis * width + i] = coords[i * stride + axis];
+	const double* axes[3] = { soa.data(), soa.data() + width, soa.data() + (stride == 3 ? 2 : 1) * width };
+
+	// Every metric is symmetric so each pair is only computed once and
+	//    set both ways, the diagonal is already 0.
+	auto simd2D = [&](auto metric)
+		{
+			buildDistances(distances, [&](uint64 j, uint64 i0, uint64 i1, double* row) { computeSimdRow<2>(axes, j, i0, i1, row, metric); });
+		};
+	auto simd3D = [&](auto metric)
+		{
+			buildDistances(distances, [&](uint64 j, uint64 i0, uint64 i1, double* row) { computeSimdRow<3>(axes, j, i0, i1, row, metric); });
+		};
+	if (stride == 2 && distanceFunction2D == euclideanDistance2D)
+		simd2D(euclideanMetric2D);
+	else if (stride == 2 && distanceFunction2D == manhattenDistance2D)
+		simd2D(manhattenMetric2D);
+	else if (stride == 2 && distanceFunction2D == maximumDistance2D)
+		simd2D(maximumMetric2D);
+	else if (stride == 2 && distanceFunction2D == pseudoEuclidianDistance2D)
+		simd2D(pseudoEuclidianMetric2D);
+	else if (stride == 3 && distanceFunction3D == euclideanDistance3D)
+		simd3D(euclideanMetric3D);
+	else if (stride == 3 && distanceFunction3D == manhattenDistance3D)
+		simd3D(manhattenMetric3D);
+	else if (stride == 3 && distanceFunction3D == maximumDistance3D)
+		simd3D(maximumMetric3D);
+	else if (stride == 2)
+	{
+		// GEO, and anything else, is one distance at a time on every thread.
+		buildDistances(distances, [&](uint64 j, uint64 i0, uint64 i1, double* row)
+			{
+				for (uint64 i = i0; i < i1; ++i)
+					row[i - i0] = distanceFunction2D(axes[0][i], axes[1][i], axes[0][j], axes[1][j]);
+			});
+	}
+	else
+	{
+		buildDistances(distances, [&](uint64 j, uint64 i0, uint64 i1, double* row)
+			{
+				for (uint64 i = i0; i < i1; ++i)
+					row[i - i0] = distanceFunction3D(axes[0][i], axes[1][i], axes[2][i], axes[0][j], axes[1][j], axes[2][j]);
+			});
 	}
 }
 
-TSPMatrix::TSPMatrix(std::vector<double> distances, uint64 width)
+TSPMatrix::TSPMatrix(const std::vector<double>& matrix, uint64 width, TSPStorageLayout layout, TSPElementType elementType)
 {
 	// Although we could compute this, the caller should know
 	//    it so why waste the cycles.
-	if (distances.size() != width * width)
+	if (matrix.size() != width * width)
 		throw std::runtime_error("Provided distance matrix and width do not match!");
+	if (layout == TSP_LAYOUT_COORDINATES)
+		throw std::runtime_error("Explicit distance matrices have no coordinates to compute distances from!");
 
-	matrix = std::vector<double>(distances.size());
-	std::copy(distances.begin(), distances.end(), matrix.begin());
-
-	matrixWidth = width;
+	distances = TSPDistances(width, layout, elementType);
+	for (uint64 i = 0; i < width; ++i)
+	{
+		for (uint64 j = i + 1; j < width; ++j)
+		{
+			// Explicit matrices are the only ones that can be asymmetric,
+			//    the triangle can only hold one of the two.
+			if (layout == TSP_LAYOUT_TRIANGULAR && matrix[i * width + j] != matrix[j * width + i])
+				throw std::runtime_error("Asymmetric distance matrices can't be stored as a triangle!");
+			distances.setDirected(i, j, matrix[i * width + j]);
+			distances.setDirected(j, i, matrix[j * width + i]);
+		}
+	}
 }
 
 TSPMatrix::TSPMatrix()
 {
-	matrixWidth = 0;
 }
 
 TSPMatrix::~TSPMatrix()
 {
 }
 
+// The view of the distances is picked once here, rather than on every
+//    lookup, and the solver runs on it without copying anything.
 TSPPath TSPMatrix::solve(TSPSolveFunction solver)
 {
-	return solver(matrix, matrixWidth);
+	return distances.visit([&](const auto& view)
+		{
+			return solveTSP(solver, view);
+		});
 }
 
-TSPMatrix2D::TSPMatrix2D(std::vector<double> coords, DistanceFunction2D distanceFunction)
+TSPMatrix2D::TSPMatrix2D(std::vector<double> coords, DistanceFunction2D distanceFunction, TSPStorageLayout layout, TSPElementType elementType)
 {
-	_initializeMatrix(coords, 2, [&](uint64 n, double* coord1, double* coord2)
-		{
-			matrix[n] = distanceFunction(coord1[0], coord1[1], coord2[0], coord2[1]);
-		});
+	if (layout == TSP_LAYOUT_COORDINATES)
+	{
+		distances = TSPDistances(coords, 2, distanceFunction, 0);
+		return;
+	}
+	_initializeMatrix(coords, 2, distanceFunction, 0, layout, elementType);
 }
 
-TSPMatrix3D::TSPMatrix3D(std::vector<double> coords, DistanceFunction3D distanceFunction)
+TSPMatrix3D::TSPMatrix3D(std::vector<double> coords, DistanceFunction3D distanceFunction, TSPStorageLayout layout, TSPElementType elementType)
 {
-	_initializeMatrix(coords, 3, [&](uint64 n, double* coord1, double* coord2)
-		{
-			matrix[n] = distanceFunction(coord1[0], coord1[1], coord1[2], coord2[0], coord2[1], coord2[2]);
-		});
+	if (layout == TSP_LAYOUT_COORDINATES)
+	{
+		distances = TSPDistances(coords, 3, 0, distanceFunction);
+		return;
+	}
+	_initializeMatrix(coords, 3, 0, distanceFunction, layout, elementType);
 }
 
 void TSPMatrix::print(uint8 precision)
 {
-	if (matrix.size() == 0 || matrixWidth == 0)
+	uint64 width = distances.getWidth();
+	if (width == 0)
 		throw std::runtime_error("Attempted to print an uninitialized TSPMatrix");
 
 	std::cout << " ";
-	for (uint64 y = 0; y < matrixWidth; ++y)
+	for (uint64 y = 0; y < width; ++y)
 	{
-		for (uint64 x = 0; x < matrixWidth; ++x)
+		for (uint64 x = 0; x < width; ++x)
 		{
-			std::cout << std::left << std::setw(10) << std::fixed << std::setprecision(precision)  <<  matrix[x + y * matrixWidth];
+			std::cout << std::left << std::setw(10) << std::fixed << std::setprecision(precision)  <<  distances(y, x);
 		}
 		std::cout << std::endl << ' ';
 	}
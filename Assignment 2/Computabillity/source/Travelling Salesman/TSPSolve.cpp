@@ -3,13 +3,6 @@
 #include <algorithm>
 #include <functional>
 
-ChristofidesMinMatchingFunctionPointer christofidesMinMatchFunctions[] =
-{
-	nearestNeighbourMinMatching,
-	bruteForceMinMatching,
-	hungarianMinMatching
-};
-
 uint8 solveAlgorithmVariant = 0;
 
 void TSPPath::print(bool fullPath)
@@ -26,9 +19,10 @@ void TSPPath::print(bool fullPath)
 }
 
 
-TSPPath solveTSPBruteForce(std::vector<double> matrix, uint64 width)
+template<typename Distances> TSPPath solveTSPBruteForce(const Distances& distances)
 {
-	if (matrix.size() == 0 || width == 0)
+	uint64 width = distances.getWidth();
+	if (width == 0)
 		throw std::runtime_error("Attempted to solve an uninitialized TSPMatrix");
 
 
@@ -49,13 +43,13 @@ TSPPath solveTSPBruteForce(std::vector<double> matrix, uint64 width)
 		for (uint64 i = 0; i < indices.size(); ++i)
 		{
 			matY = indices[i];
-			if (matY * width + matX >= width * width) throw std::runtime_error("Hello");
-			pathLength += matrix[matY * width + matX];
+			if (matY >= width || matX >= width) throw std::runtime_error("Hello");
+			pathLength += distances(matY, matX);
 			currentPath[i] = matX;
 			matX = indices[i];
 		}
-		if (matY * width + matX >= width * width) throw std::runtime_error("Hello2");
-		pathLength += matrix[matY * width];
+		if (matY >= width || matX >= width) throw std::runtime_error("Hello2");
+		pathLength += distances(matY, 0);
 		currentPath[width - 1] = matY;
 
 		if (pathLength < path.fullLength)
@@ -68,9 +62,10 @@ TSPPath solveTSPBruteForce(std::vector<double> matrix, uint64 width)
 	return path;
 }
 
-TSPPath solveTSPNearestNeighbour(std::vector<double> matrix, uint64 width)
+template<typename Distances> TSPPath solveTSPNearestNeighbour(const Distances& distances)
 {
-	if (matrix.size() == 0 || width == 0)
+	uint64 width = distances.getWidth();
+	if (width == 0)
 		throw std::runtime_error("Attempted to solve an uninitialized TSPMatrix");
 
 	std::vector<bool> visited(width);
@@ -89,10 +84,10 @@ TSPPath solveTSPNearestNeighbour(std::vector<double> matrix, uint64 width)
 		{
 			if (!visited[i])
 			{
-				if (matrix[row * width + i] < min)
+				if (distances(row, i) < min)
 				{
 					minI = i;
-					min = matrix[row * width + i];
+					min = distances(row, i);
 				}
 			}
 		}
@@ -101,13 +96,14 @@ TSPPath solveTSPNearestNeighbour(std::vector<double> matrix, uint64 width)
 		path.fullLength += min;
 		visited[row] = true;
 	}
-	path.fullLength += matrix[path.path[path.count - 1] * width];
+	path.fullLength += distances(path.path[path.count - 1], 0);
 
 	return path;
 }
 
-PairList _getMinSpanTree(std::vector<double> matrix, uint64 width)
+template<typename Distances> PairList _getMinSpanTree(const Distances& distances)
 {
+	uint64 width = distances.getWidth();
 	std::vector<std::pair<uint64, uint64>> minSpanTree;
 	std::vector<bool> visited(width);
 	visited[0] = true;
@@ -116,7 +112,7 @@ PairList _getMinSpanTree(std::vector<double> matrix, uint64 width)
 	// First pair
 	for (uint64 i = 2; i < width; ++i)
 	{
-		if (matrix[i] < matrix[minI])
+		if (distances(0, i) < distances(0, minI))
 			minI = i;
 	}
 	minSpanTree.push_back(std::make_pair((uint64)0, minI));
@@ -137,9 +133,9 @@ PairList _getMinSpanTree(std::vector<double> matrix, uint64 width)
 				{
 					if (!visited[j])
 					{
-						if (matrix[i * width + j] < min)
+						if (distances(i, j) < min)
 						{
-							min = matrix[i * width + j];
+							min = distances(i, j);
 							minF = std::make_pair(i, j);
 						}
 					}
@@ -153,12 +149,13 @@ PairList _getMinSpanTree(std::vector<double> matrix, uint64 width)
 	return minSpanTree;
 }
 
-TSPPath solveTSPMinSpanTree(std::vector<double> matrix, uint64 width)
+template<typename Distances> TSPPath solveTSPMinSpanTree(const Distances& distances)
 {
+	uint64 width = distances.getWidth();
 	std::vector<bool> visited(width);
 	visited[0] = true;
 
-	std::vector<std::pair<uint64, uint64>> minSpanTree = _getMinSpanTree(matrix, width);
+	std::vector<std::pair<uint64, uint64>> minSpanTree = _getMinSpanTree(distances);
 
 
 	// Remove any duplicate visits to nodes 
@@ -175,11 +172,11 @@ TSPPath solveTSPMinSpanTree(std::vector<double> matrix, uint64 width)
 			{
 				visited[*pair] = true;
 				path.path.push_back(*pair);
-				path.fullLength += matrix[path.path[path.path.size() - 2] * width + (*pair)];
+				path.fullLength += distances(path.path[path.path.size() - 2], *pair);
 			}
 		}
 	}
-	path.fullLength += matrix[path.path[path.path.size() - 1] * width];
+	path.fullLength += distances(path.path[path.path.size() - 1], 0);
 	return path;
 }
 
@@ -201,7 +198,7 @@ std::vector<uint64> findOddDegreeNodes(PairList minSpanTree)
 	return oddNodes;
 }
 
-PairList nearestNeighbourMinMatching(std::vector<uint64> oddNodes, std::vector<double> matrix, uint64 width)
+template<typename Distances> PairList nearestNeighbourMinMatching(std::vector<uint64> oddNodes, const Distances& distances)
 {
 	PairList oddPairs(oddNodes.size() / 2);
 	std::vector<bool> matched(oddNodes.size());
@@ -216,7 +213,7 @@ PairList nearestNeighbourMinMatching(std::vector<uint64> oddNodes, std::vector<d
 			if (matched[j]) continue;
 			if (j == i) continue;
 
-			double distance = matrix[oddNodes[i] * width + oddNodes[j]];
+			double distance = distances(oddNodes[i], oddNodes[j]);
 			if (distance < min)
 			{
 				min = distance;
@@ -234,7 +231,7 @@ PairList nearestNeighbourMinMatching(std::vector<uint64> oddNodes, std::vector<d
 	return oddPairs;
 }
 
-PairList bruteForceMinMatching(std::vector<uint64> oddNodes, std::vector<double> matrix, uint64 width)
+template<typename Distances> PairList bruteForceMinMatching(std::vector<uint64> oddNodes, const Distances& distances)
 {
 	// TODO: This is a far from optimal brute force method, it doesn't take
 	//     take into account that the pair (a,b) == (b,a) nor that the set
@@ -248,7 +245,7 @@ PairList bruteForceMinMatching(std::vector<uint64> oddNodes, std::vector<double>
 		double distance = 0;
 		for (uint64 i = 0; i < oddNodes.size() / 2; ++i)
 		{
-			distance += matrix[oddNodes[i * 2] * width + oddNodes[i * 2 + 1]];
+			distance += distances(oddNodes[i * 2], oddNodes[i * 2 + 1]);
 		}
 
 		if (distance < min)
@@ -269,7 +266,7 @@ PairList bruteForceMinMatching(std::vector<uint64> oddNodes, std::vector<double>
 	return oddPairs;
 }
 
-PairList hungarianMinMatching(std::vector<uint64> oddNodes, std::vector<double> matrix, uint64 width)
+template<typename Distances> PairList hungarianMinMatching(std::vector<uint64> oddNodes, const Distances& distances)
 {
 	std::vector<bool> matched(oddNodes.size());
 	uint64 oddWidth = oddNodes.size();
@@ -285,7 +282,7 @@ PairList hungarianMinMatching(std::vector<uint64> oddNodes, std::vector<double>
 			if (i == j)
 				oddMatrix[i * oddWidth + j] = DBL_MAX;
 			else
-				oddMatrix[i * oddWidth + j] = matrix[oddNodes[i] * width + oddNodes[j]];
+				oddMatrix[i * oddWidth + j] = distances(oddNodes[i], oddNodes[j]);
 		}
 	}
 
@@ -554,7 +551,7 @@ PairList hungarianMinMatching(std::vector<uint64> oddNodes, std::vector<double>
 					
 					// Find the single pair containing our node and get
 					//    the node it is paired with.
-					uint64 nodeToRuleOut;
+					uint64 nodeToRuleOut = 0;
 					for (uint64 j = 0; j < oddPairs.size(); ++j)
 					{
 						if (subRuledOut[j]) continue;
@@ -642,13 +639,20 @@ PairList hungarianMinMatching(std::vector<uint64> oddNodes, std::vector<double>
 	return finalList;
 }
 
-TSPPath solveTSPChristofides(std::vector<double> matrix, uint64 width)
+template<typename Distances> TSPPath solveTSPChristofides(const Distances& distances)
 {
-	auto minSpanTree = _getMinSpanTree(matrix, width);
+	uint64 width = distances.getWidth();
+	auto minSpanTree = _getMinSpanTree(distances);
 
 	auto oddNodes = findOddDegreeNodes(minSpanTree);
 
-	auto oddPairs = christofidesMinMatchFunctions[solveAlgorithmVariant](oddNodes, matrix, width); 
+	static const ChristofidesMinMatchingFunctionPointer<Distances> christofidesMinMatchFunctions[] =
+	{
+		nearestNeighbourMinMatching<Distances>,
+		bruteForceMinMatching<Distances>,
+		hungarianMinMatching<Distances>
+	};
+	auto oddPairs = christofidesMinMatchFunctions[solveAlgorithmVariant](oddNodes, distances); 
 
 	// Add the oddNodePairs to the minSpanTree
 	for (uint64 i = 0; i < oddPairs.size(); ++i)
@@ -690,7 +694,7 @@ TSPPath solveTSPChristofides(std::vector<double> matrix, uint64 width)
 				subWalk.push_back(other);
 				visited[other] = true;
 				path.path.push_back(other);
-				path.fullLength += matrix[n * width + other];
+				path.fullLength += distances(n, other);
 				if (recursionFunction(subWalk, depth + 1)) 
 					return true;
 			}
@@ -703,7 +707,7 @@ TSPPath solveTSPChristofides(std::vector<double> matrix, uint64 width)
 	visited[0] = true;
 	auto last = minSpanTree.end() - 1;
 	path.path.push_back(last->second);
-	path.fullLength = matrix[last->second * width];
+	path.fullLength = distances(last->second, 0);
 	visited[last->second] = true;
 
 	std::vector<uint64> walk(path.path.size());
@@ -722,10 +726,30 @@ TSPPath solveTSPChristofides(std::vector<double> matrix, uint64 width)
 			else continue;
 			visited[n] = true;
 			path.path.push_back(n);
-			path.fullLength += matrix[path.path[path.path.size() - 1] * width + n];
+			path.fullLength += distances(path.path[path.path.size() - 1], n);
 		}
 	}
-	path.fullLength += matrix[path.path[path.path.size() - 1]];
+	path.fullLength += distances(0, path.path[path.path.size() - 1]);
 	path.count = width;
 	return path;
-}
\ No newline at end of file
+}
+
+template<typename Distances> TSPPath solveTSP(TSPSolveFunction solver, const Distances& distances)
+{
+	switch (solver)
+	{
+	case TSP_SOLVE_BRUTE_FORCE:
+		return solveTSPBruteForce(distances);
+	case TSP_SOLVE_NEAREST_NEIGHBOUR:
+		return solveTSPNearestNeighbour(distances);
+	case TSP_SOLVE_CHRISTOFIDES:
+		return solveTSPChristofides(distances);
+	case TSP_SOLVE_MIN_SPAN_TREE:
+		return solveTSPMinSpanTree(distances);
+	default:
+		throw std::runtime_error("No solving algorithm was selected!");
+	}
+}
+
+#define INSTANTIATE_SOLVE_TSP(View) template TSPPath solveTSP<View>(TSPSolveFunction, const View&);
+TSP_DISTANCE_VIEWS(INSTANTIATE_SOLVE_TSP)
\ No newline at end of file
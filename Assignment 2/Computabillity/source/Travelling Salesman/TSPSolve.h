@@ -1,5 +1,6 @@
 #pragma once
 #include "common.h"
+#include "TSPDistances.h"
 struct TSPPath
 {
 	uint64 count;
@@ -10,23 +11,35 @@ struct TSPPath
 };
 
 
-typedef TSPPath(*TSPSolveFunction)(std::vector<double> matrix, uint64 width);
+// Which solving function solveTSP runs.
+enum TSPSolveFunction : uint8
+{
+	TSP_SOLVE_NONE,
+	TSP_SOLVE_BRUTE_FORCE,
+	TSP_SOLVE_NEAREST_NEIGHBOUR,
+	TSP_SOLVE_CHRISTOFIDES,
+	TSP_SOLVE_MIN_SPAN_TREE
+};
 
 // Can be used by solving algorithms to provide extra options
 extern uint8 solveAlgorithmVariant;
 
-// Solving functions
-TSPPath solveTSPBruteForce(std::vector<double> matrix, uint64 width);
-TSPPath solveTSPNearestNeighbour(std::vector<double> matrix, uint64 width);
-TSPPath solveTSPChristofides(std::vector<double> matrix, uint64 width);
-TSPPath solveTSPMinSpanTree(std::vector<double> matrix, uint64 width);
+// Runs solver on distances which is one of the views in TSP_DISTANCE_VIEWS,
+//    they're all instantiated in TSPSolve.cpp.
+template<typename Distances> TSPPath solveTSP(TSPSolveFunction solver, const Distances& distances);
+
+// Solving functions, each takes any view of the distances and copies none of them.
+template<typename Distances> TSPPath solveTSPBruteForce(const Distances& distances);
+template<typename Distances> TSPPath solveTSPNearestNeighbour(const Distances& distances);
+template<typename Distances> TSPPath solveTSPChristofides(const Distances& distances);
+template<typename Distances> TSPPath solveTSPMinSpanTree(const Distances& distances);
 
 // Christofides Minimum Matching algorithms
 typedef std::vector<std::pair<uint64, uint64>> PairList;
-typedef PairList(*ChristofidesMinMatchingFunctionPointer) (std::vector<uint64> oddNodes, std::vector<double> matrix, uint64 width);
+template<typename Distances> using ChristofidesMinMatchingFunctionPointer = PairList(*) (std::vector<uint64> oddNodes, const Distances& distances);
 
 std::vector<uint64> findOddDegreeNodes(PairList minSpanTree);
 
-PairList nearestNeighbourMinMatching (std::vector<uint64> oddNodes, std::vector<double> matrix, uint64 width);
-PairList bruteForceMinMatching (std::vector<uint64> oddNodes, std::vector<double> matrix, uint64 width);
-PairList hungarianMinMatching (std::vector<uint64> oddNodes, std::vector<double> matrix, uint64 width);
\ No newline at end of file
+template<typename Distances> PairList nearestNeighbourMinMatching (std::vector<uint64> oddNodes, const Distances& distances);
+template<typename Distances> PairList bruteForceMinMatching (std::vector<uint64> oddNodes, const Distances& distances);
+template<typename Distances> PairList hungarianMinMatching (std::vector<uint64> oddNodes, const Distances& distances);
\ No newline at end of file
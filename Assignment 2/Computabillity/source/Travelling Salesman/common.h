@@ -1,6 +1,7 @@
 #pragma once
 typedef long long int64;
 typedef unsigned long long uint64;
+typedef int int32;
 typedef unsigned int uint32;
 typedef unsigned char uint8;
 #include <vector>
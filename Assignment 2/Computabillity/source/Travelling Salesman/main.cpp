@@ -8,6 +8,9 @@
 bool mFlag = false;
 bool sFlag = false;
 bool qFlag = false;
+// -u, -l and -e[d,f,i], how the distance matrix is stored.
+TSPStorageLayout storageLayout = TSP_LAYOUT_FULL;
+TSPElementType elementType = TSP_ELEMENT_DOUBLE;
 const char* input = 0;
 
 struct {
@@ -17,8 +20,9 @@ struct {
 
 void printUsage()
 {
-	std::cout << "usage: tsp [-b] [-n] [-m] [-c[n,h,b]] [-t] [-s] <input>" << std::endl << std::endl;
-	std::cout << "<input> may be a filepath or a number in which case a random problem with input used as the width is generated" << std::endl << std::endl;
+	std::cout << "usage: tsp [-b] [-n] [-m] [-c[n,h,b]] [-t] [-s] [-u] [-e[d,f,i]] [-l] <input>" << std::endl << std::endl;
+	std::cout << "<input> may be a filepath, - to read the TSPLIB file from stdin or a number in which case a random problem with input" << std::endl;
+	std::cout << "used as the width is generated" << std::endl << std::endl;
 	std::cout << "Flags: " << std::endl;
 	std::cout << "    -s Generate and print statistics." << std::endl;
 	std::cout << "    -q Path length and Node Count only. Do not print full path." << std::endl;
@@ -27,6 +31,10 @@ void printUsage()
 	std::cout << "    -n Use the nearest neighbour algorithm" << std::endl;
 	std::cout << "    -t Use the minimum spanning tree algorithm" << std::endl;
 	std::cout << "    -c[n,h,b] Use the Christofide's algorithm. Matching is done with nearest neighbour (-cn), brute force (-cb) or Hungarian Minimum Matching(-ch)" << std::endl;
+	std::cout << "    -u Only store the distances above the diagonal, halves the matrix size. Explicit matrices must be symmetric." << std::endl;
+	std::cout << "    -l Store no distances, only coordinates, and compute each distance when it's needed. For instances too large" << std::endl;
+	std::cout << "       to fit a matrix in memory, not for explicit matrices. -u and -e are ignored." << std::endl;
+	std::cout << "    -e[d,f,i] Store distances as doubles (-ed, the default), floats (-ef) or 32 bit integers (-ei) rounded to the nearest." << std::endl;
 }
 
 auto startTimer()
@@ -111,23 +119,24 @@ int main(int argc, const char ** argv)
 	argv = args;
 #endif
 	try {
-		TSPSolveFunction solveFunction = 0;
+		TSPSolveFunction solveFunction = TSP_SOLVE_NONE;
 		std::srand(std::time(nullptr));
 		
 		for (uint8 i = 1; i < argc; ++i)
 		{
-			if (argv[i][0] == '-')
+			// A lone - is stdin rather than a flag.
+			if (argv[i][0] == '-' && argv[i][1] != '\0')
 			{
 				switch (argv[i][1])
 				{
 				case 't':
-					solveFunction = solveTSPMinSpanTree;
+					solveFunction = TSP_SOLVE_MIN_SPAN_TREE;
 					break;
 				case 's':
 					sFlag = true;
 					break;
 				case 'c':
-					solveFunction = solveTSPChristofides;
+					solveFunction = TSP_SOLVE_CHRISTOFIDES;
 					if (argv[i][2] == 'n')
 						break; // Default
 					else if (argv[i][2] == 'b')
@@ -139,10 +148,10 @@ int main(int argc, const char ** argv)
 						"Defaulting to nearest neighbour. Argument number: ").append(std::to_string(i)) << std::endl;
 					break;
 				case 'b':
-					solveFunction = solveTSPBruteForce;
+					solveFunction = TSP_SOLVE_BRUTE_FORCE;
 					break;
 				case 'n':
-					solveFunction = solveTSPNearestNeighbour;
+					solveFunction = TSP_SOLVE_NEAREST_NEIGHBOUR;
 					break;
 				case 'm':
 					mFlag = true;
@@ -150,6 +159,23 @@ int main(int argc, const char ** argv)
 				case 'q':
 					qFlag = true;
 					break;
+				case 'u':
+					if (storageLayout != TSP_LAYOUT_COORDINATES)
+						storageLayout = TSP_LAYOUT_TRIANGULAR;
+					break;
+				case 'l':
+					storageLayout = TSP_LAYOUT_COORDINATES;
+					break;
+				case 'e':
+					if (argv[i][2] == 'd')
+						elementType = TSP_ELEMENT_DOUBLE;
+					else if (argv[i][2] == 'f')
+						elementType = TSP_ELEMENT_FLOAT;
+					else if (argv[i][2] == 'i')
+						elementType = TSP_ELEMENT_INT32;
+					else
+						throw std::runtime_error(std::string("No element type was chosen for -e: ").append(argv[i]));
+					break;
 				default:
 					throw std::runtime_error(std::string("Unrecognized flag: ").append(argv[i]));
 				}
@@ -169,7 +195,7 @@ int main(int argc, const char ** argv)
 			exit(0);
 		}
 
-		if (solveFunction == 0)
+		if (solveFunction == TSP_SOLVE_NONE)
 		{
 			std::cout << "No solving algorithm was selected!" << std::endl << std::endl;
 			printUsage();
@@ -201,11 +227,11 @@ int main(int argc, const char ** argv)
 
 		if (genWidth > 0)
 		{
-			mat = TSPMatrix2D(generatedCoords, euclideanDistance2D);
+			mat = TSPMatrix2D(generatedCoords, euclideanDistance2D, storageLayout, elementType);
 		}
 		else
 		{
-			mat = createTSPMatrix(input);
+			mat = createTSPMatrix(input, storageLayout, elementType);
 		}
 		stats.matrixInitializationTime = stopTimer(start);
 		start = startTimer();
@@ -225,7 +251,7 @@ int main(int argc, const char ** argv)
 		if (sFlag)
 		{
 			std::cout << std::endl << "--------------- Statistics ---------------" << std::endl;
-			std::cout << " Matrix Size           : "; printSizeInApproprateUnits(sizeof(double)* mat.getWidth()* mat.getWidth());
+			std::cout << " Matrix Size           : "; printSizeInApproprateUnits(mat.getSizeInBytes());
 			std::cout << " Matrix Initialization : "; printTimeInApproprateUnits(stats.matrixInitializationTime);
 			std::cout << " Solving Algorithm     : "; printTimeInApproprateUnits(stats.solveTime);
 